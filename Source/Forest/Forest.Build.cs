@@ -2,7 +2,11 @@
 
 using UnrealBuildTool;
 using System;
+using System.Collections.Generic;
 using System.IO;
+using System.Security.Cryptography;
+using System.Text;
+using System.Text.RegularExpressions;
 
 public class Forest : ModuleRules
 {
@@ -26,37 +30,144 @@ public class Forest : ModuleRules
 
         PCHUsage = PCHUsageMode.UseExplicitOrSharedPCHs;
 
+        // The engine independent generation code, also buildable on its own with CMake
+        PrivateIncludePaths.Add(Path.Combine(ModuleDirectory, "GenerationCore"));
+
+        // The kernels are compiled in, packaged builds don't have Source/
+        PrivateIncludePaths.Add(EmbedKernels());
+        PublicDefinitions.Add("LANDSCAPEGENERATION_EMBEDDED_KERNELS=1");
+
         PrivateDependencyModuleNames.AddRange(new string[] {
-                "LandscapeEditor",
-                // Taken from LandscapeEditor
                 "Core",
                 "CoreUObject",
                 "ApplicationCore",
                 "Slate",
                 "SlateCore",
-                "EditorStyle",
                 "Engine",
                 "Landscape",
                 "RenderCore",
                 "RHI",
                 "InputCore",
-                "UnrealEd",
-                "PropertyEditor",
                 "ImageWrapper",
-                "EditorWidgets",
                 "Foliage",
-                "ViewportInteraction",
-                "VREditor"
-
+                // Runtime terrain streaming
+                "ProceduralMeshComponent"
                 });
-        PublicIncludePaths.AddRange(new string[] { EditorPath + "LandscapeEditor/Private" });
 
-        PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay", "Landscape", "LandscapeEditor", "RHI", "RenderCore" });
+        PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore", "HeadMountedDisplay", "Landscape", "RHI", "RenderCore" });
+
+        // Writing to ALandscape goes through the landscape editor, so it's only
+        // available in editor builds. Packaged games use ATerrainStreamer instead
+        if (Target.bBuildEditor)
+        {
+            PrivateDependencyModuleNames.AddRange(new string[] {
+                    "LandscapeEditor",
+                    // Taken from LandscapeEditor
+                    "EditorStyle",
+                    "UnrealEd",
+                    "PropertyEditor",
+                    "EditorWidgets",
+                    "ViewportInteraction",
+                    "VREditor"
+                    });
+            PublicIncludePaths.AddRange(new string[] { EditorPath + "LandscapeEditor/Private" });
+
+            PublicDependencyModuleNames.Add("LandscapeEditor");
+        }
 
         AddComputePath(Target);
 
     }
 
+    // Turns Kernels/*.cl in to byte arrays in EmbeddedKernelSources.h and
+    // returns the directory it's in. Does the same as GenerationCore/EmbedKernels.cmake,
+    // both have to produce the same sources and hashes
+    private string EmbedKernels()
+    {
+        string KernelsDir = Path.Combine(ModulePath, "Kernels");
+        string OutputDir = Path.GetFullPath(Path.Combine(ModulePath, "../../Intermediate/EmbeddedKernels"));
+        string OutputPath = Path.Combine(OutputDir, "EmbeddedKernelSources.h");
+
+        // Latin-1 maps every byte to one char, so the sources go through untouched
+        Encoding Bytes = Encoding.GetEncoding(28591);
+
+        string[] KernelFiles = Directory.GetFiles(KernelsDir, "*.cl");
+        Array.Sort(KernelFiles, StringComparer.Ordinal);
+
+        StringBuilder Arrays = new StringBuilder();
+        StringBuilder Entries = new StringBuilder();
+
+        foreach (string KernelPath in KernelFiles)
+        {
+            string KernelFile = Path.GetFileName(KernelPath);
+            string Content = Bytes.GetString(File.ReadAllBytes(KernelPath));
+
+            // #include "file" is replaced with the file, once per kernel and
+            // without its #pragma once, nothing is compiled with -I
+            List<string> Included = new List<string>();
+            Match Include;
+            while ((Include = Regex.Match(Content, "#include \"([^\"]+)\"")).Success)
+            {
+                string Header = Include.Groups[1].Value;
+                string Replacement = "";
+
+                if (!Included.Contains(Header))
+                {
+                    string HeaderPath = Path.Combine(KernelsDir, Header);
+                    if (!File.Exists(HeaderPath))
+                    {
+                        throw new BuildException(Header + " is included but isn't in " + KernelsDir);
+                    }
+
+                    Included.Add(Header);
+                    Replacement = Regex.Replace(Bytes.GetString(File.ReadAllBytes(HeaderPath)), "#pragma once[^\n]*\n?", "");
+                }
+
+                int Position = Content.IndexOf(Include.Value, StringComparison.Ordinal);
+                Content = Content.Substring(0, Position) + Replacement + Content.Substring(Position + Include.Value.Length);
+            }
+
+            // Visual Studio likes to put BOMs in UTF-8 files
+            byte[] Source = Bytes.GetBytes(Content.Replace("\u00EF\u00BB\u00BF", ""));
+
+            string Hash;
+            using (SHA256 Sha = SHA256.Create())
+            {
+                Hash = BitConverter.ToString(Sha.ComputeHash(Source)).Replace("-", "").ToLowerInvariant().Substring(0, 16);
+            }
+
+            string Identifier = Regex.Replace(KernelFile, "[^A-Za-z0-9_]", "_");
+
+            Arrays.Append("static const unsigned char " + Identifier + "[] = {\n\t");
+            for (int i = 0; i < Source.Length; i++)
+            {
+                Arrays.Append("0x" + Source[i].ToString("x2") + ", ");
+                if ((i + 1) % 16 == 0)
+                {
+                    Arrays.Append("\n\t");
+                }
+            }
+            Arrays.Append("0x00\n};\n\n");
+
+            Entries.Append("\t{ \"" + KernelFile + "\", (const char*)" + Identifier + ", " + Source.Length + ", 0x" + Hash + "ull },\n");
+        }
+
+        string Output = "// Generated by Forest.Build.cs from " + KernelsDir + ", don't edit\n\n#pragma once\n\n"
+            + "namespace LandscapeGeneration\n{\n\tnamespace EmbeddedKernels\n\t{\n\t\tnamespace Generated\n\t\t{\n"
+            + Arrays.ToString()
+            + "static const Source Sources[] = {\n" + Entries.ToString() + "};\n"
+            + "\t\t}\n\t}\n}\n";
+
+        // Only touch the header if it changed, so nothing is rebuilt for nothing
+        Directory.CreateDirectory(OutputDir);
+        if (!File.Exists(OutputPath) || File.ReadAllText(OutputPath) != Output)
+        {
+            File.WriteAllText(OutputPath, Output);
+        }
+
+        return OutputDir;
+    }
+
     public void AddComputePath(ReadOnlyTargetRules Target)
     {
         bUseRTTI = true;
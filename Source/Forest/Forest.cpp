@@ -3,6 +3,7 @@
 #include "Forest.h"
 #include "Modules/ModuleManager.h"
 #include "EngineUtils.h"
+#include "LandscapeGeneration.h"
 
 class FForest : public FDefaultGameModuleImpl
 {
@@ -17,10 +18,17 @@ class FForest : public FDefaultGameModuleImpl
 			UE_LOG(LogTemp, Display, TEXT("Successfully loaded OpenCL.dll"));
 			//GEngine->AddOnScreenDebugMessage(-1, 15.0f, FColor::Red, TEXT("Successfully loaded OpenCL.dll"));
 		}
+
+		LandscapeGeneration::SetupForUnreal();
+
+		// Context creation and kernel builds happen in the background, so the
+		// first node doesn't wait for them and the editor doesn't either
+		LandscapeGeneration::StartWarmUpForUnreal();
 	}
 
 	virtual void ShutdownModule() override
 	{
+		LandscapeGeneration::ShutdownForUnreal();
 		FPlatformProcess::FreeDllHandle(DLLHandle);
 	}
 };
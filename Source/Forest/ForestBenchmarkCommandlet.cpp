@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ForestBenchmarkCommandlet.h"
+#include "Benchmark.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+
+UForestBenchmarkCommandlet::UForestBenchmarkCommandlet(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	IsClient		= false;
+	IsEditor		= false;
+	IsServer		= false;
+	LogToConsole	= true;
+}
+
+int32 UForestBenchmarkCommandlet::Main(const FString& Params)
+{
+	namespace Benchmark = LandscapeGeneration::Benchmark;
+
+	Benchmark::Settings Settings;
+
+	int32 DeviceIndex = Settings.DeviceIndex, Runs = Settings.Runs, ErosionIterations = Settings.ErosionIterations;
+	float Tolerance = Settings.Tolerance;
+	FString SizesString;
+	FString OutputPath = FPaths::ProjectSavedDir() + TEXT("Benchmarks/Benchmark.json");
+	FString BaselinePath;
+
+	FParse::Value(*Params, TEXT("device="), DeviceIndex);
+	FParse::Value(*Params, TEXT("runs="), Runs);
+	FParse::Value(*Params, TEXT("erosioniterations="), ErosionIterations);
+	FParse::Value(*Params, TEXT("tolerance="), Tolerance);
+	FParse::Value(*Params, TEXT("sizes="), SizesString);
+	FParse::Value(*Params, TEXT("json="), OutputPath);
+	FParse::Value(*Params, TEXT("baseline="), BaselinePath);
+
+	Settings.DeviceIndex		= DeviceIndex;
+	Settings.Runs				= Runs;
+	Settings.ErosionIterations	= ErosionIterations;
+	Settings.Tolerance			= Tolerance;
+	Settings.OutputPath			= TCHAR_TO_UTF8(*FPaths::ConvertRelativePathToFull(OutputPath));
+	Settings.BaselinePath		= TCHAR_TO_UTF8(*BaselinePath);
+
+	if (!SizesString.IsEmpty())
+		Settings.Sizes = Benchmark::ParseSizes(TCHAR_TO_UTF8(*SizesString));
+
+	IFileManager::Get().MakeDirectory(*FPaths::GetPath(OutputPath), true);
+
+	return Benchmark::Run(Settings);
+}
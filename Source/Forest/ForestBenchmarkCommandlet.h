@@ -0,0 +1,25 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "ForestBenchmarkCommandlet.generated.h"
+
+// Runs LandscapeGeneration::Benchmark (see Benchmark.h) without opening a level:
+//
+//   UE4Editor-Cmd Forest.uproject -run=ForestBenchmark [-device=0] [-sizes=1024,2048,4096,8192]
+//       [-runs=5] [-erosioniterations=64] [-json=Path] [-baseline=Path] [-tolerance=0.1]
+//
+// The results go to Saved/Benchmarks/Benchmark.json by default. The
+// ForestBenchmark executable from GenerationCore/CMakeLists.txt runs the
+// same benchmark without Unreal. Returns 1 if anything regressed against
+// the baseline, so it can gate a build
+UCLASS()
+class UForestBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_UCLASS_BODY()
+
+public:
+	virtual int32 Main(const FString& Params) override;
+};
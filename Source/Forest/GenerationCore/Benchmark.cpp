@@ -0,0 +1,603 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Benchmark.h"
+#include "LandscapeGenerationCore.h"
+#include "MultiDevice.h"
+#include "Profiling.h"
+
+#include <boost/compute/system.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+namespace compute = boost::compute;
+
+namespace LandscapeGeneration
+{
+	namespace Benchmark
+	{
+		struct CaseResult
+		{
+			std::string	Name;
+			int32_t		Size		= 0;
+			std::string	Metric;
+
+			// Set if the case threw, the numbers are meaningless then
+			std::string	Error;
+
+			double		Value		= 0.0;
+			double		DeviceMs	= 0.0;
+			double		WallMs		= 0.0;
+			double		CompileMs	= 0.0;
+		};
+
+		// Banded erosion against the single device result, see CheckBandedErosion
+		struct BandedErosionCheck
+		{
+			bool		bRan			= false;
+			int32_t		Lanes			= 0;
+			double		MaxDifference	= 0.0;
+			std::string	Error;
+		};
+
+		// Big enough to be split in to a band per lane
+		static const int32_t BandedErosionCheckSize = 1024;
+
+		// Largest height difference that still counts as the same terrain. The
+		// bands should match exactly, this only allows for lanes on different
+		// kinds of device rounding differently
+		static const double BandedErosionTolerance = 1.0e-3;
+
+		std::vector<int32_t> ParseSizes(const std::string& Sizes)
+		{
+			std::vector<int32_t> Parsed;
+
+			std::stringstream Stream(Sizes);
+			std::string Size;
+			while (std::getline(Stream, Size, ','))
+			{
+				if (!Size.empty())
+					Parsed.push_back(std::atoi(Size.c_str()));
+			}
+
+			return Parsed;
+		}
+
+		// Device and build time of everything traced since the last Profiling::Clear
+		static void SumTraces(double& OutDeviceMs, double& OutCompileMs)
+		{
+			OutDeviceMs		= 0.0;
+			OutCompileMs	= 0.0;
+
+			for (auto& Total : Profiling::Summarize())
+			{
+				if (Total.bDevice)
+					OutDeviceMs += Total.TotalMicroseconds / 1000.0;
+				else if (Total.Category == "Compile")
+					OutCompileMs += Total.TotalMicroseconds / 1000.0;
+			}
+		}
+
+		static double Median(std::vector<double> Values)
+		{
+			if (Values.empty())
+				return 0.0;
+
+			std::sort(Values.begin(), Values.end());
+			return Values[Values.size() / 2];
+		}
+
+		static double MillisecondsSince(std::chrono::steady_clock::time_point StartTime)
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - StartTime).count();
+		}
+
+		// Runs Work once to warm up (this is where programs get built) and then Runs
+		// times. Value is Units divided by the median device time in seconds
+		static CaseResult RunCase(const std::string& Name, int32_t Size, const std::string& Metric, double Units,
+			int32_t Runs, const std::function<void()>& Work)
+		{
+			CaseResult Result;
+			Result.Name		= Name;
+			Result.Size		= Size;
+			Result.Metric	= Metric;
+
+			char Line[256];
+
+			try
+			{
+				double WarmupDeviceMs;
+
+				Profiling::Clear();
+				Work();
+				Finish();
+				SumTraces(WarmupDeviceMs, Result.CompileMs);
+
+				std::vector<double> WallTimes, DeviceTimes;
+				for (int32_t Run = 0; Run < Runs; Run++)
+				{
+					Profiling::Clear();
+
+					const auto StartTime = std::chrono::steady_clock::now();
+					Work();
+					Finish();
+					WallTimes.push_back(MillisecondsSince(StartTime));
+
+					double DeviceMs, RunCompileMs;
+					SumTraces(DeviceMs, RunCompileMs);
+					DeviceTimes.push_back(DeviceMs);
+				}
+
+				Result.DeviceMs	= Median(DeviceTimes);
+				Result.WallMs	= Median(WallTimes);
+				Result.Value	= Result.DeviceMs > 0.0 ? Units / (Result.DeviceMs / 1000.0) : 0.0;
+
+				std::snprintf(Line, sizeof(Line), "%-20s %5d: %10.2f %s (device %.2f ms, wall %.2f ms, compile %.2f ms)",
+					Name.c_str(), Size, Result.Value, Metric.c_str(), Result.DeviceMs, Result.WallMs, Result.CompileMs);
+			}
+			catch (std::exception& e)
+			{
+				// Most likely the device ran out of memory at the bigger sizes
+				Result.Error = e.what();
+
+				std::snprintf(Line, sizeof(Line), "%-20s %5d: failed, %s", Name.c_str(), Size, e.what());
+			}
+
+			Log(Line);
+			return Result;
+		}
+
+		// Dry erosion state around Height
+		static Kernels::ErosionParams CreateErosionMaps(const std::shared_ptr<Heightmap>& Height, int32_t Size)
+		{
+			const auto FluxImageFormat	= compute::image_format(CL_RGBA, CL_FLOAT);
+			const auto WaterImageFormat	= compute::image_format(CL_R, CL_FLOAT);
+
+			Kernels::ErosionParams Maps;
+			Maps.height				= Height;
+			Maps.water				= CreateHeightmap(Size, Size, WaterImageFormat);
+			Maps.hardness			= CreateHeightmap(Size, Size, WaterImageFormat);
+			Maps.sediment			= CreateHeightmap(Size, Size, WaterImageFormat);
+			Maps.sedimentCapacity	= CreateHeightmap(Size, Size, WaterImageFormat);
+			Maps.flux				= CreateHeightmap(Size, Size, FluxImageFormat);
+			Maps.velocity			= CreateHeightmap(Size, Size, FluxImageFormat);
+			Kernels::ClearErosionState(Maps);
+
+			return Maps;
+		}
+
+		// The heights after eroding the same seeded Perlin terrain, with or
+		// without splitting it over the MultiDevice lanes
+		static std::vector<float> ErodeForCheck(int32_t Iterations, bool bBanded)
+		{
+			const int32_t Size = BandedErosionCheckSize;
+
+			auto Height = CreateHeightmap(Size, Size);
+			Kernels::PerlinNoise(Height->Image, 256.f, 0, 6, 1000.f);
+
+			MultiDevice::SetEnabled(bBanded);
+
+			Kernels::ErosionParams Maps = CreateErosionMaps(Height, Size);
+			Kernels::ErosionSettings Settings;
+			Kernels::Erosion(Maps, Iterations, Settings.DeltaTime, Settings.waterMul,
+				Settings.softeningCoefficient, Settings.maxErosionDepth, Settings.sedimentCapacity);
+
+			float* RawCopy = (float*)Height->CreateRawCopy();
+			std::vector<float> Heights(RawCopy, RawCopy + (size_t)Size * Size);
+			delete[] (uint8_t*)RawCopy;
+
+			return Heights;
+		}
+
+		// Banded erosion has to give the same terrain as a single device, the
+		// halos the bands exchange every batch are what keeps the band edges
+		// seamless. Only runs with more than one lane
+		static BandedErosionCheck CheckBandedErosion(int32_t Iterations)
+		{
+			BandedErosionCheck Check;
+
+			const bool bWasEnabled = MultiDevice::IsEnabled();
+
+			try
+			{
+				MultiDevice::SetEnabled(true);
+				Check.Lanes = (int32_t)MultiDevice::GetLanes().size();
+
+				if (Check.Lanes > 1 && MultiDevice::ShouldSplit(BandedErosionCheckSize))
+				{
+					const std::vector<float> Single	= ErodeForCheck(Iterations, false);
+					const std::vector<float> Banded	= ErodeForCheck(Iterations, true);
+
+					Check.bRan = true;
+					for (size_t i = 0; i < Single.size(); i++)
+					{
+						Check.MaxDifference = std::max(Check.MaxDifference, (double)std::fabs(Single[i] - Banded[i]));
+					}
+				}
+			}
+			catch (std::exception& e)
+			{
+				Check.bRan	= true;
+				Check.Error	= e.what();
+			}
+
+			MultiDevice::SetEnabled(bWasEnabled);
+
+			if (!Check.bRan)
+				Log("Banded erosion check skipped, there's only one lane");
+			else if (!Check.Error.empty())
+				Log("Banded erosion check failed: " + Check.Error);
+			else
+				Log("Banded erosion on " + std::to_string(Check.Lanes) + " lanes differs from a single device by at most "
+					+ std::to_string(Check.MaxDifference));
+
+			return Check;
+		}
+
+		static bool HasPassed(const BandedErosionCheck& Check)
+		{
+			return !Check.bRan || (Check.Error.empty() && Check.MaxDifference <= BandedErosionTolerance);
+		}
+
+		static std::vector<CaseResult> RunSize(int32_t Size, int32_t Runs, int32_t ErosionIterations)
+		{
+			std::vector<CaseResult> Results;
+			auto Add = [&](CaseResult Result)
+			{
+				Results.push_back(std::move(Result));
+			};
+
+			const double MPixels	= (double)Size * Size / 1.0e6;
+			const double GBytes		= (double)Size * Size * sizeof(float) / 1.0e9;
+
+			std::shared_ptr<Heightmap> Output, Other, Mixed;
+			try
+			{
+				Output	= CreateHeightmap(Size, Size);
+				Other	= CreateHeightmap(Size, Size);
+				Mixed	= CreateHeightmap(Size, Size);
+			}
+			catch (std::exception& e)
+			{
+				Log("Skipping size " + std::to_string(Size) + ", " + e.what());
+				return Results;
+			}
+
+			// Constant is a device side fill, nothing is uploaded
+			Add(RunCase("Constant", Size, "gb_per_second", GBytes, Runs, [&]()
+			{
+				Kernels::Constant(Output->Image, 100.f);
+			}));
+
+			Add(RunCase("Readback", Size, "gb_per_second", GBytes, Runs, [&]()
+			{
+				delete[] (uint8_t*)Output->CreateRawCopy();
+			}));
+
+			Add(RunCase("Perlin", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::PerlinNoise(Output->Image, 256.f, 0, 6, 1000.f);
+			}));
+
+			// Four seeds as the layers of one image array, a single dispatch for all of them.
+			// The array is created on the first run, so the warm up pays for it
+			{
+				compute::image_object Layers;
+				std::vector<Kernels::BatchNoiseParams> Seeds(4);
+				for (size_t i = 0; i < Seeds.size(); i++)
+				{
+					Seeds[i].Seed		= (int32_t)i;
+					Seeds[i].NoiseSize	= 256.f;
+					Seeds[i].Amplitude	= 1000.f;
+				}
+
+				Add(RunCase("Perlin Batch x4", Size, "mpixels_per_second", MPixels * Seeds.size(), Runs, [&]()
+				{
+					if (!Layers.get())
+						Layers = CreateHeightmapArray(Size, Size, Seeds.size());
+
+					Kernels::PerlinNoiseLayers(Layers, Seeds, 6);
+				}));
+			}
+
+			Add(RunCase("Warped Perlin", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::WarpedPerlinNoise(Other->Image, 256.f, 0, 6, 1000.f);
+			}));
+
+			// The warp evaluated per pixel, what Warped Perlin cost before the warp field
+			Add(RunCase("Warped Perlin (full warp)", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::WarpFieldSettings FullWarp;
+				FullWarp.Downsample = 1;
+				Kernels::WarpedPerlinNoise(Other->Image, 256.f, 0, 6, 1000.f, Kernels::TileRegion(), FullWarp);
+			}));
+
+			// Same size and octaves as Perlin, so the noise engines can be compared
+			Add(RunCase("Simplex", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::SimplexNoise(Other->Image, 256.f, 0, 6, 1000.f);
+			}));
+
+			Add(RunCase("Gradient", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::GradientNoise(Other->Image, 256.f, 0, 6, 1000.f);
+			}));
+
+			Add(RunCase("Voronoi", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::VoronoiNoise(Other->Image, 64, 0, 1000.f);
+			}));
+
+			Add(RunCase("Mix", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::Mix(Output->Image, Other->Image, Mixed->Image, MixOperation::Max);
+			}));
+
+			// The filters cost the same per pixel at any radius, a small and a large one show it
+			Add(RunCase("Box Blur r2", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::BoxBlur(Output->Image, Mixed->Image, 2);
+			}));
+
+			Add(RunCase("Box Blur r64", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::BoxBlur(Output->Image, Mixed->Image, 64);
+			}));
+
+			Add(RunCase("Gaussian Blur", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::GaussianBlur(Output->Image, Mixed->Image, 16.f);
+			}));
+
+			Add(RunCase("Max Filter r64", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::MaxFilter(Output->Image, Mixed->Image, 64);
+			}));
+
+			Add(RunCase("Statistics", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::Statistics(Output->Image);
+			}));
+
+			Add(RunCase("Histogram Equalize", Size, "mpixels_per_second", MPixels, Runs, [&]()
+			{
+				Kernels::HistogramEqualize(Output->Image, Mixed->Image, 1024);
+			}));
+
+			// Erosion keeps seven maps alive, drop the noise outputs first
+			Other.reset();
+			Mixed.reset();
+
+			Add(RunCase("Erosion", Size, "iterations_per_second", ErosionIterations, Runs, [&]()
+			{
+				Kernels::ErosionParams Maps = CreateErosionMaps(Output, Size);
+
+				Kernels::ErosionSettings Settings;
+				Kernels::Erosion(Maps, ErosionIterations, Settings.DeltaTime, Settings.waterMul,
+					Settings.softeningCoefficient, Settings.maxErosionDepth, Settings.sedimentCapacity);
+			}));
+
+			// Four settings from one input, iterations of every run count
+			Add(RunCase("Erosion Sweep x4", Size, "iterations_per_second", ErosionIterations * 4.0, Runs, [&]()
+			{
+				Kernels::ErosionParams Maps = CreateErosionMaps(Output, Size);
+
+				Kernels::ErosionSweep(Maps, ErosionIterations,
+					Kernels::ErosionSweepGrid(Kernels::ErosionSettings(), { 0.006f, 0.012f }, {}, { 5.f, 10.f }, {}));
+			}));
+
+			return Results;
+		}
+
+		static std::string EscapeJson(const std::string& String)
+		{
+			std::string Escaped;
+
+			for (char c : String)
+			{
+				if (c == '"' || c == '\\')
+					Escaped += '\\';
+
+				Escaped += c;
+			}
+
+			return Escaped;
+		}
+
+		static std::string JsonNumber(double Value)
+		{
+			char Buffer[64];
+			std::snprintf(Buffer, sizeof(Buffer), "%.17g", Value);
+			return Buffer;
+		}
+
+		// The same fields as the commandlet wrote with Unreal's Json module
+		// before, so older baselines still compare
+		static bool WriteReport(const std::string& Path, const compute::device& Device, const Settings& BenchmarkSettings,
+			const BandedErosionCheck& Check, const std::vector<CaseResult>& Results)
+		{
+			std::ofstream File(Path, std::ios::out | std::ios::trunc);
+			if (!File)
+				return false;
+
+			File << "{\n"
+				<< "\t\"device\": \"" << EscapeJson(Device.name()) << "\",\n"
+				<< "\t\"platform\": \"" << EscapeJson(Device.platform().name()) << "\",\n"
+				<< "\t\"driver\": \"" << EscapeJson(Device.driver_version()) << "\",\n"
+				<< "\t\"runs\": " << BenchmarkSettings.Runs << ",\n"
+				<< "\t\"erosion_iterations\": " << BenchmarkSettings.ErosionIterations << ",\n";
+
+			if (Check.bRan)
+			{
+				File << "\t\"banded_erosion\": {\n"
+					<< "\t\t\"lanes\": " << Check.Lanes << ",\n";
+
+				if (!Check.Error.empty())
+					File << "\t\t\"error\": \"" << EscapeJson(Check.Error) << "\"\n";
+				else
+					File << "\t\t\"max_difference\": " << JsonNumber(Check.MaxDifference) << "\n";
+
+				File << "\t},\n";
+			}
+
+			File << "\t\"results\": [";
+
+			for (size_t i = 0; i < Results.size(); i++)
+			{
+				const CaseResult& Result = Results[i];
+
+				File << (i == 0 ? "\n" : ",\n")
+					<< "\t\t{\n"
+					<< "\t\t\t\"name\": \"" << EscapeJson(Result.Name) << "\",\n"
+					<< "\t\t\t\"size\": " << Result.Size << ",\n"
+					<< "\t\t\t\"metric\": \"" << Result.Metric << "\",\n";
+
+				if (!Result.Error.empty())
+				{
+					File << "\t\t\t\"error\": \"" << EscapeJson(Result.Error) << "\"\n";
+				}
+				else
+				{
+					File << "\t\t\t\"value\": " << JsonNumber(Result.Value) << ",\n"
+						<< "\t\t\t\"device_ms\": " << JsonNumber(Result.DeviceMs) << ",\n"
+						<< "\t\t\t\"wall_ms\": " << JsonNumber(Result.WallMs) << ",\n"
+						<< "\t\t\t\"compile_ms\": " << JsonNumber(Result.CompileMs) << "\n";
+				}
+
+				File << "\t\t}";
+			}
+
+			File << "\n\t]\n}\n";
+			return (bool)File;
+		}
+
+		// Compares every result against the baseline result with the same name and
+		// size. Returns the number of regressions
+		static int32_t CompareWithBaseline(const std::vector<CaseResult>& Results, const std::string& DeviceName,
+			const std::string& BaselinePath, float Tolerance)
+		{
+			namespace pt = boost::property_tree;
+
+			pt::ptree Baseline;
+			try
+			{
+				pt::read_json(BaselinePath, Baseline);
+			}
+			catch (std::exception&)
+			{
+				Log("Couldn't read the baseline " + BaselinePath);
+				return 0;
+			}
+
+			const std::string BaselineDevice = Baseline.get<std::string>("device", "");
+			if (BaselineDevice != DeviceName)
+				Log("The baseline was recorded on " + BaselineDevice + ", comparing anyway");
+
+			int32_t Regressions = 0;
+
+			for (auto& BaselineValue : Baseline.get_child("results", pt::ptree()))
+			{
+				const pt::ptree& BaselineResult = BaselineValue.second;
+
+				const auto Previous = BaselineResult.get_optional<double>("value");
+				if (!Previous)
+					continue;
+
+				const std::string Name	= BaselineResult.get<std::string>("name", "");
+				const int32_t Size		= BaselineResult.get<int32_t>("size", 0);
+
+				for (const CaseResult& Result : Results)
+				{
+					if (Result.Name != Name || Result.Size != Size)
+						continue;
+
+					// A case that used to run and now fails is a regression too
+					const double Current = Result.Error.empty() ? Result.Value : 0.0;
+
+					if (Current < *Previous * (1.0 - Tolerance))
+					{
+						char Line[256];
+						std::snprintf(Line, sizeof(Line), "Regression: %s %d is at %.2f %s, the baseline is %.2f",
+							Name.c_str(), Size, Current, Result.Metric.c_str(), *Previous);
+						Log(Line);
+
+						Regressions++;
+					}
+				}
+			}
+
+			return Regressions;
+		}
+
+		int32_t Run(const Settings& BenchmarkSettings)
+		{
+			const int32_t Runs = std::max(BenchmarkSettings.Runs, 1);
+
+			std::vector<compute::device> Devices;
+			try
+			{
+				Devices = compute::system::devices();
+			}
+			catch (std::exception& e)
+			{
+				Log(std::string("Couldn't enumerate OpenCL devices: ") + e.what());
+			}
+
+			const int32_t DeviceIndex = BenchmarkSettings.DeviceIndex;
+			if (DeviceIndex < 0 || DeviceIndex >= (int32_t)Devices.size())
+			{
+				Log("No OpenCL device " + std::to_string(DeviceIndex) + ", " + std::to_string(Devices.size()) + " devices found");
+				return 1;
+			}
+
+			const compute::device& Device = Devices[DeviceIndex];
+			SetDevices({ Device });
+
+			Log("Benchmarking on " + Device.name() + " (" + Device.platform().name() + ")");
+
+			// Before profiling, it's a correctness check and not timed
+			const BandedErosionCheck Check = CheckBandedErosion(BenchmarkSettings.ErosionIterations);
+
+			Profiling::SetEnabled(true);
+
+			std::vector<CaseResult> Results;
+			for (int32_t Size : BenchmarkSettings.Sizes)
+			{
+				std::vector<CaseResult> SizeResults = RunSize(Size, Runs, BenchmarkSettings.ErosionIterations);
+				Results.insert(Results.end(), SizeResults.begin(), SizeResults.end());
+			}
+
+			Profiling::SetEnabled(false);
+			Profiling::Clear();
+
+			Settings Written = BenchmarkSettings;
+			Written.Runs = Runs;
+
+			if (WriteReport(BenchmarkSettings.OutputPath, Device, Written, Check, Results))
+				Log("Results written to " + BenchmarkSettings.OutputPath);
+			else
+				Log("Couldn't write the results to " + BenchmarkSettings.OutputPath);
+
+			if (!BenchmarkSettings.BaselinePath.empty())
+			{
+				const int32_t Regressions = CompareWithBaseline(Results, Device.name(), BenchmarkSettings.BaselinePath,
+					BenchmarkSettings.Tolerance);
+				Log(std::to_string(Regressions) + " regressions against " + BenchmarkSettings.BaselinePath);
+
+				if (Regressions > 0)
+					return 1;
+			}
+
+			return HasPassed(Check) ? 0 : 1;
+		}
+	}
+}
@@ -0,0 +1,46 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace LandscapeGeneration
+{
+	// Benchmarks the generation kernels without opening a level. Run by the
+	// ForestBenchmark commandlet and by the ForestBenchmark executable that
+	// CMakeLists.txt builds, both take the same arguments:
+	//
+	//   [-device=0] [-sizes=1024,2048,4096,8192] [-runs=5] [-erosioniterations=64]
+	//       [-json=Path] [-baseline=Path] [-tolerance=0.1]
+	//
+	// Every kernel is run at every size on one OpenCL device (CPU runtimes like
+	// PoCL included) and the results are written as JSON. Throughput is
+	// measured with device time from OpenCL event profiling, wall time and
+	// program build time are reported next to it. If a baseline written by an
+	// earlier run is given, any result that's more than Tolerance slower than
+	// it is reported as a regression. With more than one MultiDevice lane
+	// banded erosion is checked against the single device result first
+	namespace Benchmark
+	{
+		struct Settings
+		{
+			int32_t					DeviceIndex			= 0;
+			std::vector<int32_t>	Sizes				= { 1024, 2048, 4096, 8192 };
+			int32_t					Runs				= 5;
+			int32_t					ErosionIterations	= 64;
+			std::string				OutputPath			= "Benchmark.json";
+			std::string				BaselinePath;
+			float					Tolerance			= 0.1f;
+		};
+
+		// Sizes as a comma separated list, e.g. "1024,2048"
+		std::vector<int32_t> ParseSizes(const std::string& Sizes);
+
+		// Returns the exit code, 1 if the device doesn't exist, there are
+		// regressions against the baseline or erosion split over the
+		// MultiDevice lanes doesn't match a single device, so it can gate a build
+		int32_t Run(const Settings& BenchmarkSettings);
+	}
+}
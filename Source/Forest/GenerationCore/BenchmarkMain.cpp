@@ -0,0 +1,63 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+// Entry point of the ForestBenchmark executable (see CMakeLists.txt), the
+// same benchmark as the ForestBenchmark commandlet without Unreal:
+//
+//   ForestBenchmark [-device=0] [-sizes=1024,2048,4096,8192] [-runs=5]
+//       [-erosioniterations=64] [-json=Path] [-baseline=Path] [-tolerance=0.1]
+//
+// Unreal compiles every file in the module, only the CMake target defines
+// LANDSCAPEGENERATION_BENCHMARK_MAIN
+#ifdef LANDSCAPEGENERATION_BENCHMARK_MAIN
+
+#include "Benchmark.h"
+#include "LandscapeGenerationCore.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Value of -Name=Value, returns false if it isn't Name
+static bool ParseValue(const char* Argument, const char* Name, std::string& OutValue)
+{
+	const size_t Length = std::strlen(Name);
+
+	if (Argument[0] != '-' || std::strncmp(Argument + 1, Name, Length) != 0 || Argument[Length + 1] != '=')
+		return false;
+
+	OutValue = Argument + Length + 2;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	using namespace LandscapeGeneration;
+
+	Benchmark::Settings Settings;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string Value;
+
+		if (ParseValue(argv[i], "device", Value))
+			Settings.DeviceIndex = std::atoi(Value.c_str());
+		else if (ParseValue(argv[i], "sizes", Value))
+			Settings.Sizes = Benchmark::ParseSizes(Value);
+		else if (ParseValue(argv[i], "runs", Value))
+			Settings.Runs = std::atoi(Value.c_str());
+		else if (ParseValue(argv[i], "erosioniterations", Value))
+			Settings.ErosionIterations = std::atoi(Value.c_str());
+		else if (ParseValue(argv[i], "json", Value))
+			Settings.OutputPath = Value;
+		else if (ParseValue(argv[i], "baseline", Value))
+			Settings.BaselinePath = Value;
+		else if (ParseValue(argv[i], "tolerance", Value))
+			Settings.Tolerance = (float)std::atof(Value.c_str());
+		else
+			Log(std::string("Unknown argument ") + argv[i]);
+	}
+
+	return Benchmark::Run(Settings);
+}
+
+#endif
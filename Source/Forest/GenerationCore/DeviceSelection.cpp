@@ -0,0 +1,367 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DeviceSelection.h"
+#include "LandscapeGenerationCore.h"
+
+// Disable warning for GNU_C not being defined
+#pragma warning(push)
+#pragma warning(disable: 4668)
+#define BOOST_COMPUTE_THREAD_SAFE
+#define BOOST_COMPUTE_DEBUG_KERNEL_COMPILATION
+#define BOOST_DISABLE_ABI_HEADERS
+#include <boost/compute/system.hpp>
+#include <boost/compute/image/image2d.hpp>
+#include <boost/compute/utility/dim.hpp>
+#pragma warning(pop)
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+namespace compute = boost::compute;
+
+namespace LandscapeGeneration
+{
+	namespace DeviceSelection
+	{
+		static std::mutex					SelectionMutex;
+		static std::vector<DeviceInfo>		ProbedDevices;
+		static bool							bProbed = false;
+		static std::string					CacheFile;
+		static std::string					OverrideDevice;
+
+		// Big enough to fill any device, small enough to take a few milliseconds
+		static const size_t BenchmarkSize = 1024;
+		static const int32_t BenchmarkRuns = 3;
+
+		// A few octaves of value noise, close enough to what the generation
+		// kernels do (image writes, lots of ALU, no local memory)
+		static const char* BenchmarkSource = R"(
+			float hash(float2 p)
+			{
+				return fract(sin(dot(p, (float2)(127.1f, 311.7f))) * 43758.5453f);
+			}
+
+			__kernel void benchmark(__write_only image2d_t output)
+			{
+				const int2 pos = (int2)(get_global_id(0), get_global_id(1));
+
+				float2 p = convert_float2(pos) * 0.01f;
+				float height = 0.f;
+				float amplitude = 1.f;
+
+				for (int octave = 0; octave < 8; octave++)
+				{
+					const float2 cell = floor(p);
+					const float2 f = p - cell;
+
+					const float a = hash(cell);
+					const float b = hash(cell + (float2)(1.f, 0.f));
+					const float c = hash(cell + (float2)(0.f, 1.f));
+					const float d = hash(cell + (float2)(1.f, 1.f));
+
+					height += amplitude * mix(mix(a, b, f.x), mix(c, d, f.x), f.y);
+					p *= 2.f;
+					amplitude *= 0.5f;
+				}
+
+				write_imagef(output, pos, (float4)(height, 0.f, 0.f, 0.f));
+			}
+		)";
+
+		static std::string ToLower(std::string Text)
+		{
+			std::transform(Text.begin(), Text.end(), Text.begin(), [](char c) { return (char)std::tolower((unsigned char)c); });
+			return Text;
+		}
+
+		std::string DeviceInfo::GetKey() const
+		{
+			return Platform + "|" + Vendor + "|" + Name + "|" + DriverVersion;
+		}
+
+		void SetCacheFile(const std::string& Path)
+		{
+			std::lock_guard<std::mutex> Lock(SelectionMutex);
+			CacheFile = Path;
+		}
+
+		void SetOverride(const std::string& Override)
+		{
+			std::lock_guard<std::mutex> Lock(SelectionMutex);
+			OverrideDevice = Override;
+		}
+
+		static DeviceInfo Probe(const compute::device& Device)
+		{
+			DeviceInfo Info;
+			Info.Device				= Device;
+			Info.Name				= Device.name();
+			Info.Vendor				= Device.vendor();
+			Info.Platform			= Device.platform().name();
+			Info.DriverVersion		= Device.driver_version();
+			Info.ComputeUnits		= Device.compute_units();
+			Info.bImageSupport		= Device.get_info<cl_bool>(CL_DEVICE_IMAGE_SUPPORT) == CL_TRUE;
+			Info.bHalfFloat			= Device.supports_extension("cl_khr_fp16");
+			Info.GlobalMemoryBytes	= Device.global_memory_size();
+			Info.MaxAllocationBytes	= Device.max_memory_alloc_size();
+
+			if (Info.bImageSupport)
+			{
+				Info.MaxImageWidth	= Device.get_info<size_t>(CL_DEVICE_IMAGE2D_MAX_WIDTH);
+				Info.MaxImageHeight	= Device.get_info<size_t>(CL_DEVICE_IMAGE2D_MAX_HEIGHT);
+			}
+
+			return Info;
+		}
+
+		// Megapixels per second, the best of a few runs after a warm up. 0 if
+		// the device can't run it
+		static double Benchmark(const DeviceInfo& Info)
+		{
+			if (!Info.bImageSupport)
+				return 0.0;
+
+			try
+			{
+				compute::context BenchmarkContext(Info.Device);
+				compute::command_queue Queue(BenchmarkContext, Info.Device, compute::command_queue::enable_profiling);
+
+				if (!compute::image2d::is_supported_format(ImageFormat, BenchmarkContext))
+					return 0.0;
+
+				compute::program Program = compute::program::build_with_source(BenchmarkSource, BenchmarkContext);
+				compute::kernel Kernel(Program, "benchmark");
+
+				compute::image2d Output(BenchmarkContext, BenchmarkSize, BenchmarkSize, ImageFormat);
+				Kernel.set_arg(0, Output);
+
+				using compute::dim;
+				Queue.enqueue_nd_range_kernel(Kernel, dim(0, 0), Output.size(), dim(1, 1)).wait();
+
+				cl_ulong BestNanoseconds = ~(cl_ulong)0;
+				for (int32_t Run = 0; Run < BenchmarkRuns; Run++)
+				{
+					compute::event Event = Queue.enqueue_nd_range_kernel(Kernel, dim(0, 0), Output.size(), dim(1, 1));
+					Event.wait();
+
+					const cl_ulong Start	= Event.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_START);
+					const cl_ulong End		= Event.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_END);
+					BestNanoseconds = std::min(BestNanoseconds, std::max<cl_ulong>(End - Start, 1));
+				}
+
+				return (double)(BenchmarkSize * BenchmarkSize) / (double)BestNanoseconds * 1000.0;
+			}
+			catch (const std::exception& Exception)
+			{
+				Log("Device benchmark failed on " + Info.Name + ": " + Exception.what());
+				return 0.0;
+			}
+		}
+
+		static std::map<std::string, double> ReadCache(const std::string& Path)
+		{
+			std::map<std::string, double> Scores;
+			if (Path.empty())
+				return Scores;
+
+			std::ifstream File(Path);
+			std::string Line;
+			while (std::getline(File, Line))
+			{
+				// Score<tab>Key
+				const size_t Tab = Line.find('\t');
+				if (Tab == std::string::npos)
+					continue;
+
+				Scores[Line.substr(Tab + 1)] = std::atof(Line.substr(0, Tab).c_str());
+			}
+
+			return Scores;
+		}
+
+		static void WriteCache(const std::string& Path, const std::vector<DeviceInfo>& Infos)
+		{
+			if (Path.empty())
+				return;
+
+			std::ofstream File(Path, std::ios::trunc);
+			if (!File)
+			{
+				Log("Couldn't write the device cache to " + Path);
+				return;
+			}
+
+			for (const DeviceInfo& Info : Infos)
+			{
+				File << Info.Score << "\t" << Info.GetKey() << "\n";
+			}
+		}
+
+		static bool IsBetter(const DeviceInfo& A, const DeviceInfo& B)
+		{
+			if (A.IsUsable() != B.IsUsable())
+				return A.IsUsable();
+
+			if (A.Score != B.Score)
+				return A.Score > B.Score;
+
+			return A.ComputeUnits > B.ComputeUnits;
+		}
+
+		static void ProbeAll()
+		{
+			if (bProbed)
+				return;
+
+			bProbed = true;
+
+			std::vector<compute::device> SystemDevices;
+			try
+			{
+				SystemDevices = compute::system::devices();
+			}
+			catch (const std::exception& Exception)
+			{
+				Log(std::string("Couldn't enumerate OpenCL devices: ") + Exception.what());
+				return;
+			}
+
+			const std::map<std::string, double> CachedScores = ReadCache(CacheFile);
+			bool bCacheChanged = false;
+
+			for (const compute::device& Device : SystemDevices)
+			{
+				DeviceInfo Info = Probe(Device);
+
+				const auto Cached = CachedScores.find(Info.GetKey());
+				if (Cached != CachedScores.end())
+				{
+					Info.Score				= Cached->second;
+					Info.bScoreFromCache	= true;
+				}
+				else
+				{
+					Info.Score		= Benchmark(Info);
+					bCacheChanged	= true;
+				}
+
+				ProbedDevices.push_back(Info);
+			}
+
+			std::stable_sort(ProbedDevices.begin(), ProbedDevices.end(), IsBetter);
+
+			if (bCacheChanged)
+				WriteCache(CacheFile, ProbedDevices);
+		}
+
+		const std::vector<DeviceInfo>& GetDevices()
+		{
+			std::lock_guard<std::mutex> Lock(SelectionMutex);
+			ProbeAll();
+
+			return ProbedDevices;
+		}
+
+		static const DeviceInfo* FindOverride(const std::string& Override)
+		{
+			if (Override.empty())
+				return nullptr;
+
+			if (std::all_of(Override.begin(), Override.end(), [](char c) { return std::isdigit((unsigned char)c) != 0; }))
+			{
+				const size_t Index = (size_t)std::atoi(Override.c_str());
+				return Index < ProbedDevices.size() ? &ProbedDevices[Index] : nullptr;
+			}
+
+			const std::string Needle = ToLower(Override);
+			for (const DeviceInfo& Info : ProbedDevices)
+			{
+				if (ToLower(Info.Name).find(Needle) != std::string::npos
+					|| ToLower(Info.Vendor).find(Needle) != std::string::npos
+					|| ToLower(Info.Platform).find(Needle) != std::string::npos)
+				{
+					return &Info;
+				}
+			}
+
+			return nullptr;
+		}
+
+		compute::device SelectDevice()
+		{
+			std::lock_guard<std::mutex> Lock(SelectionMutex);
+			ProbeAll();
+
+			std::string Override = OverrideDevice;
+			if (Override.empty())
+			{
+				if (const char* Environment = std::getenv("LANDSCAPEGEN_DEVICE"))
+					Override = Environment;
+			}
+
+			if (const DeviceInfo* Forced = FindOverride(Override))
+			{
+				if (Forced->bImageSupport)
+					return Forced->Device;
+
+				Log("Device override " + Override + " matched " + Forced->Name + ", which has no image support");
+			}
+			else if (!Override.empty())
+			{
+				Log("Device override " + Override + " didn't match any device");
+			}
+
+			if (!ProbedDevices.empty() && ProbedDevices.front().IsUsable())
+				return ProbedDevices.front().Device;
+
+			Log("No usable OpenCL device was found, falling back to the default device");
+			return compute::system::default_device();
+		}
+
+		void Rank(std::vector<compute::device>& Devices)
+		{
+			std::lock_guard<std::mutex> Lock(SelectionMutex);
+			ProbeAll();
+
+			// Position in ProbedDevices is the rank, devices that weren't probed go last
+			auto GetRank = [](const compute::device& Device)
+			{
+				for (size_t i = 0; i < ProbedDevices.size(); i++)
+				{
+					if (ProbedDevices[i].Device == Device)
+						return i;
+				}
+
+				return ProbedDevices.size();
+			};
+
+			std::stable_sort(Devices.begin(), Devices.end(), [&](const compute::device& A, const compute::device& B)
+			{
+				return GetRank(A) < GetRank(B);
+			});
+		}
+
+		void LogDevices()
+		{
+			for (const DeviceInfo& Info : GetDevices())
+			{
+				std::ostringstream Out;
+				Out << Info.Name << " (" << Info.Platform << ", " << Info.DriverVersion << "): "
+					<< Info.ComputeUnits << " compute units, "
+					<< (Info.GlobalMemoryBytes >> 20) << " MB, "
+					<< "max allocation " << (Info.MaxAllocationBytes >> 20) << " MB, "
+					<< (Info.bImageSupport ? "images up to " + std::to_string(Info.MaxImageWidth) + "x" + std::to_string(Info.MaxImageHeight) : std::string("no images")) << ", "
+					<< (Info.bHalfFloat ? "fp16" : "no fp16") << ", "
+					<< Info.Score << " MPixels/s" << (Info.bScoreFromCache ? " (cached)" : "");
+
+				Log(Out.str());
+			}
+		}
+	}
+}
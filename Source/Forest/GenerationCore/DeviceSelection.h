@@ -0,0 +1,79 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Disable warning for GNU_C not being defined
+#pragma warning(push)
+#pragma warning(disable: 4668)
+#define BOOST_COMPUTE_THREAD_SAFE
+#define BOOST_COMPUTE_DEBUG_KERNEL_COMPILATION
+#define BOOST_DISABLE_ABI_HEADERS
+#include <boost/compute/device.hpp>
+#pragma warning(pop)
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace LandscapeGeneration
+{
+	// Decides which OpenCL device the generation runs on. Devices are probed
+	// once per process and ranked by a short micro-benchmark of a noise kernel.
+	// The benchmark scores can be cached in a file so later startups don't have
+	// to run it again, and the choice can be overridden (config, LANDSCAPEGEN_DEVICE)
+	namespace DeviceSelection
+	{
+		struct DeviceInfo
+		{
+			boost::compute::device	Device;
+
+			std::string		Name;
+			std::string		Vendor;
+			std::string		Platform;
+			std::string		DriverVersion;
+
+			uint32_t		ComputeUnits		= 0;
+			bool			bImageSupport		= false;
+			size_t			MaxImageWidth		= 0;
+			size_t			MaxImageHeight		= 0;
+			bool			bHalfFloat			= false;
+			uint64_t		GlobalMemoryBytes	= 0;
+			uint64_t		MaxAllocationBytes	= 0;
+
+			// Megapixels per second of the benchmark kernel, 0 if it couldn't run
+			double			Score				= 0.0;
+			bool			bScoreFromCache		= false;
+
+			// Heightmaps are single channel float images, devices without image
+			// support can't run the kernels
+			bool IsUsable() const { return bImageSupport && Score > 0.0; }
+
+			// Identifies the device in the cache, a driver update invalidates its score
+			std::string GetKey() const;
+		};
+
+		// File the benchmark scores are kept in between runs. Empty (the default)
+		// keeps them in memory only. Has to be set before the first probe
+		void SetCacheFile(const std::string& Path);
+
+		// Forces a device instead of the best ranked one. Either an index in to
+		// GetDevices() or text matched (case insensitive) against the device
+		// name, vendor and platform. Empty clears the override. The
+		// LANDSCAPEGEN_DEVICE environment variable is used if this isn't set
+		void SetOverride(const std::string& Override);
+
+		// Every device on every platform, best first. Probes and benchmarks the
+		// devices the first time it's called, later calls are free
+		const std::vector<DeviceInfo>& GetDevices();
+
+		// The override if it matches a usable device, otherwise the best ranked
+		// device. Falls back to the system default if nothing could be probed
+		boost::compute::device SelectDevice();
+
+		// Sorts Devices best first by the same ranking as GetDevices
+		void Rank(std::vector<boost::compute::device>& Devices);
+
+		// Logs every device with its capabilities and score
+		void LogDevices();
+	}
+}
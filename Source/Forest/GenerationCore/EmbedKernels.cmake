@@ -0,0 +1,96 @@
+# Turns the .cl files in KERNELS_DIR in to byte arrays in OUTPUT, so the
+# kernels are compiled in to the library instead of being read at runtime.
+# Forest.Build.cs does the same for the Unreal build, both have to produce
+# the same sources and hashes.
+#
+#   cmake -DKERNELS_DIR=<dir> -DOUTPUT=<header> -P EmbedKernels.cmake
+#
+# For each file:
+#   - #include "file" lines are replaced with the file from KERNELS_DIR, once
+#     per kernel, without its #pragma once (nothing is compiled with -I)
+#   - UTF-8 BOMs are removed
+#   - the hash is the first 16 hex digits of the SHA-256 of the result
+
+cmake_minimum_required(VERSION 3.10)
+
+if(NOT KERNELS_DIR OR NOT OUTPUT)
+	message(FATAL_ERROR "KERNELS_DIR and OUTPUT have to be set")
+endif()
+
+string(ASCII 239 187 191 BOM)
+
+function(resolve_includes CONTENT INCLUDED OUT_CONTENT OUT_INCLUDED)
+	set(Result "${CONTENT}")
+
+	while(Result MATCHES "#include \"([^\"]+)\"")
+		set(Line "${CMAKE_MATCH_0}")
+		set(Header "${CMAKE_MATCH_1}")
+		set(Replacement "")
+
+		if(NOT Header IN_LIST INCLUDED)
+			if(NOT EXISTS "${KERNELS_DIR}/${Header}")
+				message(FATAL_ERROR "${Header} is included but isn't in ${KERNELS_DIR}")
+			endif()
+
+			list(APPEND INCLUDED "${Header}")
+			file(READ "${KERNELS_DIR}/${Header}" Replacement)
+			string(REGEX REPLACE "#pragma once[^\n]*\n?" "" Replacement "${Replacement}")
+		endif()
+
+		string(FIND "${Result}" "${Line}" Position)
+		string(LENGTH "${Line}" LineLength)
+		string(SUBSTRING "${Result}" 0 ${Position} Before)
+		math(EXPR After "${Position} + ${LineLength}")
+		string(SUBSTRING "${Result}" ${After} -1 Rest)
+		set(Result "${Before}${Replacement}${Rest}")
+	endwhile()
+
+	set(${OUT_CONTENT} "${Result}" PARENT_SCOPE)
+	set(${OUT_INCLUDED} "${INCLUDED}" PARENT_SCOPE)
+endfunction()
+
+file(GLOB KernelFiles RELATIVE "${KERNELS_DIR}" "${KERNELS_DIR}/*.cl")
+list(SORT KernelFiles)
+
+set(Arrays "")
+set(Entries "")
+
+foreach(KernelFile IN LISTS KernelFiles)
+	file(READ "${KERNELS_DIR}/${KernelFile}" Content)
+	resolve_includes("${Content}" "" Content Included)
+	string(REPLACE "${BOM}" "" Content "${Content}")
+
+	string(SHA256 Hash "${Content}")
+	string(SUBSTRING "${Hash}" 0 16 Hash)
+
+	# Through a file, string(HEX) needs a newer CMake
+	set(Scratch "${OUTPUT}.scratch")
+	file(WRITE "${Scratch}" "${Content}")
+	file(READ "${Scratch}" Hex HEX)
+	file(REMOVE "${Scratch}")
+
+	string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1, " Bytes "${Hex}")
+	string(REGEX REPLACE "((0x[0-9a-f][0-9a-f], ){16})" "\\1\n\t" Bytes "${Bytes}")
+
+	string(MAKE_C_IDENTIFIER "${KernelFile}" Identifier)
+	string(LENGTH "${Content}" Length)
+
+	string(APPEND Arrays "static const unsigned char ${Identifier}[] = {\n\t${Bytes}0x00\n};\n\n")
+	string(APPEND Entries "\t{ \"${KernelFile}\", (const char*)${Identifier}, ${Length}, 0x${Hash}ull },\n")
+endforeach()
+
+set(Header "// Generated by EmbedKernels.cmake from ${KERNELS_DIR}, don't edit\n\n#pragma once\n\n")
+string(APPEND Header "namespace LandscapeGeneration\n{\n\tnamespace EmbeddedKernels\n\t{\n\t\tnamespace Generated\n\t\t{\n")
+string(APPEND Header "${Arrays}")
+string(APPEND Header "static const Source Sources[] = {\n${Entries}};\n")
+string(APPEND Header "\t\t}\n\t}\n}\n")
+
+# Only touch the header if it changed, so nothing is rebuilt for nothing
+if(EXISTS "${OUTPUT}")
+	file(READ "${OUTPUT}" Existing)
+	if(Existing STREQUAL Header)
+		return()
+	endif()
+endif()
+
+file(WRITE "${OUTPUT}" "${Header}")
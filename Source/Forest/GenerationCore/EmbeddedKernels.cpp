@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "EmbeddedKernels.h"
+
+#include <unordered_map>
+
+#if LANDSCAPEGENERATION_EMBEDDED_KERNELS
+#include "EmbeddedKernelSources.h"
+#endif
+
+namespace LandscapeGeneration
+{
+	namespace EmbeddedKernels
+	{
+		typedef std::unordered_map<std::string, const Source*> SourceMap;
+
+		static const SourceMap& GetSources()
+		{
+			// Built on first use, thread safe as a function local static
+			static const SourceMap Sources = []()
+			{
+				SourceMap Map;
+#if LANDSCAPEGENERATION_EMBEDDED_KERNELS
+				for (const Source& Embedded : Generated::Sources)
+				{
+					Map[Embedded.Name] = &Embedded;
+				}
+#endif
+				return Map;
+			}();
+
+			return Sources;
+		}
+
+		bool IsAvailable()
+		{
+			return !GetSources().empty();
+		}
+
+		const Source* Find(const std::string& File)
+		{
+			const SourceMap& Sources = GetSources();
+
+			auto Found = Sources.find(File);
+			return Found != Sources.end() ? Found->second : nullptr;
+		}
+	}
+}
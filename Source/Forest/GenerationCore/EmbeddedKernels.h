@@ -0,0 +1,32 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace LandscapeGeneration
+{
+	// The .cl files compiled in to the binary by EmbedKernels.cmake or
+	// Forest.Build.cs, with their includes resolved and BOMs removed. Used
+	// instead of the kernels directory unless SetKernelsPath says otherwise
+	namespace EmbeddedKernels
+	{
+		struct Source
+		{
+			const char*	Name;
+			const char*	Text;
+			size_t		Length;
+
+			// Precomputed from the text, programs are cached by it
+			uint64_t	Hash;
+		};
+
+		// False if the build didn't embed the kernels (no LANDSCAPEGENERATION_EMBEDDED_KERNELS)
+		bool IsAvailable();
+
+		// The embedded File, e.g. "perlin.cl". nullptr if it isn't embedded
+		const Source* Find(const std::string& File);
+	}
+}
@@ -0,0 +1,3565 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "LandscapeGenerationCore.h"
+
+// Disable warning for GNU_C not being defined
+#pragma warning(push)
+#pragma warning(disable: 4668)
+#define BOOST_COMPUTE_THREAD_SAFE
+#define BOOST_COMPUTE_DEBUG_KERNEL_COMPILATION
+#define BOOST_DISABLE_ABI_HEADERS
+#include <boost/compute/system.hpp>
+#include <boost/compute/image/image2d.hpp>
+#include <boost/compute/utility/dim.hpp>
+#include <boost/compute/container/vector.hpp>
+#include <boost/compute/memory/local_buffer.hpp>
+#pragma warning(pop)
+
+#include <memory>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <atomic>
+#include <array>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <cmath>
+#include <chrono>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include "LandscapeGenerationCore.inl"
+#include "TiledHeightmap.h"
+#include "Profiling.h"
+#include "Stats.h"
+#include "DeviceSelection.h"
+#include "MultiDevice.h"
+#include "EmbeddedKernels.h"
+
+using namespace std;
+namespace compute = boost::compute;
+
+namespace LandscapeGeneration
+{
+	static vector<compute::device>				Devices;
+	static unique_ptr<compute::context>			Context;
+	static unique_ptr<compute::command_queue>	CommandQueue;
+
+	// The image format for all heightmaps
+	// This has external linkage to some default params for functions in this 
+	// namespace
+	compute::image_format						ImageFormat = compute::image_format(CL_R, CL_FLOAT);
+
+	// Kernels are pushed from the game thread and popped from the kernel thread
+	static std::queue<std::function<void()>>	KernelQueue;
+	static std::mutex							KernelQueueMutex;
+	static std::thread							KernelThread;
+	static std::atomic<bool>					bKernelRunning;
+
+	// Heightmaps can be created from the game thread and from the kernel thread
+	// (e.g. the runtime terrain streamer), so setup has to be guarded
+	static std::mutex							SetupMutex;
+
+	static std::mutex							LogMutex;
+	static std::function<void(const std::string&)>	LogFunction;
+
+#ifdef LANDSCAPEGENERATION_KERNELS_DIR
+	static const char*							DefaultKernelsPath = LANDSCAPEGENERATION_KERNELS_DIR;
+#else
+	static const char*							DefaultKernelsPath = "Kernels/";
+#endif
+	static std::string							KernelsPath = DefaultKernelsPath;
+
+	// Set once SetKernelsPath is given a directory, the embedded kernels aren't used after that
+	static bool									bKernelsPathSet = false;
+
+	void SetLogFunction(std::function<void(const std::string&)> InLogFunction)
+	{
+		std::lock_guard<std::mutex> Lock(LogMutex);
+		LogFunction = InLogFunction;
+	}
+
+	void Log(const std::string& Message)
+	{
+		std::lock_guard<std::mutex> Lock(LogMutex);
+
+		if (LogFunction)
+		{
+			LogFunction(Message);
+		}
+		else
+		{
+			std::cerr << Message << std::endl;
+		}
+	}
+
+	void SetKernelsPath(const std::string& Path)
+	{
+		std::lock_guard<std::mutex> Lock(SetupMutex);
+		KernelsPath		= Path.empty() ? std::string(DefaultKernelsPath) : Path;
+		bKernelsPathSet	= !Path.empty();
+	}
+
+	std::string GetKernelsPath()
+	{
+		std::lock_guard<std::mutex> Lock(SetupMutex);
+		return KernelsPath;
+	}
+
+	static std::atomic<bool>					bKernelSpecialization(true);
+
+	void SetKernelSpecialization(bool bEnabled)
+	{
+		bKernelSpecialization = bEnabled;
+	}
+
+	bool IsKernelSpecializationEnabled()
+	{
+		return bKernelSpecialization;
+	}
+
+	static std::atomic<bool>					bCpuRowKernels(true);
+
+	void SetCpuRowKernels(bool bEnabled)
+	{
+		bCpuRowKernels = bEnabled;
+	}
+
+	bool AreCpuRowKernelsEnabled()
+	{
+		return bCpuRowKernels;
+	}
+
+	static bool UseEmbeddedKernels()
+	{
+		std::lock_guard<std::mutex> Lock(SetupMutex);
+		return !bKernelsPathSet && EmbeddedKernels::IsAvailable();
+	}
+
+	// Every transfer between the host and the device goes through these, so
+	// they're counted and show up in profiles
+	static void TraceUpload(const compute::event& Event, size_t Bytes)
+	{
+		Stats::Add(Stats::Counter::BytesUploaded, (int64_t)Bytes);
+		Profiling::TraceEvent(Event, "Write Image", "Transfer");
+	}
+
+	static void TraceDownload(const compute::event& Event, size_t Bytes)
+	{
+		Stats::Add(Stats::Counter::BytesDownloaded, (int64_t)Bytes);
+		Profiling::TraceEvent(Event, "Read Image", "Transfer");
+	}
+
+	// Ensures that the device, context, queue are set up. Runs for every
+	// heightmap, so the device is only chosen once (see DeviceSelection)
+	static void EnsureStateIsSetup()
+	{
+		std::lock_guard<std::mutex> Lock(SetupMutex);
+
+		if (CommandQueue.get() != nullptr)
+			return;
+
+		if (Devices.size() == 0)
+		{
+			Devices.push_back(DeviceSelection::SelectDevice());
+		}
+
+		Context = unique_ptr<compute::context>(new compute::context(Devices[0]));
+		CommandQueue = unique_ptr<compute::command_queue>(
+			new compute::command_queue(*Context.get(), Devices[0], compute::command_queue::enable_profiling));
+	}
+
+	// Set while a ScopedQueue is alive on this thread
+	static thread_local compute::command_queue*	BoundQueue = nullptr;
+	static thread_local compute::context*		BoundContext = nullptr;
+
+	// Everything that allocates or enqueues goes through these, so work can be
+	// redirected to another device (see MultiDevice)
+	static compute::context& GetContext()
+	{
+		if (BoundContext)
+			return *BoundContext;
+
+		EnsureStateIsSetup();
+		return *Context.get();
+	}
+
+	static compute::command_queue& GetQueue()
+	{
+		if (BoundQueue)
+			return *BoundQueue;
+
+		EnsureStateIsSetup();
+		return *CommandQueue.get();
+	}
+
+	ScopedQueue::ScopedQueue(compute::command_queue& Queue)
+		: BoundQueueContext(Queue.get_context())
+		, PreviousQueue(BoundQueue)
+		, PreviousContext(BoundContext)
+	{
+		BoundQueue		= &Queue;
+		BoundContext	= &BoundQueueContext;
+	}
+
+	ScopedQueue::~ScopedQueue()
+	{
+		BoundQueue		= PreviousQueue;
+		BoundContext	= PreviousContext;
+	}
+
+	bool ScopedQueue::IsBound()
+	{
+		return BoundQueue != nullptr;
+	}
+
+	void PushKernel(std::function<void()> KernelFunc)
+	{
+		std::lock_guard<std::mutex> Lock(KernelQueueMutex);
+		KernelQueue.push(KernelFunc);
+		Stats::Add(Stats::Counter::QueueDepth, 1);
+	}
+
+	Job::Job()
+		: Status(JobStatus::Queued)
+		, Progress(0.f)
+		, bCancelRequested(false)
+		, Future(Promise.get_future().share())
+	{
+	}
+
+	void Job::SetProgress(float InProgress)
+	{
+		Progress = Clamp(InProgress, 0.f, 1.f);
+
+		if (OnProgress)
+			OnProgress(Progress);
+	}
+
+	void Job::CheckCancelled() const
+	{
+		if (bCancelRequested)
+			throw JobCancelled();
+	}
+
+	void Job::Finish(JobStatus FinalStatus)
+	{
+		if (FinalStatus == JobStatus::Succeeded)
+			SetProgress(1.f);
+
+		Status = FinalStatus;
+		Promise.set_value(FinalStatus);
+
+		Stats::Add(FinalStatus == JobStatus::Succeeded ? Stats::Counter::JobsSucceeded
+			: (FinalStatus == JobStatus::Failed ? Stats::Counter::JobsFailed : Stats::Counter::JobsCancelled), 1);
+	}
+
+	shared_ptr<Job> PushJob(std::function<void(Job&)> KernelFunc,
+		vector<shared_ptr<Job>> Dependencies,
+		vector<weak_ptr<Heightmap>> Outputs)
+	{
+		shared_ptr<Job> NewJob(new Job());
+
+		PushKernel([=]() -> void
+		{
+			if (NewJob->IsCancelRequested())
+			{
+				NewJob->Finish(JobStatus::Cancelled);
+				return;
+			}
+
+			// Everything before this job in the queue has already run
+			for (auto& Dependency : Dependencies)
+			{
+				if (Dependency && Dependency->GetStatus() != JobStatus::Succeeded)
+				{
+					NewJob->Finish(JobStatus::Cancelled);
+					return;
+				}
+			}
+
+			// Nobody is left to read the result
+			if (!Outputs.empty() && std::all_of(Outputs.begin(), Outputs.end(),
+				[](const weak_ptr<Heightmap>& Output) { return Output.expired(); }))
+			{
+				NewJob->Finish(JobStatus::Cancelled);
+				return;
+			}
+
+			NewJob->Status = JobStatus::Running;
+
+			const auto StartTime = std::chrono::steady_clock::now();
+			JobStatus FinalStatus = JobStatus::Succeeded;
+
+			try
+			{
+				KernelFunc(*NewJob);
+			}
+			catch (JobCancelled&)
+			{
+				FinalStatus = JobStatus::Cancelled;
+			}
+			catch (std::exception& e)
+			{
+				Log(std::string("OpenCL Error: ") + e.what());
+				FinalStatus = JobStatus::Failed;
+			}
+
+			Stats::Record(Stats::Histogram::JobTime, (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - StartTime).count());
+
+			NewJob->Finish(FinalStatus);
+		});
+
+		return NewJob;
+	}
+
+	// Pops the next kernel, returns false if the queue is empty
+	static bool PopKernel(std::function<void()>& OutKernelFunc)
+	{
+		std::lock_guard<std::mutex> Lock(KernelQueueMutex);
+
+		if (KernelQueue.empty())
+			return false;
+
+		OutKernelFunc = std::move(KernelQueue.front());
+		KernelQueue.pop();
+		Stats::Add(Stats::Counter::QueueDepth, -1);
+		return true;
+	}
+
+	// Images of destroyed heightmaps, by context, size and format. Allocating
+	// is slow on some drivers and every node and erosion run allocates
+	typedef std::tuple<cl_context, size_t, size_t, cl_channel_order, cl_channel_type> ImagePoolKey;
+
+	static std::map<ImagePoolKey, std::vector<compute::image2d>>	ImagePool;
+	static std::mutex												ImagePoolMutex;
+	static size_t													ImagePoolBytes = 0;
+	static size_t													ImagePoolBudget = 256 * 1024 * 1024;
+
+	static ImagePoolKey GetImagePoolKey(const compute::context& ImageContext, size_t SizeX, size_t SizeY,
+		const compute::image_format& Format)
+	{
+		return ImagePoolKey(ImageContext.get(), SizeX, SizeY,
+			Format.get_format_ptr()->image_channel_order, Format.get_format_ptr()->image_channel_data_type);
+	}
+
+	static compute::image2d AcquireImage(int SizeX, int SizeY, const compute::image_format& Format)
+	{
+		compute::context& ImageContext = GetContext();
+
+		{
+			std::lock_guard<std::mutex> Lock(ImagePoolMutex);
+
+			auto Found = ImagePool.find(GetImagePoolKey(ImageContext, SizeX, SizeY, Format));
+			if (Found != ImagePool.end() && !Found->second.empty())
+			{
+				compute::image2d Image = Found->second.back();
+				Found->second.pop_back();
+				ImagePoolBytes -= Image.get_memory_size();
+
+				return Image;
+			}
+		}
+
+		return compute::image2d(ImageContext, SizeX, SizeY, Format);
+	}
+
+	// Keeps Image for reuse if it fits in the budget, otherwise frees it
+	static void ReleaseImage(const compute::image2d& Image)
+	{
+		if (Image.get() == nullptr)
+			return;
+
+		const size_t Bytes = Image.get_memory_size();
+
+		std::lock_guard<std::mutex> Lock(ImagePoolMutex);
+
+		if (ImagePoolBytes + Bytes > ImagePoolBudget)
+			return;
+
+		ImagePool[GetImagePoolKey(Image.get_context(), Image.width(), Image.height(), Image.format())].push_back(Image);
+		ImagePoolBytes += Bytes;
+	}
+
+	void SetImagePoolBudget(size_t Bytes)
+	{
+		std::lock_guard<std::mutex> Lock(ImagePoolMutex);
+		ImagePoolBudget = Bytes;
+	}
+
+	// Stops at the pool's budget, ReleaseImage would free the rest straight away
+	void ReserveImages(int32_t SizeX, int32_t SizeY, compute::image_format Format, int32_t Count)
+	{
+		Profiling::ScopedSpan Span("Reserve Images", "Memory");
+
+		size_t Bytes = 0;
+
+		for (int32_t i = 0; i < Count; i++)
+		{
+			bool bFull;
+			{
+				std::lock_guard<std::mutex> Lock(ImagePoolMutex);
+				bFull = ImagePoolBytes + Bytes > ImagePoolBudget;
+			}
+
+			if (bFull)
+			{
+				Log("Reserved " + std::to_string(i) + " of " + std::to_string(Count) + " " + std::to_string(SizeX) + "x"
+					+ std::to_string(SizeY) + " images, the rest don't fit in the image pool's budget");
+				return;
+			}
+
+			// The size is only known after the first, if even that doesn't fit it's freed
+			compute::image2d Image(GetContext(), SizeX, SizeY, Format);
+			Bytes = Image.get_memory_size();
+			ReleaseImage(Image);
+		}
+	}
+
+	void ClearImagePool()
+	{
+		std::lock_guard<std::mutex> Lock(ImagePoolMutex);
+		ImagePool.clear();
+		ImagePoolBytes = 0;
+	}
+
+	// cl_khr_image2d_from_buffer, core in OpenCL 2.0. In pixels
+#ifndef CL_DEVICE_IMAGE_PITCH_ALIGNMENT
+#define CL_DEVICE_IMAGE_PITCH_ALIGNMENT 0x104A
+#endif
+
+	static std::atomic<HeightmapStorage>				RequestedStorage(HeightmapStorage::Automatic);
+	static std::map<cl_device_id, HeightmapStorage>	MeasuredStorage;
+	static std::mutex									MeasuredStorageMutex;
+
+	void SetHeightmapStorage(HeightmapStorage Storage)
+	{
+		RequestedStorage = Storage;
+	}
+
+	HeightmapStorage GetHeightmapStorage()
+	{
+		return RequestedStorage;
+	}
+
+	// Whether a Width wide heightmap of Format can have buffer storage on the
+	// current queue's device. The view needs the rows packed, so the row
+	// kernels can use the buffer as it is
+	static bool CanViewBufferAsImage(size_t Width, const compute::image_format& Format)
+	{
+#ifdef CL_VERSION_1_2
+		if (Format != ImageFormat)
+			return false;
+
+		const compute::device Device = GetQueue().get_device();
+		if (!Device.check_version(2, 0) && !Device.supports_extension("cl_khr_image2d_from_buffer"))
+			return false;
+
+		const cl_uint Alignment = Device.get_info<cl_uint>(CL_DEVICE_IMAGE_PITCH_ALIGNMENT);
+		return Alignment == 0 || Width % Alignment == 0;
+#else
+		return false;
+#endif
+	}
+
+	// Boost.Compute can't wrap an existing cl_mem as an image2d
+	struct WrappedImage2D : compute::image2d
+	{
+		explicit WrappedImage2D(cl_mem Mem)
+		{
+			m_mem = Mem;
+		}
+	};
+
+	// A single channel float image2d on the memory of Buffer
+	static compute::image2d CreateBufferView(const compute::buffer& Buffer, size_t Width, size_t Height)
+	{
+#ifdef CL_VERSION_1_2
+		cl_image_desc Desc = {};
+		Desc.image_type			= CL_MEM_OBJECT_IMAGE2D;
+		Desc.image_width		= Width;
+		Desc.image_height		= Height;
+		Desc.image_row_pitch	= Width * sizeof(float);
+		Desc.buffer				= Buffer.get();
+
+		cl_int Error = CL_SUCCESS;
+		cl_mem Mem = clCreateImage(GetContext().get(), CL_MEM_READ_WRITE, ImageFormat.get_format_ptr(), &Desc, nullptr, &Error);
+		if (Error != CL_SUCCESS)
+			BOOST_THROW_EXCEPTION(compute::opencl_error(Error));
+
+		// The wrapper takes over the reference clCreateImage returned
+		return WrappedImage2D(Mem);
+#else
+		throw std::runtime_error("Buffer heightmaps need OpenCL 1.2");
+#endif
+	}
+
+	static const char* GetStorageName(HeightmapStorage Storage)
+	{
+		switch (Storage)
+		{
+			case HeightmapStorage::Image:			return "Image";
+			case HeightmapStorage::Buffer:			return "Buffer";
+			case HeightmapStorage::MappedBuffer:	return "Mapped Buffer";
+			default:								return "Automatic";
+		}
+	}
+
+	// Size of the heightmaps the backends are measured with
+	static const int32_t StorageMeasureSize = 512;
+
+	// Times a noise node, a mix and reading the result back with each backend
+	// the device can do. The first round builds the programs and isn't counted,
+	// the best of the others is
+	static HeightmapStorage MeasureStorage()
+	{
+		Profiling::ScopedSpan Span("Measure Heightmap Storage", "Memory");
+
+		if (!CanViewBufferAsImage(StorageMeasureSize, ImageFormat))
+			return HeightmapStorage::Image;
+
+		HeightmapStorage Best = HeightmapStorage::Image;
+		double BestSeconds = std::numeric_limits<double>::max();
+
+		for (HeightmapStorage Storage : { HeightmapStorage::Image, HeightmapStorage::Buffer, HeightmapStorage::MappedBuffer })
+		{
+			double Seconds = std::numeric_limits<double>::max();
+
+			for (int32_t Round = 0; Round < 4; Round++)
+			{
+				const auto StartTime = std::chrono::steady_clock::now();
+
+				auto Noise	= CreateHeightmap(StorageMeasureSize, StorageMeasureSize, ImageFormat, Storage);
+				auto Mixed	= CreateHeightmap(StorageMeasureSize, StorageMeasureSize, ImageFormat, Storage);
+
+				Kernels::PerlinNoise(Noise->Image, 64.f, 1, 4, 1.f);
+				Kernels::Mix(Noise->Image, Noise->Image, Mixed->Image, MixOperation::Add);
+
+				delete[] (uint8_t*)Mixed->CreateRawCopy();
+
+				if (Round > 0)
+					Seconds = std::min(Seconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count());
+			}
+
+			Log(std::string("Heightmap storage ") + GetStorageName(Storage) + ": " + std::to_string(Seconds * 1000.0) + " ms");
+
+			if (Seconds < BestSeconds)
+			{
+				Best		= Storage;
+				BestSeconds	= Seconds;
+			}
+		}
+
+		return Best;
+	}
+
+	HeightmapStorage GetDeviceHeightmapStorage()
+	{
+		const cl_device_id Device = GetQueue().get_device().id();
+
+		{
+			std::lock_guard<std::mutex> Lock(MeasuredStorageMutex);
+
+			auto Found = MeasuredStorage.find(Device);
+			if (Found != MeasuredStorage.end())
+				return Found->second;
+		}
+
+		// Not held while measuring, the measurement makes heightmaps itself
+		const HeightmapStorage Measured = MeasureStorage();
+
+		Log(std::string("Heightmaps on ") + GetQueue().get_device().name() + " use " + GetStorageName(Measured) + " storage");
+
+		std::lock_guard<std::mutex> Lock(MeasuredStorageMutex);
+		return MeasuredStorage.emplace(Device, Measured).first->second;
+	}
+
+	// What Automatic has measured on the current queue's device, Image until
+	// the warm up has measured it. Heightmaps are made on the game thread,
+	// measuring here would stall it and race the warm up's own measurement
+	static HeightmapStorage FindDeviceHeightmapStorage()
+	{
+		std::lock_guard<std::mutex> Lock(MeasuredStorageMutex);
+
+		auto Found = MeasuredStorage.find(GetQueue().get_device().id());
+		return Found != MeasuredStorage.end() ? Found->second : HeightmapStorage::Image;
+	}
+
+	// Falls back to Image when the buffer backends can't hold the heightmap
+	static HeightmapStorage ResolveStorage(int SizeX, const compute::image_format& Format, HeightmapStorage Storage)
+	{
+		if (Storage == HeightmapStorage::Automatic)
+			Storage = GetHeightmapStorage();
+
+		if (Storage == HeightmapStorage::Image || !CanViewBufferAsImage(SizeX, Format))
+			return HeightmapStorage::Image;
+
+		return Storage == HeightmapStorage::Automatic ? FindDeviceHeightmapStorage() : Storage;
+	}
+
+	// Every backend has an image, buffer storage included (the view is an
+	// image as well), so none of them can be larger than the device allows
+	static void CheckImageLimits(int SizeX, int SizeY)
+	{
+		const compute::device Device = GetQueue().get_device();
+
+		if ((size_t)SizeX > Device.get_info<size_t>(CL_DEVICE_IMAGE2D_MAX_WIDTH)
+			|| (size_t)SizeY > Device.get_info<size_t>(CL_DEVICE_IMAGE2D_MAX_HEIGHT))
+			throw std::runtime_error("The heightmap is larger than the device's maximum image size, use a TiledHeightmap");
+	}
+
+	// Heightmap Ctor. Just allocates the image on the device side 
+	Heightmap::Heightmap(int SizeX, int SizeY, boost::compute::image_format inImageFormat, HeightmapStorage inStorage)
+	{
+		Profiling::ScopedSpan Span("Allocate Heightmap", "Memory");
+
+		CheckImageLimits(SizeX, SizeY);
+		StorageType = ResolveStorage(SizeX, inImageFormat, inStorage);
+
+		if (StorageType == HeightmapStorage::Image)
+		{
+			Image = AcquireImage(SizeX, SizeY, inImageFormat);
+			Allocation = Stats::TrackedAllocation(Image.get_memory_size());
+			return;
+		}
+
+		// Buffers aren't pooled, the backends are only picked where allocating them is cheap
+		const cl_mem_flags Flags = compute::memory_object::read_write
+			| (StorageType == HeightmapStorage::MappedBuffer ? compute::memory_object::alloc_host_ptr : 0);
+
+		Buffer = compute::buffer(GetContext(), (size_t)SizeX * SizeY * sizeof(float), Flags);
+		Image = CreateBufferView(Buffer, SizeX, SizeY);
+		Allocation = Stats::TrackedAllocation(Buffer.size());
+	}
+
+	Heightmap::~Heightmap()
+	{
+		if (StorageType == HeightmapStorage::Image)
+			ReleaseImage(Image);
+	}
+
+	size_t Heightmap::Width() const
+	{
+		return Image.width();
+	}
+
+	size_t Heightmap::Height() const
+	{
+		return Image.height();
+	}
+
+	compute::image_format Heightmap::Format() const
+	{
+		return Image.format();
+	}
+
+	HeightmapStorage Heightmap::Storage() const
+	{
+		return StorageType;
+	}
+
+	void Heightmap::ReadPixels(void* Out) const
+	{
+		const size_t Bytes = Image.get_memory_size();
+
+		switch (StorageType)
+		{
+			case HeightmapStorage::Buffer:
+				TraceDownload(GetQueue().enqueue_read_buffer(Buffer, 0, Bytes, Out), Bytes);
+				break;
+
+			// Already in host memory, mapping it doesn't copy
+			case HeightmapStorage::MappedBuffer:
+			{
+				compute::event MapEvent;
+				void* Mapped = GetQueue().enqueue_map_buffer(Buffer, CL_MAP_READ, 0, Bytes, MapEvent);
+				TraceDownload(MapEvent, Bytes);
+
+				std::memcpy(Out, Mapped, Bytes);
+				GetQueue().enqueue_unmap_buffer(Buffer, Mapped).wait();
+				break;
+			}
+
+			default:
+				TraceDownload(GetQueue().enqueue_read_image(Image, Image.origin(), Image.size(), Out), Bytes);
+				break;
+		}
+	}
+
+	Heightmap::operator std::vector<uint16_t>() const
+	{
+		// Can't use a switch here because boost::compute::image_format is non const
+		if (this->Format() != boost::compute::image_format(CL_R, CL_UNSIGNED_INT16)
+		 && this->Format() != boost::compute::image_format(CL_R, CL_FLOAT))
+			throw std::runtime_error("Wrong heightmap type conversion");
+
+		if (this->Format() == boost::compute::image_format(CL_R, CL_UNSIGNED_INT16))
+		{
+			std::vector<uint16_t> OutArray(Width() * Height());
+
+			// Copy from the device to the host
+			ReadPixels(OutArray.data());
+
+			return OutArray;
+		}
+
+		if (this->Format() == boost::compute::image_format(CL_R, CL_FLOAT))
+		{
+			std::vector<uint16_t> OutArray(Width() * Height());
+
+			float* RawCopy = (float*)this->CreateRawCopy();
+			const auto PxNum = Width() * Height();
+
+			for (size_t i = 0; i < PxNum; i++)
+			{
+				RawCopy[i] = Clamp(RawCopy[i], 0.f, (float)UINT16_MAX);
+
+				OutArray[i] = (uint16_t)roundf(RawCopy[i]);
+			}
+
+			delete[] (uint8_t*)RawCopy;
+
+			return OutArray;
+		}
+
+		throw std::runtime_error("Undefined control path. An exception should have been thrown at \"Wrong heightmap type conversion\".");
+		return std::vector<uint16_t>();
+	}
+
+	void* Heightmap::CreateRawCopy() const
+	{
+		Profiling::ScopedSpan Span("Create Raw Copy", "Transfer");
+
+		uint8_t* OutData = new uint8_t[Image.get_memory_size()];
+
+		ReadPixels(OutData);
+
+		return OutData;
+	}
+
+	Heightmap::operator std::vector<float>() const
+	{
+		if (this->Format() != boost::compute::image_format(CL_RGBA, CL_FLOAT))
+			throw std::runtime_error("Wrong heightmap type conversion");
+
+		std::vector<float> OutArray(Width() * Height() * 4);
+
+		// Copy from the device to the host
+		ReadPixels(OutArray.data());
+
+		return OutArray;
+	}
+
+	void SetDevices(vector<compute::device> Devices)
+	{
+		if (Devices.empty())
+			return;
+
+		// The queue goes on the best of them rather than whichever came first
+		DeviceSelection::Rank(Devices);
+
+		// Pooled images belong to the old context
+		ClearImagePool();
+
+		std::lock_guard<std::mutex> Lock(SetupMutex);
+
+		LandscapeGeneration::Devices = Devices;
+		LandscapeGeneration::Context = unique_ptr<compute::context>(
+			new compute::context(LandscapeGeneration::Devices));
+		LandscapeGeneration::CommandQueue = unique_ptr<compute::command_queue>(
+			new compute::command_queue(*LandscapeGeneration::Context.get(), LandscapeGeneration::Devices[0],
+				compute::command_queue::enable_profiling));
+	}
+
+	compute::command_queue GetSharedQueue()
+	{
+		EnsureStateIsSetup();
+
+		std::lock_guard<std::mutex> Lock(SetupMutex);
+		return *CommandQueue.get();
+	}
+
+	compute::device GetDevice()
+	{
+		EnsureStateIsSetup();
+
+		std::lock_guard<std::mutex> Lock(SetupMutex);
+		return Devices[0];
+	}
+
+	shared_ptr<Heightmap> CreateHeightmap(int SizeX, int SizeY, boost::compute::image_format inImageFormat, HeightmapStorage inStorage)
+	{
+		return std::shared_ptr<Heightmap>(new Heightmap(SizeX, SizeY, inImageFormat, inStorage));
+	}
+
+	compute::image_object CreateHeightmapArray(size_t Width, size_t Height, size_t Layers)
+	{
+		if (Layers == 0 || Layers > GetMaxHeightmapArrayLayers())
+			throw std::runtime_error("The device can't hold that many heightmap array layers");
+
+#ifdef CL_VERSION_1_2
+		// Boost.Compute has no image2d_array, it's created directly and wrapped
+		const cl_image_format* Format = ImageFormat.get_format_ptr();
+
+		cl_image_desc Desc = {};
+		Desc.image_type			= CL_MEM_OBJECT_IMAGE2D_ARRAY;
+		Desc.image_width		= Width;
+		Desc.image_height		= Height;
+		Desc.image_array_size	= Layers;
+
+		cl_int Error = CL_SUCCESS;
+		cl_mem Mem = clCreateImage(GetContext().get(), CL_MEM_READ_WRITE, Format, &Desc, nullptr, &Error);
+		if (Error != CL_SUCCESS)
+			BOOST_THROW_EXCEPTION(compute::opencl_error(Error));
+
+		// The wrapper takes over the reference clCreateImage returned
+		return compute::image_object(Mem, false);
+#else
+		throw std::runtime_error("Heightmap arrays need OpenCL 1.2");
+#endif
+	}
+
+	size_t GetMaxHeightmapArrayLayers()
+	{
+#ifdef CL_VERSION_1_2
+		const compute::device Device = GetQueue().get_device();
+		if (!Device.check_version(1, 2) || !Device.get_info<cl_bool>(CL_DEVICE_IMAGE_SUPPORT))
+			return 0;
+
+		return Device.get_info<size_t>(CL_DEVICE_IMAGE_MAX_ARRAY_SIZE);
+#else
+		return 0;
+#endif
+	}
+
+	void Tick()
+	{
+		Profiling::ResolveFinishedEvents();
+
+		if (!bKernelRunning)
+		{
+			if (KernelThread.joinable())
+				KernelThread.join();
+
+			bool bHasWork;
+			{
+				std::lock_guard<std::mutex> Lock(KernelQueueMutex);
+				bHasWork = !KernelQueue.empty();
+			}
+
+			if (bHasWork)
+			{
+				bKernelRunning = true;
+
+				// Create the new thread and make sure it sets bKernelRunning to false once it's done.
+				// It drains the whole queue, streaming pushes lots of small kernels and
+				// running only one per frame would starve it
+				KernelThread = std::thread([]() -> void
+				{
+					std::function<void()> KernelFunc;
+					while (PopKernel(KernelFunc))
+					{
+						KernelFunc();
+					}
+
+					bKernelRunning = false;
+				});
+			}
+		}
+	}
+
+	void Finish()
+	{
+		GetQueue().finish();
+	}
+
+	void GetMipLevelSize(int32_t SizeX, int32_t SizeY, int32_t Level, int32_t& OutSizeX, int32_t& OutSizeY)
+	{
+		OutSizeX = SizeX;
+		OutSizeY = SizeY;
+
+		for (int32_t i = 0; i < Level; i++)
+		{
+			OutSizeX = std::max((OutSizeX + 1) / 2, 1);
+			OutSizeY = std::max((OutSizeY + 1) / 2, 1);
+		}
+	}
+
+	int32_t GetMipLevelCount(int32_t SizeX, int32_t SizeY)
+	{
+		int32_t Levels = 0;
+		while (SizeX > 1 || SizeY > 1)
+		{
+			GetMipLevelSize(SizeX, SizeY, 1, SizeX, SizeY);
+			Levels++;
+		}
+
+		return Levels;
+	}
+
+	namespace Kernels
+	{
+		static std::string const GetBuildOptions()
+		{
+			return " -g -w -cl-kernel-arg-info";
+		}
+
+		// Creates and builds a program from files in the kernels directory.
+		// Built programs by context, files and options, so each one is only
+		// built once per context. Programs that failed to build aren't kept.
+		// A program that's still being built (e.g. by the warm up) is in the
+		// cache already, whoever wants it waits for that build rather than
+		// building it twice, without holding up lookups of other programs
+		struct ProgramKey
+		{
+			cl_context	Context;
+			uint64_t	SourceHash;
+			std::string	Options;
+
+			bool operator==(const ProgramKey& Other) const
+			{
+				return Context == Other.Context && SourceHash == Other.SourceHash && Options == Other.Options;
+			}
+		};
+
+		struct ProgramKeyHash
+		{
+			size_t operator()(const ProgramKey& Key) const
+			{
+				return std::hash<const void*>()(Key.Context) ^ (size_t)(Key.SourceHash * 31) ^ std::hash<std::string>()(Key.Options);
+			}
+		};
+
+		struct CachedProgram
+		{
+			std::shared_future<compute::program>	Program;
+
+			// Tells a build apart from a later one of the same key, after a ClearProgramCache
+			uint64_t								BuildId;
+		};
+
+		static std::unordered_map<ProgramKey, CachedProgram, ProgramKeyHash>	ProgramCache;
+		static std::mutex														ProgramCacheMutex;
+		static uint64_t															ProgramBuildCount = 0;
+
+		static const uint64_t FNVOffset	= 14695981039346656037ull;
+		static const uint64_t FNVPrime	= 1099511628211ull;
+
+		// FNV-1a, for sources that don't come with a hash
+		static uint64_t HashString(const std::string& Text, uint64_t Hash = FNVOffset)
+		{
+			for (char c : Text)
+			{
+				Hash = (Hash ^ (uint8_t)c) * FNVPrime;
+			}
+
+			return Hash;
+		}
+
+		// -D defines a program variant is built with, name and value
+		typedef std::vector<std::pair<std::string, std::string>> Specialization;
+
+		// Octave loops longer than this aren't worth a variant of their own
+		static const int32_t MaxSpecializedOctaves = 16;
+
+		// A float as an exact OpenCL C literal (hexadecimal, so no precision is lost)
+		static std::string FloatLiteral(float Value)
+		{
+			char Buffer[64];
+			std::snprintf(Buffer, sizeof(Buffer), "%af", (double)Value);
+			return Buffer;
+		}
+
+		// Build errors are logged, creating a kernel from the program throws.
+		// The sources are the embedded kernels if they're all there, otherwise
+		// the files in the kernels directory, which are only read when the
+		// program isn't cached yet. Each Defines is a variant of its own.
+		// Required defines are applied even with specialisation turned off,
+		// for the ones the kernels can't do without (VECTOR_WIDTH)
+		static compute::program BuildProgram(const std::vector<std::string>& Files,
+			const Specialization& Defines = Specialization(),
+			const Specialization& Required = Specialization())
+		{
+			compute::context& ProgramContext = GetContext();
+
+			std::vector<const EmbeddedKernels::Source*> Embedded;
+			if (UseEmbeddedKernels())
+			{
+				for (auto& File : Files)
+				{
+					Embedded.push_back(EmbeddedKernels::Find(File));
+				}
+
+				if (std::find(Embedded.begin(), Embedded.end(), nullptr) != Embedded.end())
+					Embedded.clear();
+			}
+
+			const bool bEmbedded = !Embedded.empty();
+
+			// Embedded kernels have their includes resolved already
+			const std::string Directory = bEmbedded ? std::string() : GetKernelsPath();
+			std::string Options = bEmbedded ? std::string() : "-I \"" + Directory + "\"";
+			if (IsKernelSpecializationEnabled())
+			{
+				for (auto& Define : Defines)
+				{
+					Options += " -D " + Define.first + "=" + Define.second;
+				}
+			}
+
+			for (auto& Define : Required)
+			{
+				Options += " -D " + Define.first + "=" + Define.second;
+			}
+
+			uint64_t SourceHash = HashString(Directory);
+			for (size_t i = 0; i < Files.size(); i++)
+			{
+				SourceHash = bEmbedded
+					? (SourceHash ^ Embedded[i]->Hash) * FNVPrime
+					: HashString(";" + Files[i], SourceHash);
+			}
+
+			const ProgramKey Key = { ProgramContext.get(), SourceHash, Options };
+
+			std::promise<compute::program> Promise;
+			uint64_t BuildId;
+			{
+				std::unique_lock<std::mutex> Lock(ProgramCacheMutex);
+
+				auto Found = ProgramCache.find(Key);
+				if (Found != ProgramCache.end())
+				{
+					std::shared_future<compute::program> Program = Found->second.Program;
+					Lock.unlock();
+
+					Stats::Add(Stats::Counter::ProgramCacheHits, 1);
+					return Program.get();
+				}
+
+				BuildId = ++ProgramBuildCount;
+				ProgramCache[Key] = { Promise.get_future().share(), BuildId };
+			}
+
+			// Failed builds are taken out again, the next BuildProgram tries anew
+			const auto Forget = [&]()
+			{
+				std::lock_guard<std::mutex> Lock(ProgramCacheMutex);
+
+				auto Found = ProgramCache.find(Key);
+				if (Found != ProgramCache.end() && Found->second.BuildId == BuildId)
+					ProgramCache.erase(Found);
+			};
+
+			Profiling::ScopedSpan Span("Build Program", "Compile");
+			const auto StartTime = std::chrono::steady_clock::now();
+
+			compute::program program;
+			try
+			{
+				if (bEmbedded)
+				{
+					std::vector<std::string> Sources;
+					for (auto* Source : Embedded)
+					{
+						Sources.emplace_back(Source->Text, Source->Length);
+					}
+
+					program = compute::program::create_with_source(Sources, ProgramContext);
+				}
+				else
+				{
+					std::vector<std::string> Paths;
+					for (auto& File : Files)
+					{
+						Paths.push_back(Directory + File);
+					}
+
+					program = create_with_source_file(Paths, ProgramContext);
+				}
+
+				((logged_compute_program*)(&program))->build(Options);
+			}
+			catch (...)
+			{
+				Forget();
+				Promise.set_exception(std::current_exception());
+				throw;
+			}
+
+			Stats::Add(Stats::Counter::ProgramBuilds, 1);
+			Stats::Record(Stats::Histogram::BuildTime, (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - StartTime).count());
+
+			if (program.get_build_info<cl_build_status>(CL_PROGRAM_BUILD_STATUS, ProgramContext.get_device()) != CL_BUILD_SUCCESS)
+				Forget();
+
+			// The ones waiting get the failed program as well, their kernels throw
+			Promise.set_value(program);
+			return program;
+		}
+
+		static Specialization OctaveSpecialization(int32_t depth)
+		{
+			if (depth < 1 || depth > MaxSpecializedOctaves)
+				return Specialization();
+
+			return { { "PERLIN_DEPTH", std::to_string(depth) } };
+		}
+
+		static Specialization MixSpecialization(MixOperation MixType)
+		{
+			return { { "MIX_TYPE", std::to_string((int32_t)MixType) } };
+		}
+
+		// Pixels per work item of the row kernels on the current device, 0 if
+		// it gets the image kernels. Some CPU runtimes prefer scalar code and
+		// vectorise it themselves, those report a native width, so the wider
+		// of the two is taken, at least 4 (SSE) and at most 16 (AVX-512)
+		static int32_t RowKernelWidth()
+		{
+			if (!AreCpuRowKernelsEnabled())
+				return 0;
+
+			const compute::device Device = GetQueue().get_device();
+			if ((Device.type() & CL_DEVICE_TYPE_CPU) == 0)
+				return 0;
+
+			const cl_uint Width = std::max(Device.get_info<cl_uint>(CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT),
+				Device.get_info<cl_uint>(CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT));
+
+			return Width >= 16 ? 16 : Width >= 8 ? 8 : 4;
+		}
+
+		static Specialization RowSpecialization(int32_t RowWidth)
+		{
+			return { { "VECTOR_WIDTH", std::to_string(RowWidth) } };
+		}
+
+		// mix_rows always needs its operation
+		static Specialization MixRowSpecialization(MixOperation MixType, int32_t RowWidth)
+		{
+			Specialization Defines = RowSpecialization(RowWidth);
+			Defines.push_back({ "MIX_TYPE", std::to_string((int32_t)MixType) });
+			return Defines;
+		}
+
+		// One work item per RowWidth pixels of a row
+		static compute::extents<2> RowKernelSize(size_t Width, size_t Height, int32_t RowWidth)
+		{
+			return compute::dim((Width + RowWidth - 1) / RowWidth, Height);
+		}
+
+		// Single channel float maps between images and row-major buffers
+		static void CopyImageToRows(compute::image2d& Image, compute::buffer& Rows)
+		{
+			const size_t Origin[3] = { 0, 0, 0 };
+			const size_t Region[3] = { Image.width(), Image.height(), 1 };
+			Profiling::TraceEvent(GetQueue().enqueue_copy_image_to_buffer(Image, Rows, Origin, Region, 0), "copy_image_to_rows");
+		}
+
+		static void CopyRowsToImage(compute::buffer& Rows, compute::image2d& Image)
+		{
+			const size_t Origin[3] = { 0, 0, 0 };
+			const size_t Region[3] = { Image.width(), Image.height(), 1 };
+			Profiling::TraceEvent(GetQueue().enqueue_copy_buffer_to_image(Rows, Image, 0, Origin, Region), "copy_rows_to_image");
+		}
+
+		// Row kernels only write single channel float maps
+		static int32_t RowKernelWidth(const compute::image2d& Heightmap)
+		{
+			return Heightmap.format() == ImageFormat ? RowKernelWidth() : 0;
+		}
+
+		// The buffer under the image of a heightmap with buffer storage (see
+		// HeightmapStorage), packed the way the row kernels read and write.
+		// False for any other image
+		static bool GetBufferRows(const compute::image2d& Image, compute::buffer& OutRows)
+		{
+			if (Image.format() != ImageFormat)
+				return false;
+
+			const cl_mem Rows = Image.get_memory_info<cl_mem>(CL_MEM_ASSOCIATED_MEMOBJECT);
+			if (Rows == nullptr || Image.get_info<size_t>(CL_IMAGE_ROW_PITCH) != Image.width() * sizeof(float))
+				return false;
+
+			OutRows = compute::buffer(Rows);
+			return true;
+		}
+
+		// Image as rows for a row kernel to read, a copy unless it has buffer storage
+		static compute::buffer ReadRows(compute::image2d& Image)
+		{
+			compute::buffer Rows;
+			if (GetBufferRows(Image, Rows))
+				return Rows;
+
+			Rows = compute::buffer(GetContext(), Image.width() * Image.height() * sizeof(float));
+			CopyImageToRows(Image, Rows);
+			return Rows;
+		}
+
+		// Runs a row kernel that writes its first argument, a row-major buffer
+		// as wide as its second argument. That's Heightmap's own buffer if it
+		// has one, otherwise a temporary that's copied in to Heightmap
+		static void RunRowKernel(compute::kernel& Kernel, compute::image2d& Heightmap, int32_t RowWidth, const char* Name)
+		{
+			compute::buffer Rows;
+			const bool bInPlace = GetBufferRows(Heightmap, Rows);
+			if (!bInPlace)
+				Rows = compute::buffer(GetContext(), Heightmap.width() * Heightmap.height() * sizeof(float));
+
+			Kernel.set_arg(0, Rows);
+			Kernel.set_arg(1, (cl_int)Heightmap.width());
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(Kernel, compute::dim(0, 0),
+				RowKernelSize(Heightmap.width(), Heightmap.height(), RowWidth), compute::dim(1, 1)), Name);
+
+			if (!bInPlace)
+				CopyRowsToImage(Rows, Heightmap);
+		}
+
+		// Physical constants of the pipe model, see erosion.cl
+		static const float ErosionGravity		= 9.80665f;
+		static const float ErosionPipeArea		= 20.f;
+		static const float ErosionPipeLength	= 5.f;
+
+		// Only the constants are defines. The settings are tuned from the
+		// editor, as defines every change would be a cold compile and a
+		// program cached for good, so they stay kernel arguments and every
+		// erosion run shares one build per context
+		static Specialization ErosionSpecialization()
+		{
+			return {
+				{ "EROSION_GRAVITY",		FloatLiteral(ErosionGravity) },
+				{ "EROSION_PIPE_AREA",		FloatLiteral(ErosionPipeArea) },
+				{ "EROSION_PIPE_LENGTH",	FloatLiteral(ErosionPipeLength) },
+			};
+		}
+
+		// The erosion program, with the row kernels when RowWidth isn't 0
+		static compute::program BuildErosionProgram(int32_t RowWidth)
+		{
+			if (RowWidth > 0)
+				return BuildProgram({ "perlin.cl", "erosion.cl", "erosion_rows.cl" }, ErosionSpecialization(), RowSpecialization(RowWidth));
+
+			return BuildProgram({ "perlin.cl", "erosion.cl" }, ErosionSpecialization());
+		}
+
+		// Every program the nodes use, built ahead of time by the warm up
+		static void BuildAllPrograms()
+		{
+			const std::vector<std::vector<std::string>> Programs = {
+				{ "perlin.cl" },
+				{ "perlin.cl", "warpedperlin.cl" },
+				{ "perlin.cl", "voronoi.cl" },
+				{ "gradientnoise.cl" },
+				{ "voronoigrid.cl" },
+				{ "mix.cl" },
+				{ "mip.cl" },
+				{ "box_filter.cl" },
+				{ "reduce.cl" },
+				{ "perlin.cl", "batch.cl" },
+				{ "init.cl" },
+			};
+
+			for (const auto& Files : Programs)
+			{
+				BuildProgram(Files);
+			}
+
+			BuildErosionProgram(0);
+
+			// There are only a few mix variants, the others depend on the graph
+			for (MixOperation MixType : { MixOperation::Add, MixOperation::Subtract, MixOperation::Multiply, MixOperation::Min, MixOperation::Max })
+			{
+				BuildProgram({ "mix.cl" }, MixSpecialization(MixType));
+			}
+
+			// And the row kernels on CPU devices
+			const int32_t RowWidth = RowKernelWidth();
+			if (RowWidth > 0)
+			{
+				const std::vector<std::vector<std::string>> RowPrograms = {
+					{ "perlin.cl", "perlin_rows.cl" },
+					{ "perlin.cl", "voronoi.cl", "voronoi_rows.cl" },
+				};
+
+				for (const auto& Files : RowPrograms)
+				{
+					BuildProgram(Files, Specialization(), RowSpecialization(RowWidth));
+				}
+
+				BuildErosionProgram(RowWidth);
+
+				for (MixOperation MixType : { MixOperation::Add, MixOperation::Subtract, MixOperation::Multiply, MixOperation::Min, MixOperation::Max })
+				{
+					BuildProgram({ "mix_rows.cl" }, Specialization(), MixRowSpecialization(MixType, RowWidth));
+				}
+			}
+		}
+
+		// Noise that's split over the MultiDevice lanes, the band is just a
+		// smaller region further down the world
+		static bool ShouldSplitNoise(const compute::image2d& Heightmap)
+		{
+			return Heightmap.format() == ImageFormat && MultiDevice::ShouldSplit((int32_t)Heightmap.height());
+		}
+
+		// Runs Generate on every lane at once, each filling its own band of
+		// Output. The primary lane's band is copied on the device, the others
+		// come back through the host
+		static void GenerateBands(compute::image2d& Output, const TileRegion& Region,
+			const std::function<void(compute::image2d&, const TileRegion&)>& Generate)
+		{
+			using compute::dim;
+
+			Profiling::ScopedSpan Span("Generate Bands", "MultiDevice");
+
+			const auto Lanes = MultiDevice::GetLanes();
+			const auto Bands = MultiDevice::SplitRows((int32_t)Output.height());
+			const size_t Width = Output.width();
+
+			std::vector<float> Staging(Width * Output.height());
+			std::vector<std::future<void>> Futures;
+
+			for (const auto& Band : Bands)
+			{
+				Futures.push_back(std::async(std::launch::async, [&, Band]()
+				{
+					MultiDevice::Lane& Lane = *Lanes[Band.Lane];
+					ScopedQueue Bind(Lane.Queue);
+
+					const auto StartTime = std::chrono::steady_clock::now();
+
+					auto BandMap = CreateHeightmap((int32_t)Width, Band.Rows, Output.format());
+
+					TileRegion BandRegion = Region;
+					BandRegion.OriginY += Band.Start * Region.Step;
+					Generate(BandMap->Image, BandRegion);
+
+					if (Lane.bPrimary)
+					{
+						Lane.Queue.enqueue_copy_image(BandMap->Image, Output, dim(0, 0), dim(0, Band.Start), BandMap->Image.size());
+					}
+					else
+					{
+						TraceDownload(Lane.Queue.enqueue_read_image(BandMap->Image, BandMap->Image.origin(), BandMap->Image.size(),
+							Staging.data() + Band.Start * Width), BandMap->Image.get_memory_size());
+					}
+
+					Lane.Queue.finish();
+
+					MultiDevice::ReportThroughput(Band.Lane, (double)Width * Band.Rows,
+						std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count());
+				}));
+			}
+
+			// Rethrows anything that went wrong on a lane
+			for (auto& Future : Futures)
+			{
+				Future.get();
+			}
+
+			for (const auto& Band : Bands)
+			{
+				if (Lanes[Band.Lane]->bPrimary)
+					continue;
+
+				TraceUpload(GetQueue().enqueue_write_image(Output, dim(0, Band.Start), dim(Width, Band.Rows),
+					Staging.data() + Band.Start * Width), Width * Band.Rows * sizeof(float));
+			}
+		}
+
+		void PerlinNoise(compute::image2d& Heightmap,
+			float noiseSize, int32_t seed, int32_t depth, float amplitude, const TileRegion& Region)
+		{
+			using compute::dim;
+
+			if (ShouldSplitNoise(Heightmap))
+			{
+				GenerateBands(Heightmap, Region, [=](compute::image2d& Band, const TileRegion& BandRegion)
+				{
+					PerlinNoise(Band, noiseSize, seed, depth, amplitude, BandRegion);
+				});
+				return;
+			}
+
+			const int32_t RowWidth = RowKernelWidth(Heightmap);
+			if (RowWidth > 0)
+			{
+				compute::program program = BuildProgram({ "perlin.cl", "perlin_rows.cl" }, OctaveSpecialization(depth), RowSpecialization(RowWidth));
+
+				compute::kernel kernel(program, "perlin_rows");
+				kernel.set_arg(2, noiseSize);
+				kernel.set_arg(3, seed);
+				kernel.set_arg(4, depth);
+				kernel.set_arg(5, amplitude);
+				kernel.set_arg(6, Region.OriginX);
+				kernel.set_arg(7, Region.OriginY);
+				kernel.set_arg(8, Region.Step);
+
+				RunRowKernel(kernel, Heightmap, RowWidth, "perlin_rows");
+				return;
+			}
+
+			// Create the images needed for this kernel
+			compute::image2d input_image(GetContext(), Heightmap.width(), Heightmap.height(), ImageFormat);
+
+			// build box filter program
+			compute::program program = BuildProgram({ "perlin.cl" }, OctaveSpecialization(depth));
+
+			// setup perlin kernel
+			compute::kernel kernel(program, "perlin");
+			kernel.set_arg(0, input_image);
+			kernel.set_arg(1, Heightmap);
+			kernel.set_arg(2, noiseSize);
+			kernel.set_arg(3, seed);
+			kernel.set_arg(4, depth);
+			kernel.set_arg(5, amplitude);
+			kernel.set_arg(6, Region.OriginX);
+			kernel.set_arg(7, Region.OriginY);
+			kernel.set_arg(8, Region.Step);
+
+			// execute the kernel
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), input_image.size(), dim(1, 1)), "perlin");
+		}
+
+		// Rounds towards negative infinity, like floor_div in the kernels
+		static int32_t FloorDiv(int32_t A, int32_t B)
+		{
+			return A >= 0 ? A / B : -((-A + B - 1) / B);
+		}
+
+		void WarpedPerlinNoise(compute::image2d& Heightmap,
+			float noiseSize, int32_t seed, int32_t depth, float amplitude, const TileRegion& Region,
+			const WarpFieldSettings& Warp)
+		{
+			using compute::dim;
+
+			if (ShouldSplitNoise(Heightmap))
+			{
+				GenerateBands(Heightmap, Region, [=](compute::image2d& Band, const TileRegion& BandRegion)
+				{
+					WarpedPerlinNoise(Band, noiseSize, seed, depth, amplitude, BandRegion, Warp);
+				});
+				return;
+			}
+
+			const int32_t WarpDepth = Warp.Depth > 0 ? Warp.Depth : depth;
+
+			if (Warp.Downsample <= 1 && WarpDepth == depth)
+			{
+				// Create the images needed for this kernel
+				compute::image2d input_image(GetContext(), Heightmap.width(), Heightmap.height(), ImageFormat);
+
+				// build box filter program
+				compute::program program = BuildProgram({ "perlin.cl", "warpedperlin.cl" }, OctaveSpecialization(depth));
+
+				// setup perlin kernel
+				compute::kernel kernel(program, "warpedperlin");
+				kernel.set_arg(0, input_image);
+				kernel.set_arg(1, Heightmap);
+				kernel.set_arg(2, noiseSize);
+				kernel.set_arg(3, seed);
+				kernel.set_arg(4, depth);
+				kernel.set_arg(5, amplitude);
+				kernel.set_arg(6, Region.OriginX);
+				kernel.set_arg(7, Region.OriginY);
+				kernel.set_arg(8, Region.Step);
+
+				// execute the kernel
+				Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), input_image.size(), dim(1, 1)), "warpedperlin");
+				return;
+			}
+
+			// The field's texels are on a world space grid of FieldStep, so
+			// neighbouring tiles and bands sample the same texels
+			const int32_t FieldStep		= Region.Step * std::max(Warp.Downsample, 1);
+			const int32_t FieldOriginX	= FloorDiv(Region.OriginX, FieldStep) * FieldStep;
+			const int32_t FieldOriginY	= FloorDiv(Region.OriginY, FieldStep) * FieldStep;
+
+			// Enough texels to have one past the last pixel on both axes
+			const int32_t LastX = Region.OriginX + ((int32_t)Heightmap.width() - 1) * Region.Step;
+			const int32_t LastY = Region.OriginY + ((int32_t)Heightmap.height() - 1) * Region.Step;
+			const int32_t FieldSizeX = (LastX - FieldOriginX) / FieldStep + 2;
+			const int32_t FieldSizeY = (LastY - FieldOriginY) / FieldStep + 2;
+
+			// RGBA float is the only two channel float format every device can filter
+			auto Field = CreateHeightmap(FieldSizeX, FieldSizeY, compute::image_format(CL_RGBA, CL_FLOAT));
+
+			compute::program field_program = BuildProgram({ "perlin.cl", "warpedperlin.cl" }, OctaveSpecialization(WarpDepth));
+
+			compute::kernel field_kernel(field_program, "warp_field");
+			field_kernel.set_arg(0, Field->Image);
+			field_kernel.set_arg(1, noiseSize);
+			field_kernel.set_arg(2, seed);
+			field_kernel.set_arg(3, WarpDepth);
+			field_kernel.set_arg(4, FieldOriginX);
+			field_kernel.set_arg(5, FieldOriginY);
+			field_kernel.set_arg(6, FieldStep);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(field_kernel, dim(0, 0), Field->Image.size(), dim(1, 1)), "warp_field");
+
+			compute::program program = BuildProgram({ "perlin.cl", "warpedperlin.cl" }, OctaveSpecialization(depth));
+
+			compute::kernel kernel(program, "warpedperlin_field");
+			kernel.set_arg(0, Field->Image);
+			kernel.set_arg(1, Heightmap);
+			kernel.set_arg(2, noiseSize);
+			kernel.set_arg(3, seed);
+			kernel.set_arg(4, depth);
+			kernel.set_arg(5, amplitude);
+			kernel.set_arg(6, Region.OriginX);
+			kernel.set_arg(7, Region.OriginY);
+			kernel.set_arg(8, Region.Step);
+			kernel.set_arg(9, FieldOriginX);
+			kernel.set_arg(10, FieldOriginY);
+			kernel.set_arg(11, FieldStep);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), Heightmap.size(), dim(1, 1)), "warpedperlin_field");
+		}
+
+		// Size of the permutation table in gradientnoise.cl
+		static const size_t PermutationSize = 256;
+
+		// 0 to PermutationSize - 1 shuffled by seed. Fisher-Yates on mt19937,
+		// whose output is the same everywhere (std::shuffle's isn't)
+		static std::vector<cl_uchar> MakePermutation(int32_t seed)
+		{
+			std::vector<cl_uchar> Permutation(PermutationSize);
+			for (size_t i = 0; i < PermutationSize; i++)
+			{
+				Permutation[i] = (cl_uchar)i;
+			}
+
+			std::mt19937 Random((uint32_t)seed);
+			for (size_t i = PermutationSize - 1; i > 0; i--)
+			{
+				std::swap(Permutation[i], Permutation[Random() % (i + 1)]);
+			}
+
+			return Permutation;
+		}
+
+		static void GradientNoiseKernel(const char* KernelName, compute::image2d& Heightmap,
+			float noiseSize, int32_t seed, int32_t depth, float amplitude, const TileRegion& Region)
+		{
+			using compute::dim;
+
+			compute::program program = BuildProgram({ "gradientnoise.cl" }, OctaveSpecialization(depth));
+			compute::kernel kernel(program, KernelName);
+
+			std::vector<cl_uchar> Permutation = MakePermutation(seed);
+			compute::buffer PermutationBuffer(GetContext(), Permutation.size(),
+				compute::memory_object::read_only | compute::memory_object::copy_host_ptr, Permutation.data());
+
+			kernel.set_arg(0, Heightmap);
+			kernel.set_arg(1, PermutationBuffer);
+			kernel.set_arg(2, noiseSize);
+			kernel.set_arg(3, depth);
+			kernel.set_arg(4, amplitude);
+			kernel.set_arg(5, Region.OriginX);
+			kernel.set_arg(6, Region.OriginY);
+			kernel.set_arg(7, Region.Step);
+
+			// Every work group copies the table in to local memory, so the groups
+			// should be as big as the device allows (up to 16x16)
+			const size_t MaxGroupSize = kernel.get_work_group_info<size_t>(GetQueue().get_device(), CL_KERNEL_WORK_GROUP_SIZE);
+			const size_t GroupSize = MaxGroupSize >= 256 ? 16 : (MaxGroupSize >= 64 ? 8 : 1);
+
+			const size_t GlobalX = (Heightmap.width() + GroupSize - 1) / GroupSize * GroupSize;
+			const size_t GlobalY = (Heightmap.height() + GroupSize - 1) / GroupSize * GroupSize;
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), dim(GlobalX, GlobalY), dim(GroupSize, GroupSize)), KernelName);
+		}
+
+		void SimplexNoise(compute::image2d& Heightmap,
+			float noiseSize, int32_t seed, int32_t depth, float amplitude, const TileRegion& Region)
+		{
+			if (ShouldSplitNoise(Heightmap))
+			{
+				GenerateBands(Heightmap, Region, [=](compute::image2d& Band, const TileRegion& BandRegion)
+				{
+					SimplexNoise(Band, noiseSize, seed, depth, amplitude, BandRegion);
+				});
+				return;
+			}
+
+			GradientNoiseKernel("simplex_noise", Heightmap, noiseSize, seed, depth, amplitude, Region);
+		}
+
+		void GradientNoise(compute::image2d& Heightmap,
+			float noiseSize, int32_t seed, int32_t depth, float amplitude, const TileRegion& Region)
+		{
+			if (ShouldSplitNoise(Heightmap))
+			{
+				GenerateBands(Heightmap, Region, [=](compute::image2d& Band, const TileRegion& BandRegion)
+				{
+					GradientNoise(Band, noiseSize, seed, depth, amplitude, BandRegion);
+				});
+				return;
+			}
+
+			GradientNoiseKernel("gradient_noise", Heightmap, noiseSize, seed, depth, amplitude, Region);
+		}
+
+		void Mix(compute::image2d& LHeightMap,
+			compute::image2d& RHeightMap,
+			compute::image2d& OutputHeightmap,
+			MixOperation MixType)
+		{
+			// Make sure that the enum is the correct size and the images are the correct sizes
+			static_assert(sizeof(MixType) == sizeof(cl_uchar), "sizeof(MixType) must equal sizeof(uchar)!");
+			assert(LHeightMap.width() == RHeightMap.width() && LHeightMap.height() == RHeightMap.height());
+			assert(RHeightMap.width() == OutputHeightmap.width() && RHeightMap.height() == OutputHeightmap.height());
+
+			using compute::dim;
+
+			// Inputs without buffer storage are copied in to buffers first, that's
+			// still cheaper than three emulated image accesses per pixel
+			const int32_t RowWidth = RowKernelWidth(OutputHeightmap);
+			if (RowWidth > 0 && LHeightMap.format() == ImageFormat && RHeightMap.format() == ImageFormat)
+			{
+				compute::buffer LRows = ReadRows(LHeightMap);
+				compute::buffer RRows = ReadRows(RHeightMap);
+
+				compute::program program = BuildProgram({ "mix_rows.cl" }, Specialization(), MixRowSpecialization(MixType, RowWidth));
+
+				compute::kernel kernel(program, "mix_rows");
+				kernel.set_arg(2, (cl_int)LHeightMap.height());
+				kernel.set_arg(3, LRows);
+				kernel.set_arg(4, RRows);
+
+				RunRowKernel(kernel, OutputHeightmap, RowWidth, "mix_rows");
+				return;
+			}
+
+			compute::program program = BuildProgram({ "mix.cl" }, MixSpecialization(MixType));
+
+			// setup box filter kernel
+			compute::kernel kernel(program, "mix_kernel");
+			kernel.set_arg(0, OutputHeightmap);
+			kernel.set_arg(1, LHeightMap);
+			kernel.set_arg(2, RHeightMap);
+			kernel.set_arg(3, (cl_uchar)MixType);
+
+			// execute the box filter kernel
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), LHeightMap.size(), dim(1, 1)), "mix_kernel");
+		}
+
+		void VoronoiNoise(compute::image2d& Heightmap,
+			int32_t noiseSize,
+			int32_t seed,
+			float amplitude,
+			const TileRegion& Region)
+		{
+			using compute::dim;
+
+			if (ShouldSplitNoise(Heightmap))
+			{
+				GenerateBands(Heightmap, Region, [=](compute::image2d& Band, const TileRegion& BandRegion)
+				{
+					VoronoiNoise(Band, noiseSize, seed, amplitude, BandRegion);
+				});
+				return;
+			}
+
+			const int32_t RowWidth = RowKernelWidth(Heightmap);
+			if (RowWidth > 0)
+			{
+				compute::program program = BuildProgram({ "perlin.cl", "voronoi.cl", "voronoi_rows.cl" },
+					Specialization(), RowSpecialization(RowWidth));
+
+				compute::kernel kernel(program, "voronoi_rows");
+				kernel.set_arg(2, noiseSize);
+				kernel.set_arg(3, seed);
+				kernel.set_arg(4, amplitude);
+				kernel.set_arg(5, Region.OriginX);
+				kernel.set_arg(6, Region.OriginY);
+				kernel.set_arg(7, Region.Step);
+
+				RunRowKernel(kernel, Heightmap, RowWidth, "voronoi_rows");
+				return;
+			}
+
+			// Create the images needed for this kernel
+			compute::image2d input_image(GetContext(), Heightmap.width(), Heightmap.height(), ImageFormat);
+
+			// build box filter program
+			compute::program program = BuildProgram({ "perlin.cl", "voronoi.cl" });
+
+			// setup box filter kernel
+			compute::kernel kernel(program, "voronoi");
+			kernel.set_arg(0, input_image);
+			kernel.set_arg(1, Heightmap);
+			kernel.set_arg(2, noiseSize);
+			kernel.set_arg(3, seed);
+			kernel.set_arg(4, amplitude);
+			kernel.set_arg(5, Region.OriginX);
+			kernel.set_arg(6, Region.OriginY);
+			kernel.set_arg(7, Region.Step);
+
+			// execute the box filter kernel
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), input_image.size(), dim(1, 1)), "voronoi");
+		}
+
+		void VoronoiFeatures(compute::image2d& F1,
+			compute::image2d& F2,
+			compute::image2d& Edge,
+			compute::image2d& CellId,
+			int32_t noiseSize,
+			int32_t seed,
+			float amplitude,
+			const TileRegion& Region)
+		{
+			using compute::dim;
+
+			for (const compute::image2d* Output : { &F2, &Edge, &CellId })
+			{
+				if (Output->width() != F1.width() || Output->height() != F1.height())
+					throw std::runtime_error("The Voronoi outputs have to be the same size");
+			}
+
+			compute::program program = BuildProgram({ "voronoigrid.cl" });
+
+			compute::kernel kernel(program, "voronoi_features");
+			kernel.set_arg(0, F1);
+			kernel.set_arg(1, F2);
+			kernel.set_arg(2, Edge);
+			kernel.set_arg(3, CellId);
+			kernel.set_arg(4, noiseSize);
+			kernel.set_arg(5, seed);
+			kernel.set_arg(6, amplitude);
+			kernel.set_arg(7, Region.OriginX);
+			kernel.set_arg(8, Region.OriginY);
+			kernel.set_arg(9, Region.Step);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), F1.size(), dim(1, 1)), "voronoi_features");
+		}
+
+		static bool IsUnsignedFormat(const compute::image_format& Format)
+		{
+			const cl_channel_type Type = Format.get_format_ptr()->image_channel_data_type;
+			return Type == CL_UNSIGNED_INT8 || Type == CL_UNSIGNED_INT16 || Type == CL_UNSIGNED_INT32;
+		}
+
+		void Fill(compute::image2d& Image, float Value)
+		{
+			using compute::dim;
+
+			const bool bUnsigned = IsUnsignedFormat(Image.format());
+			const cl_float4 FloatColor = { { Value, Value, Value, Value } };
+			const cl_uint Rounded = (cl_uint)std::max(Value + 0.5f, 0.f);
+			const cl_uint4 UintColor = { { Rounded, Rounded, Rounded, Rounded } };
+
+#ifdef CL_VERSION_1_2
+			if (GetQueue().get_device().check_version(1, 2))
+			{
+				const void* Color = bUnsigned ? (const void*)&UintColor : (const void*)&FloatColor;
+				Profiling::TraceEvent(GetQueue().enqueue_fill_image(Image, Color, Image.origin(), Image.size()), "fill_image");
+				return;
+			}
+#endif
+
+			compute::program program = BuildProgram({ "init.cl" });
+
+			compute::kernel kernel(program, bUnsigned ? "fill_uint" : "fill_float");
+			kernel.set_arg(0, Image);
+			if (bUnsigned)
+				kernel.set_arg(1, UintColor);
+			else
+				kernel.set_arg(1, FloatColor);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), Image.size(), dim(1, 1)), bUnsigned ? "fill_uint" : "fill_float");
+		}
+
+		void Constant(compute::image2d& Heightmap,
+			float height)
+		{
+			Fill(Heightmap, height);
+		}
+
+		// Levels written by one mip_reduce dispatch, see mip.cl
+		static const int32_t MipLevelsPerPass = 4;
+		static const size_t MipGroupSize = 8;
+
+		vector<shared_ptr<Heightmap>> MipPyramid(compute::image2d& Heightmap,
+			int32_t Levels)
+		{
+			if (Heightmap.format() != ImageFormat)
+				throw std::runtime_error("Mip pyramids can only be built from single channel float heightmaps");
+
+			using compute::dim;
+
+			const int32_t SizeX = (int32_t)Heightmap.width();
+			const int32_t SizeY = (int32_t)Heightmap.height();
+
+			Levels = Clamp(Levels, 0, GetMipLevelCount(SizeX, SizeY));
+
+			vector<shared_ptr<LandscapeGeneration::Heightmap>> Pyramid;
+			for (int32_t Level = 1; Level <= Levels; Level++)
+			{
+				int32_t LevelX, LevelY;
+				GetMipLevelSize(SizeX, SizeY, Level, LevelX, LevelY);
+				Pyramid.push_back(CreateHeightmap(LevelX, LevelY, compute::image_format(CL_RGBA, CL_FLOAT)));
+			}
+
+			if (Levels == 0)
+				return Pyramid;
+
+			compute::program program = BuildProgram({ "mip.cl" });
+
+			compute::kernel kernel(program, "mip_reduce");
+
+			// Each pass reduces the last level written by the one before it
+			for (int32_t First = 0; First < Levels; First += MipLevelsPerPass)
+			{
+				const int32_t PassLevels = std::min(MipLevelsPerPass, Levels - First);
+				compute::image2d& Input = First == 0 ? Heightmap : Pyramid[First - 1]->Image;
+
+				kernel.set_arg(0, Input);
+				kernel.set_arg(1, (cl_int)(First == 0 ? 0 : 1));
+
+				// Levels that aren't written still need a valid image
+				for (int32_t i = 0; i < MipLevelsPerPass; i++)
+				{
+					kernel.set_arg(2 + i, Pyramid[First + std::min(i, PassLevels - 1)]->Image);
+				}
+
+				kernel.set_arg(6, (cl_int)PassLevels);
+
+				// One work item per texel of the first level in this pass, rounded up to whole groups
+				auto& FirstLevel = Pyramid[First]->Image;
+				const size_t GlobalX = (FirstLevel.width() + MipGroupSize - 1) / MipGroupSize * MipGroupSize;
+				const size_t GlobalY = (FirstLevel.height() + MipGroupSize - 1) / MipGroupSize * MipGroupSize;
+
+				Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), dim(GlobalX, GlobalY), dim(MipGroupSize, MipGroupSize)), "mip_reduce");
+			}
+
+			return Pyramid;
+		}
+
+		void MipChannel(compute::image2d& Level,
+			compute::image2d& OutputHeightmap,
+			MipReduction Reduction)
+		{
+			assert(Level.width() == OutputHeightmap.width() && Level.height() == OutputHeightmap.height());
+
+			using compute::dim;
+
+			compute::program program = BuildProgram({ "mip.cl" });
+
+			compute::kernel kernel(program, "mip_channel");
+			kernel.set_arg(0, Level);
+			kernel.set_arg(1, OutputHeightmap);
+			kernel.set_arg(2, (cl_int)Reduction);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), OutputHeightmap.size(), dim(1, 1)), "mip_channel");
+		}
+
+		void Resample(compute::image2d& Heightmap,
+			compute::image2d& OutputHeightmap)
+		{
+			using compute::dim;
+
+			compute::program program = BuildProgram({ "mip.cl" });
+
+			compute::kernel kernel(program, "resample_bilinear");
+			kernel.set_arg(0, Heightmap);
+			kernel.set_arg(1, OutputHeightmap);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), OutputHeightmap.size(), dim(1, 1)), "resample_bilinear");
+		}
+
+		// Pixels per box_pass work item, segments are never shorter than the window
+		static const int32_t BoxSegmentLength = 256;
+
+		static void CheckFilterImages(compute::image2d& Heightmap, compute::image2d& OutputHeightmap)
+		{
+			if (Heightmap.format() != ImageFormat || OutputHeightmap.format() != ImageFormat)
+				throw std::runtime_error("Filters only work on single channel float heightmaps");
+
+			if (Heightmap.width() != OutputHeightmap.width() || Heightmap.height() != OutputHeightmap.height())
+				throw std::runtime_error("The filter output has to be the same size as the heightmap");
+		}
+
+		static void BoxPass(compute::image2d& Input, compute::image2d& Output, int32_t Radius, bool bHorizontal)
+		{
+			using compute::dim;
+
+			compute::program program = BuildProgram({ "box_filter.cl" });
+
+			const size_t Length	= bHorizontal ? Input.width() : Input.height();
+			const size_t Lines	= bHorizontal ? Input.height() : Input.width();
+			const size_t Segment	= (size_t)std::max(BoxSegmentLength, 2 * Radius + 1);
+
+			compute::kernel kernel(program, "box_pass");
+			kernel.set_arg(0, Input);
+			kernel.set_arg(1, Output);
+			kernel.set_arg(2, (cl_int)Radius);
+			kernel.set_arg(3, (cl_int)(bHorizontal ? 1 : 0));
+			kernel.set_arg(4, (cl_int)Segment);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), dim(Lines, (Length + Segment - 1) / Segment), dim(1, 1)), "box_pass");
+		}
+
+		// Runs a box pass per radius along the rows, then the same along the
+		// columns, ping-ponging between two scratch images
+		static void BoxPasses(compute::image2d& Heightmap, compute::image2d& OutputHeightmap, std::vector<int32_t> Radii)
+		{
+			Radii.erase(std::remove(Radii.begin(), Radii.end(), 0), Radii.end());
+
+			if (Radii.empty())
+			{
+				GetQueue().enqueue_copy_image(Heightmap, OutputHeightmap, Heightmap.origin(), OutputHeightmap.origin(), Heightmap.size());
+				return;
+			}
+
+			const size_t Passes = Radii.size() * 2;
+			std::shared_ptr<LandscapeGeneration::Heightmap> Scratch[2];
+
+			compute::image2d* Input = &Heightmap;
+			for (size_t Pass = 0; Pass < Passes; Pass++)
+			{
+				compute::image2d* Output = &OutputHeightmap;
+				if (Pass + 1 < Passes)
+				{
+					auto& Target = Scratch[Pass % 2];
+					if (!Target)
+						Target = CreateHeightmap((int32_t)Heightmap.width(), (int32_t)Heightmap.height());
+
+					Output = &Target->Image;
+				}
+
+				BoxPass(*Input, *Output, Radii[Pass % Radii.size()], Pass < Radii.size());
+				Input = Output;
+			}
+		}
+
+		void BoxBlur(compute::image2d& Heightmap,
+			compute::image2d& OutputHeightmap,
+			int32_t Radius)
+		{
+			CheckFilterImages(Heightmap, OutputHeightmap);
+			BoxPasses(Heightmap, OutputHeightmap, { std::max(Radius, 0) });
+		}
+
+		void GaussianBlur(compute::image2d& Heightmap,
+			compute::image2d& OutputHeightmap,
+			float Sigma)
+		{
+			CheckFilterImages(Heightmap, OutputHeightmap);
+
+			// Box widths whose three passes have the variance of the gaussian,
+			// from "Fast almost-Gaussian filtering" (Kovesi)
+			const int32_t Boxes = 3;
+			const double Variance = 12.0 * std::max(Sigma, 0.f) * std::max(Sigma, 0.f);
+
+			int32_t Lower = (int32_t)std::floor(std::sqrt(Variance / Boxes + 1.0));
+			if (Lower % 2 == 0)
+				Lower--;
+
+			const int32_t Upper = Lower + 2;
+			const int32_t LowerCount = (int32_t)std::lround((Variance - Boxes * Lower * Lower - 4.0 * Boxes * Lower - 3.0 * Boxes) / (-4.0 * Lower - 4.0));
+
+			std::vector<int32_t> Radii;
+			for (int32_t i = 0; i < Boxes; i++)
+			{
+				Radii.push_back(((i < LowerCount ? Lower : Upper) - 1) / 2);
+			}
+
+			BoxPasses(Heightmap, OutputHeightmap, Radii);
+		}
+
+		// One van Herk/Gil-Werman pass, see box_filter.cl. Prefix and Suffix
+		// have room for every line of the pass
+		static void MorphologyPass(compute::image2d& Input, compute::image2d& Output,
+			compute::buffer& Prefix, compute::buffer& Suffix, int32_t Radius, bool bHorizontal, bool bMin)
+		{
+			using compute::dim;
+
+			compute::program program = BuildProgram({ "box_filter.cl" });
+
+			const size_t Length	= bHorizontal ? Input.width() : Input.height();
+			const size_t Lines	= bHorizontal ? Input.height() : Input.width();
+			const size_t Window	= (size_t)(2 * Radius + 1);
+			const size_t Blocks	= (Length + 2 * Radius + Window - 1) / Window;
+			const cl_int PaddedLength = (cl_int)(Blocks * Window);
+
+			compute::kernel blocks(program, "vhgw_blocks");
+			blocks.set_arg(0, Input);
+			blocks.set_arg(1, Prefix);
+			blocks.set_arg(2, Suffix);
+			blocks.set_arg(3, (cl_int)Radius);
+			blocks.set_arg(4, (cl_int)(bHorizontal ? 1 : 0));
+			blocks.set_arg(5, PaddedLength);
+			blocks.set_arg(6, (cl_int)(bMin ? 1 : 0));
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(blocks, dim(0, 0), dim(Lines, Blocks), dim(1, 1)), "vhgw_blocks");
+
+			compute::kernel combine(program, "vhgw_combine");
+			combine.set_arg(0, Prefix);
+			combine.set_arg(1, Suffix);
+			combine.set_arg(2, Output);
+			combine.set_arg(3, (cl_int)Radius);
+			combine.set_arg(4, (cl_int)(bHorizontal ? 1 : 0));
+			combine.set_arg(5, PaddedLength);
+			combine.set_arg(6, (cl_int)(bMin ? 1 : 0));
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(combine, dim(0, 0), dim(Length, Lines), dim(1, 1)), "vhgw_combine");
+		}
+
+		static void MorphologyFilter(compute::image2d& Heightmap, compute::image2d& OutputHeightmap, int32_t Radius, bool bMin)
+		{
+			CheckFilterImages(Heightmap, OutputHeightmap);
+
+			if (Radius <= 0)
+			{
+				GetQueue().enqueue_copy_image(Heightmap, OutputHeightmap, Heightmap.origin(), OutputHeightmap.origin(), Heightmap.size());
+				return;
+			}
+
+			const size_t Width	= Heightmap.width();
+			const size_t Height	= Heightmap.height();
+			const size_t Window	= (size_t)(2 * Radius + 1);
+
+			// Big enough for the padded lines of either pass
+			const size_t RowFloats		= Height * ((Width + 2 * Radius + Window - 1) / Window) * Window;
+			const size_t ColumnFloats	= Width * ((Height + 2 * Radius + Window - 1) / Window) * Window;
+			const size_t Bytes			= std::max(RowFloats, ColumnFloats) * sizeof(float);
+
+			compute::buffer Prefix(GetContext(), Bytes);
+			compute::buffer Suffix(GetContext(), Bytes);
+
+			auto Scratch = CreateHeightmap((int32_t)Width, (int32_t)Height);
+
+			MorphologyPass(Heightmap, Scratch->Image, Prefix, Suffix, Radius, true, bMin);
+			MorphologyPass(Scratch->Image, OutputHeightmap, Prefix, Suffix, Radius, false, bMin);
+		}
+
+		void MinFilter(compute::image2d& Heightmap,
+			compute::image2d& OutputHeightmap,
+			int32_t Radius)
+		{
+			MorphologyFilter(Heightmap, OutputHeightmap, Radius, true);
+		}
+
+		void MaxFilter(compute::image2d& Heightmap,
+			compute::image2d& OutputHeightmap,
+			int32_t Radius)
+		{
+			MorphologyFilter(Heightmap, OutputHeightmap, Radius, false);
+		}
+
+		// Work groups launched by a reduction at most, the pixels are strided
+		// over them. Bounds what's read back by Statistics
+		static const size_t MaxReductionGroups = 256;
+
+		// Largest power of two work group up to 256 that the kernel can run with
+		static size_t ReductionGroupSize(const compute::kernel& Kernel)
+		{
+			const size_t MaxGroupSize = std::min<size_t>(256,
+				Kernel.get_work_group_info<size_t>(GetQueue().get_device(), CL_KERNEL_WORK_GROUP_SIZE));
+
+			size_t GroupSize = 1;
+			while (GroupSize * 2 <= MaxGroupSize)
+			{
+				GroupSize *= 2;
+			}
+
+			return GroupSize;
+		}
+
+		static void CheckReductionImage(compute::image2d& Heightmap)
+		{
+			if (Heightmap.format() != ImageFormat)
+				throw std::runtime_error("Reductions only work on single channel float heightmaps");
+		}
+
+		// One float4 (min, max, sum, sum of squares) per work group in Partials
+		static compute::buffer ReducePartials(compute::image2d& Heightmap, size_t& OutGroups)
+		{
+			using compute::dim;
+
+			compute::program program = BuildProgram({ "reduce.cl" });
+			compute::kernel kernel(program, "reduce_stats");
+
+			const size_t Count		= Heightmap.width() * Heightmap.height();
+			const size_t GroupSize	= ReductionGroupSize(kernel);
+			OutGroups = std::max<size_t>(std::min((Count + GroupSize - 1) / GroupSize, MaxReductionGroups), 1);
+
+			compute::buffer Partials(GetContext(), OutGroups * sizeof(cl_float4));
+
+			kernel.set_arg(0, Heightmap);
+			kernel.set_arg(1, Partials);
+			kernel.set_arg(2, compute::local_buffer<compute::float4_>(GroupSize));
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0), dim(OutGroups * GroupSize), dim(GroupSize)), "reduce_stats");
+
+			return Partials;
+		}
+
+		// The statistics as one float4 in device memory, for kernels to read
+		static compute::buffer DeviceStatistics(compute::image2d& Heightmap)
+		{
+			using compute::dim;
+
+			size_t Groups = 0;
+			compute::buffer Partials = ReducePartials(Heightmap, Groups);
+
+			compute::program program = BuildProgram({ "reduce.cl" });
+			compute::kernel kernel(program, "finish_stats");
+
+			const size_t GroupSize = ReductionGroupSize(kernel);
+			compute::buffer Result(GetContext(), sizeof(cl_float4));
+
+			kernel.set_arg(0, Partials);
+			kernel.set_arg(1, (cl_int)Groups);
+			kernel.set_arg(2, Result);
+			kernel.set_arg(3, compute::local_buffer<compute::float4_>(GroupSize));
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0), dim(GroupSize), dim(GroupSize)), "finish_stats");
+
+			return Result;
+		}
+
+		HeightmapStatistics Statistics(compute::image2d& Heightmap)
+		{
+			CheckReductionImage(Heightmap);
+
+			size_t Groups = 0;
+			compute::buffer Partials = ReducePartials(Heightmap, Groups);
+
+			// The partials are combined in double, the float sums are per group only
+			std::vector<float> Values(Groups * 4);
+			TraceDownload(GetQueue().enqueue_read_buffer(Partials, 0, Values.size() * sizeof(float), Values.data()), Values.size() * sizeof(float));
+
+			HeightmapStatistics Result;
+			Result.Count	= (uint64_t)Heightmap.width() * Heightmap.height();
+			Result.Min		= std::numeric_limits<float>::max();
+			Result.Max		= -std::numeric_limits<float>::max();
+
+			double SumOfSquares = 0.0;
+			for (size_t Group = 0; Group < Groups; Group++)
+			{
+				Result.Min		= std::min(Result.Min, Values[Group * 4 + 0]);
+				Result.Max		= std::max(Result.Max, Values[Group * 4 + 1]);
+				Result.Sum		+= Values[Group * 4 + 2];
+				SumOfSquares	+= Values[Group * 4 + 3];
+			}
+
+			if (Result.Count > 0)
+			{
+				Result.Mean		= Result.Sum / Result.Count;
+				Result.StdDev	= std::sqrt(std::max(SumOfSquares / Result.Count - Result.Mean * Result.Mean, 0.0));
+			}
+
+			return Result;
+		}
+
+		// Counts in device memory, the range is Stats' min and max
+		static compute::buffer DeviceHistogram(compute::image2d& Heightmap, compute::buffer& Stats, int32_t Bins)
+		{
+			using compute::dim;
+
+			compute::program program = BuildProgram({ "reduce.cl" });
+			compute::buffer Counts(GetContext(), Bins * sizeof(cl_uint));
+
+			compute::kernel clear(program, "clear_counts");
+			clear.set_arg(0, Counts);
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(clear, dim(0), dim(Bins), dim(1)), "clear_counts");
+
+			compute::kernel kernel(program, "histogram");
+
+			const size_t Count		= Heightmap.width() * Heightmap.height();
+			const size_t GroupSize	= ReductionGroupSize(kernel);
+			const size_t Groups		= std::max<size_t>(std::min((Count + GroupSize - 1) / GroupSize, MaxReductionGroups), 1);
+
+			kernel.set_arg(0, Heightmap);
+			kernel.set_arg(1, Stats);
+			kernel.set_arg(2, (cl_int)Bins);
+			kernel.set_arg(3, Counts);
+			kernel.set_arg(4, compute::local_buffer<cl_uint>(Bins));
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0), dim(Groups * GroupSize), dim(GroupSize)), "histogram");
+
+			return Counts;
+		}
+
+		// The local counts have to fit in local memory with room to spare
+		static int32_t ClampBins(int32_t Bins)
+		{
+			return Clamp(Bins, 1, 4096);
+		}
+
+		std::vector<uint32_t> Histogram(compute::image2d& Heightmap,
+			int32_t Bins, float& OutMin, float& OutMax)
+		{
+			CheckReductionImage(Heightmap);
+			Bins = ClampBins(Bins);
+
+			compute::buffer Stats = DeviceStatistics(Heightmap);
+			compute::buffer Counts = DeviceHistogram(Heightmap, Stats, Bins);
+
+			cl_float Range[4];
+			TraceDownload(GetQueue().enqueue_read_buffer(Stats, 0, sizeof(Range), Range), sizeof(Range));
+			OutMin = Range[0];
+			OutMax = Range[1];
+
+			std::vector<uint32_t> Result(Bins);
+			TraceDownload(GetQueue().enqueue_read_buffer(Counts, 0, Bins * sizeof(cl_uint), Result.data()), Bins * sizeof(cl_uint));
+
+			return Result;
+		}
+
+		void Normalize(compute::image2d& Heightmap,
+			compute::image2d& OutputHeightmap,
+			float Min, float Max)
+		{
+			using compute::dim;
+
+			CheckFilterImages(Heightmap, OutputHeightmap);
+
+			compute::buffer Stats = DeviceStatistics(Heightmap);
+
+			compute::program program = BuildProgram({ "reduce.cl" });
+			compute::kernel kernel(program, "normalize_stats");
+			kernel.set_arg(0, Heightmap);
+			kernel.set_arg(1, OutputHeightmap);
+			kernel.set_arg(2, Stats);
+			kernel.set_arg(3, Min);
+			kernel.set_arg(4, Max);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), Heightmap.size(), dim(1, 1)), "normalize_stats");
+		}
+
+		void Remap(compute::image2d& Heightmap,
+			compute::image2d& OutputHeightmap,
+			float InMin, float InMax, float OutMin, float OutMax, bool bClamp)
+		{
+			using compute::dim;
+
+			CheckFilterImages(Heightmap, OutputHeightmap);
+
+			compute::program program = BuildProgram({ "reduce.cl" });
+			compute::kernel kernel(program, "remap");
+			kernel.set_arg(0, Heightmap);
+			kernel.set_arg(1, OutputHeightmap);
+			kernel.set_arg(2, InMin);
+			kernel.set_arg(3, InMax);
+			kernel.set_arg(4, OutMin);
+			kernel.set_arg(5, OutMax);
+			kernel.set_arg(6, (cl_int)(bClamp ? 1 : 0));
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), Heightmap.size(), dim(1, 1)), "remap");
+		}
+
+		void HistogramEqualize(compute::image2d& Heightmap,
+			compute::image2d& OutputHeightmap,
+			int32_t Bins)
+		{
+			using compute::dim;
+
+			CheckFilterImages(Heightmap, OutputHeightmap);
+			Bins = ClampBins(Bins);
+
+			compute::buffer Stats = DeviceStatistics(Heightmap);
+			compute::buffer Counts = DeviceHistogram(Heightmap, Stats, Bins);
+			compute::buffer Cdf(GetContext(), Bins * sizeof(cl_float));
+
+			compute::program program = BuildProgram({ "reduce.cl" });
+
+			compute::kernel cdf_kernel(program, "histogram_cdf");
+			cdf_kernel.set_arg(0, Counts);
+			cdf_kernel.set_arg(1, (cl_int)Bins);
+			cdf_kernel.set_arg(2, Cdf);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(cdf_kernel, dim(0), dim(1), dim(1)), "histogram_cdf");
+
+			compute::kernel kernel(program, "equalize");
+			kernel.set_arg(0, Heightmap);
+			kernel.set_arg(1, OutputHeightmap);
+			kernel.set_arg(2, Stats);
+			kernel.set_arg(3, Cdf);
+			kernel.set_arg(4, (cl_int)Bins);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0), Heightmap.size(), dim(1, 1)), "equalize");
+		}
+
+		static size_t ArrayLayers(const compute::image_object& Layers)
+		{
+			return Layers.get_image_info<size_t>(CL_IMAGE_ARRAY_SIZE);
+		}
+
+		void PerlinNoiseLayers(compute::image_object& Layers,
+			const vector<BatchNoiseParams>& Params, int32_t depth, const TileRegion& Region)
+		{
+			using compute::dim;
+
+			const size_t LayerCount = ArrayLayers(Layers);
+			if (Params.size() != LayerCount)
+				throw std::runtime_error("Batched noise needs one parameter set per layer");
+
+			vector<cl_int> Seeds;
+			vector<cl_float2> Scales;
+			for (const auto& Param : Params)
+			{
+				Seeds.push_back(Param.Seed);
+				Scales.push_back({ { 1.f / Param.NoiseSize, Param.Amplitude } });
+			}
+
+			compute::buffer SeedBuffer(GetContext(), Seeds.size() * sizeof(cl_int));
+			compute::buffer ScaleBuffer(GetContext(), Scales.size() * sizeof(cl_float2));
+			TraceUpload(GetQueue().enqueue_write_buffer(SeedBuffer, 0, SeedBuffer.size(), Seeds.data()), SeedBuffer.size());
+			TraceUpload(GetQueue().enqueue_write_buffer(ScaleBuffer, 0, ScaleBuffer.size(), Scales.data()), ScaleBuffer.size());
+
+			compute::program program = BuildProgram({ "perlin.cl", "batch.cl" }, OctaveSpecialization(depth));
+
+			compute::kernel kernel(program, "perlin_layers");
+			kernel.set_arg(0, Layers);
+			kernel.set_arg(1, SeedBuffer);
+			kernel.set_arg(2, ScaleBuffer);
+			kernel.set_arg(3, depth);
+			kernel.set_arg(4, Region.OriginX);
+			kernel.set_arg(5, Region.OriginY);
+			kernel.set_arg(6, Region.Step);
+
+			const size_t Width	= Layers.get_image_info<size_t>(CL_IMAGE_WIDTH);
+			const size_t Height	= Layers.get_image_info<size_t>(CL_IMAGE_HEIGHT);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0, 0), dim(Width, Height, LayerCount), dim(1, 1, 1)), "perlin_layers");
+		}
+
+		void ThumbnailStrip(compute::image_object& Layers,
+			compute::image2d& Strip,
+			size_t FirstThumbnail, size_t ThumbnailCount)
+		{
+			using compute::dim;
+
+			const size_t LayerCount		= ArrayLayers(Layers);
+			const size_t ThumbnailWidth	= ThumbnailCount > 0 ? Strip.width() / ThumbnailCount : 0;
+
+			if (ThumbnailWidth == 0 || FirstThumbnail + LayerCount > ThumbnailCount)
+				throw std::runtime_error("The thumbnail strip doesn't have room for every layer");
+
+			compute::program program = BuildProgram({ "perlin.cl", "batch.cl" });
+
+			compute::kernel kernel(program, "thumbnail_strip");
+			kernel.set_arg(0, Layers);
+			kernel.set_arg(1, Strip);
+			kernel.set_arg(2, (cl_int)ThumbnailWidth);
+			kernel.set_arg(3, (cl_int)Strip.height());
+			kernel.set_arg(4, (cl_int)FirstThumbnail);
+
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(kernel, dim(0, 0, 0), dim(ThumbnailWidth, Strip.height(), LayerCount), dim(1, 1, 1)), "thumbnail_strip");
+		}
+
+		void CopyLayer(compute::image_object& Layers, size_t Layer, compute::image2d& Heightmap)
+		{
+			const size_t SourceOrigin[3]	= { 0, 0, Layer };
+			const size_t TargetOrigin[3]	= { 0, 0, 0 };
+			const size_t Region[3]			= { Heightmap.width(), Heightmap.height(), 1 };
+
+			Profiling::TraceEvent(GetQueue().enqueue_copy_image(Layers, Heightmap, SourceOrigin, TargetOrigin, Region), "copy_layer");
+		}
+
+		HeightmapBatch CreateHeightmapBatch(int32_t SizeX, int32_t SizeY, int32_t Count, int32_t ThumbnailSize)
+		{
+			HeightmapBatch Batch;
+
+			for (int32_t i = 0; i < Count; i++)
+			{
+				Batch.Maps.push_back(CreateHeightmap(SizeX, SizeY));
+			}
+
+			ThumbnailSize = std::max(ThumbnailSize, 1);
+			const int32_t ThumbnailHeight = std::max((int32_t)((int64_t)ThumbnailSize * SizeY / std::max(SizeX, 1)), 1);
+			Batch.Thumbnails = CreateHeightmap(ThumbnailSize * std::max(Count, 1), ThumbnailHeight);
+
+			return Batch;
+		}
+
+		void PerlinNoiseBatch(HeightmapBatch& Batch,
+			const vector<BatchNoiseParams>& Params, int32_t depth, const TileRegion& Region)
+		{
+			if (Params.empty())
+				return;
+
+			if (Batch.Maps.size() != Params.size())
+				throw std::runtime_error("Batched noise needs one map per parameter set");
+
+			const size_t MaxLayers = GetMaxHeightmapArrayLayers();
+			if (MaxLayers == 0)
+				throw std::runtime_error("Batched generation needs image array support");
+
+			const size_t SizeX = Batch.Maps[0]->Image.width();
+			const size_t SizeY = Batch.Maps[0]->Image.height();
+
+			// One array per chunk, only as many layers as the device allows
+			for (size_t First = 0; First < Params.size(); First += MaxLayers)
+			{
+				const size_t Count = std::min(MaxLayers, Params.size() - First);
+				const vector<BatchNoiseParams> Chunk(Params.begin() + First, Params.begin() + First + Count);
+
+				compute::image_object Layers = CreateHeightmapArray(SizeX, SizeY, Count);
+				Stats::TrackedAllocation Allocation(Layers.get_memory_size());
+
+				PerlinNoiseLayers(Layers, Chunk, depth, Region);
+				ThumbnailStrip(Layers, Batch.Thumbnails->Image, First, Params.size());
+
+				for (size_t Layer = 0; Layer < Count; Layer++)
+				{
+					CopyLayer(Layers, Layer, Batch.Maps[First + Layer]->Image);
+				}
+			}
+		}
+
+		// All of the kernels that make up one erosion iteration. program has
+		// to be built with the same RowWidth
+		struct ErosionKernels
+		{
+			ErosionKernels(const compute::program& program, int32_t InRowWidth)
+				: rainfall(program, "rainfall")
+				, flux(program, "flux")
+				, k_factor(program, "calculate_k_factor")
+				, water_height(program, "calculate_water_height_change")
+				, velocity(program, "calculate_velocity")
+				, sediment_capacity(program, "calculate_sediment_capacity")
+				, erosion_deposition(program, "calculate_erosion_deposition")
+				, RowWidth(InRowWidth)
+			{
+				if (RowWidth > 0)
+				{
+					unpack_planes			= compute::kernel(program, "unpack_planes");
+					pack_planes				= compute::kernel(program, "pack_planes");
+					rainfall_rows			= compute::kernel(program, "rainfall_rows");
+					flux_rows				= compute::kernel(program, "flux_rows");
+					k_factor_rows			= compute::kernel(program, "k_factor_rows");
+					water_height_rows		= compute::kernel(program, "water_height_rows");
+					velocity_rows			= compute::kernel(program, "velocity_rows");
+					sediment_capacity_rows	= compute::kernel(program, "sediment_capacity_rows");
+					erosion_deposition_rows	= compute::kernel(program, "erosion_deposition_rows");
+				}
+			}
+
+			compute::kernel rainfall;
+			compute::kernel flux;
+			compute::kernel k_factor;
+			compute::kernel water_height;
+			compute::kernel velocity;
+			compute::kernel sediment_capacity;
+			compute::kernel erosion_deposition;
+
+			// The row variants, see erosion_rows.cl
+			int32_t RowWidth;
+			compute::kernel unpack_planes;
+			compute::kernel pack_planes;
+			compute::kernel rainfall_rows;
+			compute::kernel flux_rows;
+			compute::kernel k_factor_rows;
+			compute::kernel water_height_rows;
+			compute::kernel velocity_rows;
+			compute::kernel sediment_capacity_rows;
+			compute::kernel erosion_deposition_rows;
+
+			// The maps as buffers while the row kernels run, kept between calls.
+			// flux and outFlux are 4 planes, velocity 2
+			struct
+			{
+				size_t			Width	= 0;
+				size_t			Height	= 0;
+				compute::buffer	height, water, hardness, sediment, sedimentOut, sedimentCapacity;
+				compute::buffer	flux, outFlux, velocity;
+			} Rows;
+		};
+
+		// Whether Maps can go through the row kernels: single channel float maps
+		// and RGBA float flux and velocity
+		static bool CanErodeRows(const ErosionKernels& KernelSet, const ErosionParams& Maps, const std::shared_ptr<Heightmap>& sedimentOut)
+		{
+			const auto FluxImageFormat = compute::image_format(CL_RGBA, CL_FLOAT);
+
+			if (KernelSet.RowWidth <= 0)
+				return false;
+
+			for (const auto* Map : { &Maps.height, &Maps.water, &Maps.hardness, &Maps.sediment, &Maps.sedimentCapacity, &sedimentOut })
+			{
+				if ((*Map)->Image.format() != ImageFormat)
+					return false;
+			}
+
+			return Maps.flux->Image.format() == FluxImageFormat && Maps.velocity->Image.format() == FluxImageFormat;
+		}
+
+		// RGBA images to and from PlaneCount planes of a buffer
+		static void UnpackPlanes(ErosionKernels& KernelSet, compute::image2d& Image, compute::buffer& Planes, cl_int PlaneCount)
+		{
+			KernelSet.unpack_planes.set_args(Image, Planes, PlaneCount);
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(KernelSet.unpack_planes, compute::dim(0, 0), Image.size(), compute::dim(1, 1)), "unpack_planes", "Erosion");
+		}
+
+		static void PackPlanes(ErosionKernels& KernelSet, compute::buffer& Planes, compute::image2d& Image, cl_int PlaneCount)
+		{
+			KernelSet.pack_planes.set_args(Planes, Image, PlaneCount);
+			Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(KernelSet.pack_planes, compute::dim(0, 0), Image.size(), compute::dim(1, 1)), "pack_planes", "Erosion");
+		}
+
+		// SimulateErosion with the row kernels. The maps are copied in to the
+		// buffers, eroded and copied back, so a call leaves Maps and sedimentOut
+		// as the image kernels would. The velocity and sediment capacity are
+		// recalculated every iteration, they're only copied back
+		static void SimulateErosionRows(ErosionKernels& KernelSet,
+			ErosionParams& Maps,
+			std::shared_ptr<Heightmap>& sedimentOut,
+			int32_t FirstIteration,
+			int32_t Iterations,
+			const ErosionSettings& Settings)
+		{
+			auto& Rows = KernelSet.Rows;
+
+			const size_t Width	= Maps.height->Image.width();
+			const size_t Height	= Maps.height->Image.height();
+			const cl_int W		= (cl_int)Width;
+			const cl_int H		= (cl_int)Height;
+			const auto Size		= RowKernelSize(Width, Height, KernelSet.RowWidth);
+
+			if (Rows.Width != Width || Rows.Height != Height)
+			{
+				const size_t Bytes = Width * Height * sizeof(float);
+
+				for (auto* Buffer : { &Rows.height, &Rows.water, &Rows.hardness, &Rows.sediment, &Rows.sedimentOut, &Rows.sedimentCapacity })
+				{
+					*Buffer = compute::buffer(GetContext(), Bytes);
+				}
+
+				Rows.flux		= compute::buffer(GetContext(), 4 * Bytes);
+				Rows.outFlux	= compute::buffer(GetContext(), 4 * Bytes);
+				Rows.velocity	= compute::buffer(GetContext(), 2 * Bytes);
+				Rows.Width		= Width;
+				Rows.Height		= Height;
+			}
+
+			// Maps with buffer storage are used in place, the others go through the copies in Rows
+			const auto Bind = [](compute::image2d& Image, compute::buffer& Copy, bool bCopyIn)
+			{
+				compute::buffer InPlace;
+				if (GetBufferRows(Image, InPlace))
+					return InPlace;
+
+				if (bCopyIn)
+					CopyImageToRows(Image, Copy);
+
+				return Copy;
+			};
+
+			const auto Unbind = [](compute::buffer& Used, compute::image2d& Image)
+			{
+				compute::buffer InPlace;
+				if (!GetBufferRows(Image, InPlace))
+					CopyRowsToImage(Used, Image);
+			};
+
+			compute::buffer height				= Bind(Maps.height->Image, Rows.height, true);
+			compute::buffer water				= Bind(Maps.water->Image, Rows.water, true);
+			compute::buffer hardness			= Bind(Maps.hardness->Image, Rows.hardness, true);
+			compute::buffer sediment			= Bind(Maps.sediment->Image, Rows.sediment, true);
+			compute::buffer sedimentCapacity	= Bind(Maps.sedimentCapacity->Image, Rows.sedimentCapacity, false);
+			compute::buffer sedimentRows		= Bind(sedimentOut->Image, Rows.sedimentOut, false);
+			UnpackPlanes(KernelSet, Maps.flux->Image, Rows.flux, 4);
+
+			const auto Run = [&](compute::kernel& Kernel, const char* Name)
+			{
+				Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(Kernel, compute::dim(0, 0), Size, compute::dim(1, 1)), Name, "Erosion");
+			};
+
+			for (int32_t i = FirstIteration; i < FirstIteration + Iterations; i++)
+			{
+				KernelSet.rainfall_rows.set_args(water, W, H,
+					(cl_uint)1000u + i, (cl_float)Settings.DeltaTime, (cl_float)Settings.waterMul);
+				Run(KernelSet.rainfall_rows, "rainfall_rows");
+
+				KernelSet.flux_rows.set_args(height, water, Rows.flux, Rows.outFlux, W, H, (cl_float)Settings.DeltaTime);
+				Run(KernelSet.flux_rows, "flux_rows");
+
+				KernelSet.k_factor_rows.set_args(water, Rows.outFlux, W, H, (cl_float)Settings.DeltaTime);
+				Run(KernelSet.k_factor_rows, "k_factor_rows");
+
+				std::swap(Rows.flux, Rows.outFlux);
+
+				KernelSet.water_height_rows.set_args(water, Rows.flux, W, H, (cl_float)Settings.DeltaTime);
+				Run(KernelSet.water_height_rows, "water_height_rows");
+
+				KernelSet.velocity_rows.set_args(Rows.flux, Rows.velocity, W, H);
+				Run(KernelSet.velocity_rows, "velocity_rows");
+
+				KernelSet.sediment_capacity_rows.set_args((cl_float)Settings.sedimentCapacity, (cl_float)Settings.maxErosionDepth,
+					water, Rows.velocity, sedimentCapacity, W, H);
+				Run(KernelSet.sediment_capacity_rows, "sediment_capacity_rows");
+
+				// Same constants as the image path
+				KernelSet.erosion_deposition_rows.set_args(height, hardness, sediment, sedimentRows,
+					sedimentCapacity, water, W, H,
+					(cl_float)1.f, (cl_float)1.0f, (cl_float)Settings.softeningCoefficient, (cl_float)0.1f, (cl_float)Settings.DeltaTime);
+				Run(KernelSet.erosion_deposition_rows, "erosion_deposition_rows");
+			}
+
+			Unbind(height, Maps.height->Image);
+			Unbind(water, Maps.water->Image);
+			Unbind(sedimentCapacity, Maps.sedimentCapacity->Image);
+			Unbind(sedimentRows, sedimentOut->Image);
+			PackPlanes(KernelSet, Rows.flux, Maps.flux->Image, 4);
+			PackPlanes(KernelSet, Rows.velocity, Maps.velocity->Image, 2);
+
+			GetQueue().finish();
+		}
+
+		// Runs Iterations erosion iterations over Maps. The flux is ping-ponged
+		// between Maps.flux and outFluxImage, Maps.flux always holds the latest.
+		// FirstIteration offsets the rainfall seed so that a run split up in to
+		// several calls matches one long call
+		static void SimulateErosion(ErosionKernels& KernelSet,
+			ErosionParams& Maps,
+			std::shared_ptr<Heightmap>& outFluxImage,
+			std::shared_ptr<Heightmap>& sedimentOut,
+			int32_t FirstIteration,
+			int32_t Iterations,
+			const ErosionSettings& Settings)
+		{
+			using compute::dim;
+
+			if (CanErodeRows(KernelSet, Maps, sedimentOut))
+			{
+				SimulateErosionRows(KernelSet, Maps, sedimentOut, FirstIteration, Iterations, Settings);
+				return;
+			}
+
+			auto& Heightmap = Maps.height->Image;
+
+			for (int32_t i = FirstIteration; i < FirstIteration + Iterations; i++)
+			{
+				KernelSet.rainfall.set_args(
+					Maps.water->Image,		// Water Height in
+					Maps.water->Image,		// Water Height out
+					(cl_uint)1000u + i,		// Seed
+					(cl_float)Settings.DeltaTime,	// DeltaTime
+					(cl_float)Settings.waterMul		// WaterMul
+				);
+
+				Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(KernelSet.rainfall, dim(0, 0), Heightmap.size(), dim(1, 1)), "rainfall", "Erosion");
+				GetQueue().finish();
+
+				// Calculate flux and ping-pong flux images
+				{
+					// Calculates the flux
+					KernelSet.flux.set_args(
+						Heightmap,				// Terrain Height in
+						Maps.water->Image,		// Water Height in
+						Maps.flux->Image,		// Flux in
+						outFluxImage->Image,	// Flux out
+						(cl_float)Settings.DeltaTime		// DeltaTime
+					);
+
+					Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(KernelSet.flux, dim(0, 0), Heightmap.size(), dim(1, 1)), "flux", "Erosion");
+					GetQueue().finish();
+
+					// Calculates the scaling factor for the flux and scales the flux
+					KernelSet.k_factor.set_args(
+						Maps.water->Image,		// Water Height in
+						outFluxImage->Image,	// Flux in
+						outFluxImage->Image,	// Flux out
+						(cl_float)Settings.DeltaTime		// DeltaTime
+					);
+
+					Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(KernelSet.k_factor, dim(0, 0), Heightmap.size(), dim(1, 1)), "calculate_k_factor", "Erosion");
+					GetQueue().finish();
+
+					// Make sure to ping-pong after k factor
+					std::swap(Maps.flux, outFluxImage);
+				}
+
+				// This doesn't have to be ping pongd
+				KernelSet.water_height.set_args(
+					Maps.water->Image,		// Water Height in
+					Maps.water->Image,		// Water Height out
+					Maps.flux->Image,		// Flux in
+					(cl_float)Settings.DeltaTime		// DeltaTime
+				);
+
+				Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(KernelSet.water_height, dim(0, 0), Heightmap.size(), dim(1, 1)), "calculate_water_height_change", "Erosion");
+				GetQueue().finish();
+
+				KernelSet.velocity.set_args(
+					Maps.flux->Image,		// Flux in
+					Maps.velocity->Image,	// Velocity out
+					(cl_float)Settings.DeltaTime		// DeltaTime
+				);
+
+				Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(KernelSet.velocity, dim(0, 0), Heightmap.size(), dim(1, 1)), "calculate_velocity", "Erosion");
+				GetQueue().finish();
+
+				KernelSet.sediment_capacity.set_args(
+					(cl_float)Settings.sedimentCapacity,			// Sediment capacity
+					(cl_float)Settings.maxErosionDepth,		// maxErosionDepth
+					Heightmap,				// Terrain Height in
+					Maps.water->Image,		// Water height in
+					Maps.velocity->Image,	// Velocity in
+					Maps.sedimentCapacity->Image		// Sediment Capacity Out
+				);
+
+				Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(KernelSet.sediment_capacity, dim(0, 0), Heightmap.size(), dim(1, 1)), "calculate_sediment_capacity", "Erosion");
+				GetQueue().finish();
+
+				KernelSet.erosion_deposition.set_args(
+					Heightmap,				// Terrain Height in
+					Heightmap,				// Terrain Height out
+					Maps.hardness->Image,		// Terrain Hardness in
+					Maps.sediment->Image,		// Sediment in
+					sedimentOut->Image,		// Sediment out
+					Maps.sedimentCapacity->Image,		// Sediment capacity in
+					Maps.water->Image,		// Water height in
+					Maps.water->Image,		// Water height out
+
+					(cl_float) 1.f,			// deposition speed
+					(cl_float) 1.0f,		// sedimentCoefficient
+					(cl_float)Settings.softeningCoefficient,		// softeningCoefficient
+					(cl_float) 0.1f,		// hardnessMin
+					(cl_float)Settings.DeltaTime
+				);
+
+				Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(KernelSet.erosion_deposition, dim(0, 0), Heightmap.size(), dim(1, 1)), "calculate_erosion_deposition", "Erosion");
+				GetQueue().finish();
+
+				/*move_sediment_kernel.set_args(
+					sedimentOut->Image,		// Sediment in
+					Maps.sediment->Image,		// Sediment out
+					Maps.velocity->Image,	// Velocity in
+
+					(cl_float)Settings.DeltaTime
+				);
+
+				Profiling::TraceEvent(GetQueue().enqueue_nd_range_kernel(move_sediment_kernel, dim(0, 0), Heightmap.size(), dim(1, 1)), "move_sediment");
+				GetQueue().finish();*/
+			}
+
+		}
+
+		// Iterations between progress updates and cancellation checks
+		static const int32_t ErosionBatchIterations = 16;
+
+		void ClearErosionState(ErosionParams& Maps)
+		{
+			for (auto Map : { &ErosionParams::water, &ErosionParams::hardness, &ErosionParams::sediment,
+				&ErosionParams::sedimentCapacity, &ErosionParams::flux, &ErosionParams::velocity })
+			{
+				if (Maps.*Map)
+					Fill((Maps.*Map)->Image, 0.f);
+			}
+		}
+
+		// How far (in pixels) one erosion iteration can move information.
+		// flux reads the neighbouring height and water, then the water height
+		// change and velocity read the neighbouring flux
+		static const int32_t ErosionHaloPerIteration = 3;
+
+		// Erosion split over the MultiDevice lanes. Each lane keeps its band and
+		// a halo wide enough for one batch resident for the whole run. Between
+		// batches only the rows the neighbouring bands read as their halo go
+		// through the host, uploaded by all lanes before any lane simulates and
+		// writes its own edge rows back
+		static void BandedErosion(ErosionParams& Maps, int32_t iterations, const ErosionSettings& Settings, Job* InJob)
+		{
+			using compute::dim;
+
+			Profiling::ScopedSpan Span("Banded Erosion", "MultiDevice");
+
+			const int32_t Width		= (int32_t)Maps.height->Image.width();
+			const int32_t Height	= (int32_t)Maps.height->Image.height();
+			const int32_t Halo		= ErosionBatchIterations * ErosionHaloPerIteration;
+
+			const auto Lanes = MultiDevice::GetLanes();
+			const auto Bands = MultiDevice::SplitRows(Height, std::max(MultiDevice::MinBandRows, 2 * Halo));
+
+			// In ErosionParams order. Hardness never changes, the velocity and
+			// sediment capacity are recalculated from the others every iteration,
+			// so only height, water, sediment and flux are exchanged
+			const std::vector<std::shared_ptr<Heightmap> ErosionParams::*> AllMaps = {
+				&ErosionParams::height, &ErosionParams::water, &ErosionParams::hardness, &ErosionParams::sediment,
+				&ErosionParams::sedimentCapacity, &ErosionParams::flux, &ErosionParams::velocity };
+			const std::vector<size_t> ExchangedMaps = { 0, 1, 3, 5 };
+
+			// The whole terrain on the host, the lanes read and write disjoint rows of it
+			std::vector<std::vector<float>> Host(AllMaps.size());
+			for (size_t Map = 0; Map < AllMaps.size(); Map++)
+			{
+				auto& Image = (Maps.*AllMaps[Map])->Image;
+				auto& Data = Host[Map];
+				Data.resize(Image.get_memory_size() / sizeof(float));
+				TraceDownload(GetQueue().enqueue_read_image(Image, Image.origin(), Image.size(), Data.data()), Image.get_memory_size());
+			}
+
+			struct LaneState
+			{
+				MultiDevice::Band				Band;
+				int32_t							Y0, Y1;
+				ErosionParams					Maps;
+				std::shared_ptr<Heightmap>		outFlux;
+				std::shared_ptr<Heightmap>		sedimentOut;
+				std::unique_ptr<ErosionKernels>	KernelSet;
+			};
+
+			std::vector<LaneState> States(Bands.size());
+
+			// Rows From to From + Count of the terrain, between the host and a lane's band image
+			const auto TransferRows = [&](LaneState& State, size_t Map, int32_t From, int32_t Count, bool bUpload)
+			{
+				if (Count <= 0)
+					return;
+
+				auto& Image = (State.Maps.*AllMaps[Map])->Image;
+				const size_t Channels = Host[Map].size() / ((size_t)Width * Height);
+				float* Rows = Host[Map].data() + (size_t)From * Width * Channels;
+				const size_t Bytes = (size_t)Width * Count * Channels * sizeof(float);
+
+				if (bUpload)
+					TraceUpload(GetQueue().enqueue_write_image(Image, dim(0, From - State.Y0), dim(Width, Count), Rows), Bytes);
+				else
+					TraceDownload(GetQueue().enqueue_read_image(Image, dim(0, From - State.Y0), dim(Width, Count), Rows), Bytes);
+			};
+
+			// Runs Func for every band at once, each on its lane's queue
+			const auto ForEachLane = [&](const std::function<void(LaneState&)>& Func)
+			{
+				std::vector<std::future<void>> Futures;
+				for (auto& State : States)
+				{
+					Futures.push_back(std::async(std::launch::async, [&]()
+					{
+						ScopedQueue Bind(Lanes[State.Band.Lane]->Queue);
+						Func(State);
+						GetQueue().finish();
+					}));
+				}
+
+				for (auto& Future : Futures)
+				{
+					Future.get();
+				}
+			};
+
+			for (size_t i = 0; i < Bands.size(); i++)
+			{
+				States[i].Band	= Bands[i];
+				States[i].Y0	= std::max(Bands[i].Start - Halo, 0);
+				States[i].Y1	= std::min(Bands[i].Start + Bands[i].Rows + Halo, Height);
+			}
+
+			ForEachLane([&](LaneState& State)
+			{
+				const int32_t Rows = State.Y1 - State.Y0;
+
+				for (size_t Map = 0; Map < AllMaps.size(); Map++)
+				{
+					State.Maps.*AllMaps[Map] = CreateHeightmap(Width, Rows, (Maps.*AllMaps[Map])->Image.format());
+					TransferRows(State, Map, State.Y0, Rows, true);
+				}
+
+				State.outFlux		= CreateHeightmap(Width, Rows, Maps.flux->Image.format());
+				State.sedimentOut	= CreateHeightmap(Width, Rows, Maps.sediment->Image.format());
+				const int32_t RowWidth = RowKernelWidth();
+				State.KernelSet		= std::unique_ptr<ErosionKernels>(new ErosionKernels(
+					BuildErosionProgram(RowWidth), RowWidth));
+			});
+
+			for (int32_t First = 0; First < iterations; First += ErosionBatchIterations)
+			{
+				if (InJob)
+					InJob->CheckCancelled();
+
+				const int32_t BatchIterations = std::min(ErosionBatchIterations, iterations - First);
+
+				// The halos, written by the neighbouring bands last batch. Every
+				// band reads them before any band writes its edges for this batch,
+				// the host rows are shared and the join is the only barrier
+				if (First > 0)
+				{
+					ForEachLane([&](LaneState& State)
+					{
+						const int32_t Start	= State.Band.Start;
+						const int32_t End	= Start + State.Band.Rows;
+
+						for (size_t Map : ExchangedMaps)
+						{
+							TransferRows(State, Map, State.Y0, Start - State.Y0, true);
+							TransferRows(State, Map, End, State.Y1 - End, true);
+						}
+					});
+				}
+
+				ForEachLane([&](LaneState& State)
+				{
+					const auto StartTime = std::chrono::steady_clock::now();
+					const int32_t Start	= State.Band.Start;
+					const int32_t End	= Start + State.Band.Rows;
+
+					SimulateErosion(*State.KernelSet, State.Maps, State.outFlux, State.sedimentOut,
+						First, BatchIterations, Settings);
+
+					// The edge rows the neighbouring bands need as their halos
+					const int32_t EdgeRows = std::min(Halo, State.Band.Rows);
+					for (size_t Map : ExchangedMaps)
+					{
+						TransferRows(State, Map, Start, EdgeRows, false);
+						TransferRows(State, Map, End - EdgeRows, EdgeRows, false);
+					}
+
+					GetQueue().finish();
+					MultiDevice::ReportThroughput(State.Band.Lane, (double)Width * (State.Y1 - State.Y0) * BatchIterations,
+						std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count());
+				});
+
+				if (InJob)
+					InJob->SetProgress((float)(First + ErosionBatchIterations) / iterations);
+			}
+
+			ForEachLane([&](LaneState& State)
+			{
+				for (size_t Map = 0; Map < AllMaps.size(); Map++)
+				{
+					TransferRows(State, Map, State.Band.Start, State.Band.Rows, false);
+				}
+			});
+
+			for (size_t Map = 0; Map < AllMaps.size(); Map++)
+			{
+				auto& Image = (Maps.*AllMaps[Map])->Image;
+				TraceUpload(GetQueue().enqueue_write_image(Image, Image.origin(), Image.size(), Host[Map].data()), Image.get_memory_size());
+			}
+		}
+
+		ErosionParams Erosion(ErosionParams inputMaps,
+			int32_t iterations,
+			float DeltaTime,
+			float waterMul,
+			float softeningCoefficient,
+			float maxErosionDepth,
+			float sedimentCapacity,
+			Job* InJob
+			)
+		{
+			using compute::dim;
+
+			const auto FluxImageFormat = compute::image_format(CL_RGBA, CL_FLOAT);
+			const auto WaterImageFormat = compute::image_format(CL_R, CL_FLOAT);
+
+			auto& Heightmap		= inputMaps.height->Image;
+			auto hardness		= inputMaps.hardness;
+			auto sediment2		= CreateHeightmap(Heightmap.width(), Heightmap.height(), WaterImageFormat);
+			auto outFluxImage	= CreateHeightmap(Heightmap.width(), Heightmap.height(), FluxImageFormat);
+
+			Fill(hardness->Image, 0.f);
+
+			ErosionSettings Settings;
+			Settings.DeltaTime				= DeltaTime;
+			Settings.waterMul				= waterMul;
+			Settings.softeningCoefficient	= softeningCoefficient;
+			Settings.maxErosionDepth		= maxErosionDepth;
+			Settings.sedimentCapacity		= sedimentCapacity;
+
+			if (Heightmap.format() == ImageFormat && MultiDevice::ShouldSplit((int32_t)Heightmap.height()))
+			{
+				BandedErosion(inputMaps, iterations, Settings, InJob);
+				return inputMaps;
+			}
+
+			const int32_t RowWidth = RowKernelWidth();
+			ErosionKernels KernelSet(BuildErosionProgram(RowWidth), RowWidth);
+
+			ErosionParams Maps = inputMaps;
+
+			// Run in batches so the job can report progress and be cancelled
+			for (int32_t First = 0; First < iterations; First += ErosionBatchIterations)
+			{
+				if (InJob)
+					InJob->CheckCancelled();
+
+				SimulateErosion(KernelSet, Maps, outFluxImage, sediment2,
+					First, std::min(ErosionBatchIterations, iterations - First), Settings);
+
+				if (InJob)
+					InJob->SetProgress((float)(First + ErosionBatchIterations) / iterations);
+			}
+
+			return Maps;
+		}
+
+		vector<ErosionSettings> ErosionSweepGrid(const ErosionSettings& Base,
+			const vector<float>& waterMuls,
+			const vector<float>& softeningCoefficients,
+			const vector<float>& maxErosionDepths,
+			const vector<float>& sedimentCapacities)
+		{
+			const auto OrBase = [](const vector<float>& Values, float Value)
+			{
+				return Values.empty() ? vector<float>{ Value } : Values;
+			};
+
+			vector<ErosionSettings> Grid;
+			for (float waterMul : OrBase(waterMuls, Base.waterMul))
+			{
+				for (float softeningCoefficient : OrBase(softeningCoefficients, Base.softeningCoefficient))
+				{
+					for (float maxErosionDepth : OrBase(maxErosionDepths, Base.maxErosionDepth))
+					{
+						for (float sedimentCapacity : OrBase(sedimentCapacities, Base.sedimentCapacity))
+						{
+							ErosionSettings Settings	= Base;
+							Settings.waterMul				= waterMul;
+							Settings.softeningCoefficient	= softeningCoefficient;
+							Settings.maxErosionDepth		= maxErosionDepth;
+							Settings.sedimentCapacity		= sedimentCapacity;
+							Grid.push_back(Settings);
+						}
+					}
+				}
+			}
+
+			return Grid;
+		}
+
+		// Runs in flight per lane during a sweep. SimulateErosion waits for
+		// every kernel, a second queue keeps the device busy in the gaps
+		static const size_t ErosionSweepQueuesPerLane = 2;
+
+		vector<ErosionSweepRun> ErosionSweep(const ErosionParams& inputMaps,
+			int32_t iterations,
+			const vector<ErosionSettings>& Runs,
+			const vector<shared_ptr<Heightmap>>& OutputHeights,
+			Job* InJob)
+		{
+			using compute::dim;
+
+			Profiling::ScopedSpan Span("Erosion Sweep", "Erosion");
+
+			vector<ErosionSweepRun> Results(Runs.size());
+			if (Runs.empty())
+				return Results;
+
+			const bool bOutputHeights = OutputHeights.size() == Runs.size();
+
+			const size_t Width	= inputMaps.height->Image.width();
+			const size_t Height	= inputMaps.height->Image.height();
+
+			// Hardness is only ever read, so it isn't in here
+			const vector<shared_ptr<Heightmap> ErosionParams::*> RunMaps = {
+				&ErosionParams::height, &ErosionParams::water, &ErosionParams::sediment,
+				&ErosionParams::sedimentCapacity, &ErosionParams::flux, &ErosionParams::velocity };
+
+			struct SweepLane
+			{
+				std::string				Name;
+				compute::command_queue	Queue;
+				bool					bPrimary;
+
+				// The inputs in the lane's context, and its erosion program
+				ErosionParams			Inputs;
+				compute::program		Program;
+				int32_t					RowWidth;
+			};
+
+			vector<SweepLane> Lanes;
+			if (MultiDevice::IsEnabled() && !ScopedQueue::IsBound())
+			{
+				for (auto& Lane : MultiDevice::GetLanes())
+				{
+					Lanes.push_back({ Lane->Name, Lane->Queue, Lane->bPrimary, ErosionParams(), compute::program(), 0 });
+				}
+			}
+			else
+			{
+				Lanes.push_back({ GetDevice().name(), GetQueue(), true, ErosionParams(), compute::program(), 0 });
+			}
+
+			// Only lanes with their own context need the inputs through the host
+			vector<vector<float>> Host(RunMaps.size());
+			if (std::any_of(Lanes.begin(), Lanes.end(), [](const SweepLane& Lane) { return !Lane.bPrimary; }))
+			{
+				for (size_t Map = 0; Map < RunMaps.size(); Map++)
+				{
+					auto& Image = (inputMaps.*RunMaps[Map])->Image;
+					Host[Map].resize(Image.get_memory_size() / sizeof(float));
+					TraceDownload(GetQueue().enqueue_read_image(Image, Image.origin(), Image.size(), Host[Map].data()), Image.get_memory_size());
+				}
+			}
+
+			const auto HardnessFormat = inputMaps.hardness->Image.format();
+
+			// The settings are kernel arguments, so every run shares one build per context
+			for (auto& Lane : Lanes)
+			{
+				ScopedQueue Bind(Lane.Queue);
+
+				if (Lane.bPrimary)
+				{
+					Lane.Inputs = inputMaps;
+				}
+				else
+				{
+					for (size_t Map = 0; Map < RunMaps.size(); Map++)
+					{
+						auto& Source = (inputMaps.*RunMaps[Map])->Image;
+						auto& Target = Lane.Inputs.*RunMaps[Map];
+						Target = CreateHeightmap((int)Width, (int)Height, Source.format());
+						TraceUpload(GetQueue().enqueue_write_image(Target->Image, Target->Image.origin(), Target->Image.size(), Host[Map].data()), Source.get_memory_size());
+					}
+				}
+
+				Lane.Inputs.hardness = CreateHeightmap((int)Width, (int)Height, HardnessFormat);
+				Fill(Lane.Inputs.hardness->Image, 0.f);
+
+				Lane.RowWidth = RowKernelWidth();
+				Lane.Program = BuildErosionProgram(Lane.RowWidth);
+				GetQueue().finish();
+			}
+
+			// Runs are taken in order by whichever queue is free, so faster lanes do more of them.
+			// Runs on other contexts are read back and uploaded to the caller's context afterwards
+			std::atomic<size_t> NextRun(0);
+			std::atomic<size_t> FinishedRuns(0);
+			std::mutex ProgressMutex;
+			vector<vector<vector<float>>> Downloads(Runs.size());
+
+			const auto Worker = [&](SweepLane& Lane, compute::command_queue Queue)
+			{
+				ScopedQueue Bind(Queue);
+				ErosionKernels KernelSet(Lane.Program, Lane.RowWidth);
+
+				for (size_t Run = NextRun++; Run < Runs.size(); Run = NextRun++)
+				{
+					if (InJob)
+						InJob->CheckCancelled();
+
+					const auto StartTime = std::chrono::steady_clock::now();
+
+					ErosionParams Maps;
+					for (auto Map : RunMaps)
+					{
+						auto& Source = (Lane.Inputs.*Map)->Image;
+						Maps.*Map = (Lane.bPrimary && bOutputHeights && Map == &ErosionParams::height)
+							? OutputHeights[Run]
+							: CreateHeightmap((int)Width, (int)Height, Source.format());
+
+						Profiling::TraceEvent(GetQueue().enqueue_copy_image(Source, (Maps.*Map)->Image, Source.origin(), Source.origin(), Source.size()), "copy_sweep_input", "Erosion");
+					}
+					Maps.hardness = Lane.Inputs.hardness;
+
+					auto outFlux	= CreateHeightmap((int)Width, (int)Height, Maps.flux->Image.format());
+					auto sediment2	= CreateHeightmap((int)Width, (int)Height, Maps.sediment->Image.format());
+
+					for (int32_t First = 0; First < iterations; First += ErosionBatchIterations)
+					{
+						if (InJob)
+							InJob->CheckCancelled();
+
+						SimulateErosion(KernelSet, Maps, outFlux, sediment2,
+							First, std::min(ErosionBatchIterations, iterations - First), Runs[Run]);
+					}
+
+					if (!Lane.bPrimary)
+					{
+						auto& Download = Downloads[Run];
+						Download.resize(RunMaps.size());
+						for (size_t Map = 0; Map < RunMaps.size(); Map++)
+						{
+							auto& Image = (Maps.*RunMaps[Map])->Image;
+							Download[Map].resize(Image.get_memory_size() / sizeof(float));
+							TraceDownload(GetQueue().enqueue_read_image(Image, Image.origin(), Image.size(), Download[Map].data()), Image.get_memory_size());
+						}
+					}
+					else
+					{
+						Results[Run].Maps = Maps;
+					}
+
+					GetQueue().finish();
+
+					Results[Run].Settings	= Runs[Run];
+					Results[Run].Lane		= Lane.Name;
+					Results[Run].Seconds	= std::chrono::duration<double>(std::chrono::steady_clock::now() - StartTime).count();
+
+					if (InJob)
+					{
+						std::lock_guard<std::mutex> Lock(ProgressMutex);
+						InJob->SetProgress((float)++FinishedRuns / Runs.size());
+					}
+				}
+			};
+
+			vector<std::future<void>> Futures;
+			for (auto& Lane : Lanes)
+			{
+				for (size_t i = 0; i < ErosionSweepQueuesPerLane; i++)
+				{
+					// The lane's own queue first, then more on the same device
+					compute::command_queue Queue = i == 0 ? Lane.Queue
+						: compute::command_queue(Lane.Queue.get_context(), Lane.Queue.get_device(), compute::command_queue::enable_profiling);
+
+					Futures.push_back(std::async(std::launch::async, Worker, std::ref(Lane), Queue));
+				}
+			}
+
+			// Every worker has to stop before anything is thrown, they use the locals
+			std::exception_ptr Error;
+			for (auto& Future : Futures)
+			{
+				try
+				{
+					Future.get();
+				}
+				catch (...)
+				{
+					if (!Error)
+						Error = std::current_exception();
+				}
+			}
+
+			if (Error)
+				std::rethrow_exception(Error);
+
+			// The hardness the caller gets back, in its own context
+			shared_ptr<Heightmap> SharedHardness;
+			for (auto& Lane : Lanes)
+			{
+				if (Lane.bPrimary)
+					SharedHardness = Lane.Inputs.hardness;
+			}
+
+			if (!SharedHardness)
+			{
+				SharedHardness = CreateHeightmap((int)Width, (int)Height, HardnessFormat);
+				Fill(SharedHardness->Image, 0.f);
+			}
+
+			for (size_t Run = 0; Run < Runs.size(); Run++)
+			{
+				if (!Downloads[Run].empty())
+				{
+					for (size_t Map = 0; Map < RunMaps.size(); Map++)
+					{
+						auto& Source = (inputMaps.*RunMaps[Map])->Image;
+						auto& Target = Results[Run].Maps.*RunMaps[Map];
+						Target = (bOutputHeights && RunMaps[Map] == &ErosionParams::height)
+							? OutputHeights[Run]
+							: CreateHeightmap((int)Width, (int)Height, Source.format());
+
+						TraceUpload(GetQueue().enqueue_write_image(Target->Image, Target->Image.origin(), Target->Image.size(),
+							Downloads[Run][Map].data()), Target->Image.get_memory_size());
+					}
+				}
+
+				Results[Run].Maps.hardness = SharedHardness;
+			}
+
+			return Results;
+		}
+
+		// How much host memory each tile store is allowed before it starts
+		// paging tiles out to its scratch file
+		static const size_t TiledErosionResidentBytes = 256 * 1024 * 1024;
+
+		// The device images for one tile. Tiles on the edge of the terrain are
+		// clipped, so there's one of these per distinct tile size
+		struct ErosionTileImages
+		{
+			ErosionParams				Maps;
+			std::shared_ptr<Heightmap>	outFlux;
+			std::shared_ptr<Heightmap>	sedimentOut;
+		};
+
+		void TiledErosion(TiledHeightmap& HeightmapTiles,
+			int32_t iterations,
+			int32_t IterationsPerPass,
+			int32_t TileSize,
+			const ErosionSettings& Settings,
+			const std::string& ScratchDirectory,
+			Job* InJob)
+		{
+			using compute::dim;
+
+			EnsureStateIsSetup();
+
+			const auto FluxImageFormat = compute::image_format(CL_RGBA, CL_FLOAT);
+			const auto WaterImageFormat = compute::image_format(CL_R, CL_FLOAT);
+
+			const int32_t SizeX = HeightmapTiles.GetSizeX();
+			const int32_t SizeY = HeightmapTiles.GetSizeY();
+
+			if (iterations <= 0)
+				return;
+
+			IterationsPerPass	= Clamp(IterationsPerPass, 1, iterations);
+			const int32_t Halo	= IterationsPerPass * ErosionHaloPerIteration;
+
+			// The tile and its halo have to fit in to one device image, and the
+			// largest image (flux, 4 floats per pixel) has to fit in to one allocation
+			const compute::device Device = GetQueue().get_device();
+			const size_t MaxImageSize = std::min(
+				Device.get_info<size_t>(CL_DEVICE_IMAGE2D_MAX_WIDTH),
+				Device.get_info<size_t>(CL_DEVICE_IMAGE2D_MAX_HEIGHT));
+			const size_t MaxAllocSize = (size_t)std::sqrt(
+				(double)Device.get_info<cl_ulong>(CL_DEVICE_MAX_MEM_ALLOC_SIZE) / (4 * sizeof(float)));
+
+			TileSize = std::min(TileSize, (int32_t)std::min(MaxImageSize, MaxAllocSize) - 2 * Halo);
+
+			if (TileSize <= 0)
+				throw std::runtime_error("IterationsPerPass is too large for the device's maximum image size");
+
+			// A region with its halo touches at most 3x3 tiles as long as the halo
+			// is smaller than a tile, so always keep at least that many resident
+			std::string ScratchPath = ScratchDirectory;
+			if (!ScratchPath.empty() && ScratchPath.back() != '/' && ScratchPath.back() != '\\')
+				ScratchPath += '/';
+
+			const auto MakeStore = [&](const std::string& Name, int32_t Channels)
+			{
+				const size_t TileBytes = (size_t)TileSize * TileSize * Channels * sizeof(float);
+				const int32_t ResidentTiles = (int32_t)std::max<size_t>(9, TiledErosionResidentBytes / TileBytes);
+
+				return std::unique_ptr<TiledHeightmap>(new TiledHeightmap(
+					SizeX, SizeY, TileSize, Channels, ScratchPath + Name, ResidentTiles));
+			};
+
+			// Every pass reads from the In stores and writes to the Out stores, so
+			// tiles don't see their neighbours' results until the next pass
+			std::unique_ptr<TiledHeightmap> HeightScratch	= MakeStore("erosion_height.tiles", 1);
+			std::unique_ptr<TiledHeightmap> WaterIn			= MakeStore("erosion_water0.tiles", 1);
+			std::unique_ptr<TiledHeightmap> WaterOut		= MakeStore("erosion_water1.tiles", 1);
+			std::unique_ptr<TiledHeightmap> SedimentIn		= MakeStore("erosion_sediment0.tiles", 1);
+			std::unique_ptr<TiledHeightmap> SedimentOut		= MakeStore("erosion_sediment1.tiles", 1);
+			std::unique_ptr<TiledHeightmap> FluxIn			= MakeStore("erosion_flux0.tiles", 4);
+			std::unique_ptr<TiledHeightmap> FluxOut			= MakeStore("erosion_flux1.tiles", 4);
+
+			TiledHeightmap* HeightIn	= &HeightmapTiles;
+			TiledHeightmap* HeightOut	= HeightScratch.get();
+
+			const int32_t RowWidth = RowKernelWidth();
+			ErosionKernels KernelSet(BuildErosionProgram(RowWidth), RowWidth);
+
+			std::map<std::pair<int32_t, int32_t>, ErosionTileImages> TileImages;
+			std::vector<float> Staging;
+
+			const auto GetTileImages = [&](int32_t W, int32_t H) -> ErosionTileImages&
+			{
+				auto Found = TileImages.find(std::make_pair(W, H));
+				if (Found != TileImages.end())
+					return Found->second;
+
+				ErosionTileImages& Images = TileImages[std::make_pair(W, H)];
+				Images.Maps.height				= CreateHeightmap(W, H, WaterImageFormat);
+				Images.Maps.water				= CreateHeightmap(W, H, WaterImageFormat);
+				Images.Maps.hardness			= CreateHeightmap(W, H, WaterImageFormat);
+				Images.Maps.sediment			= CreateHeightmap(W, H, WaterImageFormat);
+				Images.Maps.sedimentCapacity	= CreateHeightmap(W, H, WaterImageFormat);
+				Images.Maps.flux				= CreateHeightmap(W, H, FluxImageFormat);
+				Images.Maps.velocity			= CreateHeightmap(W, H, FluxImageFormat);
+				Images.outFlux					= CreateHeightmap(W, H, FluxImageFormat);
+				Images.sedimentOut				= CreateHeightmap(W, H, WaterImageFormat);
+
+				// The hardness is never written by the kernels, so it only has to be
+				// cleared once per image
+				Fill(Images.Maps.hardness->Image, 0.f);
+
+				return Images;
+			};
+
+			// Copies the whole image's region (tile + halo) from the store to the device
+			const auto Upload = [&](TiledHeightmap& Store, const std::shared_ptr<Heightmap>& Map, int32_t X, int32_t Y)
+			{
+				auto& Image = Map->Image;
+				Staging.resize(Image.width() * Image.height() * Store.GetChannels());
+				Store.ReadRegion(X, Y, (int32_t)Image.width(), (int32_t)Image.height(), Staging.data());
+				TraceUpload(GetQueue().enqueue_write_image(Image, Image.origin(), Image.size(), Staging.data()), Staging.size() * sizeof(float));
+			};
+
+			// Copies only the tile's interior back from the device to the store
+			const auto Download = [&](TiledHeightmap& Store, const std::shared_ptr<Heightmap>& Map,
+				int32_t X, int32_t Y, int32_t OffsetX, int32_t OffsetY, int32_t W, int32_t H)
+			{
+				Staging.resize((size_t)W * H * Store.GetChannels());
+				TraceDownload(GetQueue().enqueue_read_image(Map->Image, dim(OffsetX, OffsetY), dim(W, H), Staging.data()), Staging.size() * sizeof(float));
+				Store.WriteRegion(X, Y, W, H, Staging.data());
+			};
+
+			const int32_t Passes = (iterations + IterationsPerPass - 1) / IterationsPerPass;
+			const int32_t TilesX = (SizeX + TileSize - 1) / TileSize;
+			const int32_t TilesY = (SizeY + TileSize - 1) / TileSize;
+
+			for (int32_t Pass = 0; Pass < Passes; Pass++)
+			{
+				const int32_t FirstIteration	= Pass * IterationsPerPass;
+				const int32_t PassIterations	= std::min(IterationsPerPass, iterations - FirstIteration);
+
+				for (int32_t TileY = 0; TileY < TilesY; TileY++)
+				{
+					for (int32_t TileX = 0; TileX < TilesX; TileX++)
+					{
+						if (InJob)
+							InJob->CheckCancelled();
+
+						const int32_t TileX0	= TileX * TileSize;
+						const int32_t TileY0	= TileY * TileSize;
+						const int32_t TileW	= std::min(TileSize, SizeX - TileX0);
+						const int32_t TileH	= std::min(TileSize, SizeY - TileY0);
+
+						// The tile plus its halo, clipped to the terrain so the edges
+						// behave the same as the clamped sampler in a single image
+						const int32_t X0 = std::max(TileX0 - Halo, 0);
+						const int32_t Y0 = std::max(TileY0 - Halo, 0);
+						const int32_t X1 = std::min(TileX0 + TileW + Halo, SizeX);
+						const int32_t Y1 = std::min(TileY0 + TileH + Halo, SizeY);
+
+						ErosionTileImages& Images = GetTileImages(X1 - X0, Y1 - Y0);
+
+						Upload(*HeightIn,	Images.Maps.height,		X0, Y0);
+						Upload(*WaterIn,	Images.Maps.water,		X0, Y0);
+						Upload(*SedimentIn,	Images.Maps.sediment,	X0, Y0);
+						Upload(*FluxIn,		Images.Maps.flux,		X0, Y0);
+
+						SimulateErosion(KernelSet, Images.Maps, Images.outFlux, Images.sedimentOut,
+							FirstIteration, PassIterations, Settings);
+
+						const int32_t OffsetX = TileX0 - X0;
+						const int32_t OffsetY = TileY0 - Y0;
+
+						Download(*HeightOut,	Images.Maps.height,		TileX0, TileY0, OffsetX, OffsetY, TileW, TileH);
+						Download(*WaterOut,		Images.Maps.water,		TileX0, TileY0, OffsetX, OffsetY, TileW, TileH);
+						Download(*SedimentOut,	Images.Maps.sediment,	TileX0, TileY0, OffsetX, OffsetY, TileW, TileH);
+						Download(*FluxOut,		Images.Maps.flux,		TileX0, TileY0, OffsetX, OffsetY, TileW, TileH);
+
+						if (InJob)
+						{
+							const int32_t TilesDone = (Pass * TilesY + TileY) * TilesX + TileX + 1;
+							InJob->SetProgress((float)TilesDone / (Passes * TilesX * TilesY));
+						}
+					}
+				}
+
+				// This is the halo exchange, the next pass reads its halos from what
+				// the neighbouring tiles just wrote
+				std::swap(HeightIn, HeightOut);
+				std::swap(WaterIn, WaterOut);
+				std::swap(SedimentIn, SedimentOut);
+				std::swap(FluxIn, FluxOut);
+			}
+
+			// After an odd number of passes the result is in the scratch store
+			if (HeightIn != &HeightmapTiles)
+			{
+				for (int32_t TileY = 0; TileY < TilesY; TileY++)
+				{
+					for (int32_t TileX = 0; TileX < TilesX; TileX++)
+					{
+						const int32_t TileX0	= TileX * TileSize;
+						const int32_t TileY0	= TileY * TileSize;
+						const int32_t TileW	= std::min(TileSize, SizeX - TileX0);
+						const int32_t TileH	= std::min(TileSize, SizeY - TileY0);
+
+						Staging.resize((size_t)TileW * TileH);
+						HeightIn->ReadRegion(TileX0, TileY0, TileW, TileH, Staging.data());
+						HeightmapTiles.WriteRegion(TileX0, TileY0, TileW, TileH, Staging.data());
+					}
+				}
+			}
+		}
+	}
+
+	void ClearProgramCache()
+	{
+		std::lock_guard<std::mutex> Lock(Kernels::ProgramCacheMutex);
+		Kernels::ProgramCache.clear();
+	}
+
+	// Joined when the process exits if nobody waited for it
+	struct WarmUpThreadHolder
+	{
+		~WarmUpThreadHolder()
+		{
+			if (Thread.joinable())
+				Thread.join();
+		}
+
+		std::thread Thread;
+	};
+
+	static WarmUpThreadHolder	WarmUp;
+	static std::mutex			WarmUpMutex;
+
+	void StartWarmUp(int32_t SizeX, int32_t SizeY)
+	{
+		std::lock_guard<std::mutex> Lock(WarmUpMutex);
+
+		if (WarmUp.Thread.joinable())
+			return;
+
+		WarmUp.Thread = std::thread([=]()
+		{
+			Profiling::ScopedSpan Span("Warm Up", "Setup");
+
+			try
+			{
+				// Probes and benchmarks the devices unless they're cached
+				DeviceSelection::GetDevices();
+
+				EnsureStateIsSetup();
+				Kernels::BuildAllPrograms();
+
+				// The only place Automatic is measured, heightmaps are Images until then
+				const bool bMeasureStorage = GetHeightmapStorage() == HeightmapStorage::Automatic;
+				if (bMeasureStorage)
+					GetDeviceHeightmapStorage();
+
+				if (MultiDevice::IsEnabled())
+				{
+					for (const auto& Lane : MultiDevice::GetLanes())
+					{
+						if (Lane->bPrimary)
+							continue;
+
+						ScopedQueue Bind(Lane->Queue);
+						Kernels::BuildAllPrograms();
+
+						if (bMeasureStorage)
+							GetDeviceHeightmapStorage();
+					}
+				}
+
+				// What one node and an erosion run allocate at the landscape size,
+				// as far as the pool's budget goes
+				if (SizeX > 0 && SizeY > 0)
+				{
+					ReserveImages(SizeX, SizeY, ImageFormat, 6);
+					ReserveImages(SizeX, SizeY, compute::image_format(CL_RGBA, CL_FLOAT), 3);
+				}
+			}
+			catch (const std::exception& Exception)
+			{
+				Log(std::string("Warm up failed: ") + Exception.what());
+			}
+		});
+	}
+
+	void WaitForWarmUp()
+	{
+		std::lock_guard<std::mutex> Lock(WarmUpMutex);
+
+		if (WarmUp.Thread.joinable())
+			WarmUp.Thread.join();
+	}
+}
@@ -0,0 +1,588 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Disable warning for GNU_C not being defined
+#pragma warning(push)
+#pragma warning(disable: 4668)
+#define BOOST_COMPUTE_THREAD_SAFE
+#define BOOST_COMPUTE_DEBUG_KERNEL_COMPILATION
+#define BOOST_DISABLE_ABI_HEADERS
+#include <boost/compute/system.hpp>
+#include <boost/compute/image/image2d.hpp>
+#include <boost/compute/utility/dim.hpp>
+#include <boost/compute/utility/source.hpp>
+#pragma warning(pop)
+
+#include <vector>
+#include <mutex>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <functional>
+#include <stdexcept>
+#include <cstdint>
+#include <algorithm>
+
+#include "Stats.h"
+
+// The generation core doesn't depend on the engine, so it can be built and
+// profiled on its own (see CMakeLists.txt). LandscapeGeneration.h adapts it
+// to Unreal
+namespace LandscapeGeneration
+{
+	class TiledHeightmap;
+
+	// The values match EMixType, EJobStatus and EMipReduction on the Unreal side
+	enum class MixOperation : uint8_t
+	{
+		Add			= 0,
+		Subtract	= 1,
+		Multiply	= 2,
+		Min			= 3,
+		Max			= 4
+	};
+
+	enum class JobStatus : uint8_t
+	{
+		Queued		= 0,
+		Running		= 1,
+		Succeeded	= 2,
+		Failed		= 3,
+		Cancelled	= 4
+	};
+
+	enum class MipReduction : uint8_t
+	{
+		Min			= 0,
+		Max			= 1,
+		Average		= 2
+	};
+
+	template<typename T>
+	T Clamp(const T& Value, const T& Min, const T& Max)
+	{
+		return std::min(std::max(Value, Min), Max);
+	}
+
+	// Warnings and build logs go through here, stderr unless something else is set
+	void SetLogFunction(std::function<void(const std::string&)> LogFunction);
+	void Log(const std::string& Message);
+
+	// Directory the .cl files are loaded from, with a trailing slash. The
+	// kernels embedded at build time (see EmbeddedKernels) are used unless this
+	// is set, empty goes back to them. Without embedded kernels it defaults to
+	// LANDSCAPEGENERATION_KERNELS_DIR if it's defined, otherwise Kernels/
+	void SetKernelsPath(const std::string& Path);
+	std::string GetKernelsPath();
+
+	// Kernels are built with the mix operation, the octave count and the
+	// erosion constants as -D defines, so loops can be unrolled and branches
+	// removed. Values tuned from the editor stay kernel arguments, there's
+	// only a handful of variants, each built once and cached. On by default,
+	// off always uses the generic kernels
+	void SetKernelSpecialization(bool bEnabled);
+	bool IsKernelSpecializationEnabled();
+
+	// On CPU devices perlin, voronoi, mix and erosion run as row kernels over
+	// buffers, several pixels per work item with vload/vstore (see
+	// Kernels/vector.h), the CPU runtimes emulate image reads and writes.
+	// On by default, other device types always use the image kernels
+	void SetCpuRowKernels(bool bEnabled);
+	bool AreCpuRowKernelsEnabled();
+
+	extern boost::compute::image_format ImageFormat;
+
+	// Where the pixels of a heightmap live. Image is an image2d. Buffer is a
+	// row-major buffer with an image2d view of the same memory
+	// (cl_khr_image2d_from_buffer), the image kernels go through the view and
+	// the row kernels use the buffer without copying. MappedBuffer is a
+	// Buffer in host memory (CL_MEM_ALLOC_HOST_PTR), reading it back is a map.
+	// Automatic takes the fastest backend the warm up measured on the device,
+	// until it has (or without a warm up) heightmaps are Images
+	enum class HeightmapStorage : uint8_t
+	{
+		Automatic		= 0,
+		Image			= 1,
+		Buffer			= 2,
+		MappedBuffer	= 3
+	};
+
+	// Automatic by default. Only single channel float heightmaps can use the
+	// buffer backends, on devices that can view a buffer as an image and only
+	// if their width fits the device's row pitch alignment. Everything else
+	// is an Image. The backends are about speed, not size: every heightmap
+	// has to fit in to the device's image limits, terrains that don't go
+	// through TiledHeightmap and Kernels::TiledErosion
+	void SetHeightmapStorage(HeightmapStorage Storage);
+	HeightmapStorage GetHeightmapStorage();
+
+	// What Automatic picks on the current queue's device, measured once per
+	// device. Blocks while it measures, the warm up calls it off the game thread
+	HeightmapStorage GetDeviceHeightmapStorage();
+
+	class Heightmap
+	{
+	public:
+		Heightmap(
+			int SizeX, 
+			int SizeY, 
+			boost::compute::image_format inImageFormat
+				= ImageFormat,
+			HeightmapStorage inStorage
+				= HeightmapStorage::Automatic
+		);
+
+		// Gives the image back to the pool
+		~Heightmap();
+
+		Heightmap(const Heightmap&) = delete;
+		Heightmap& operator=(const Heightmap&) = delete;
+
+		// Copy the heightmap from the device to the host. uint16_t heightmaps can be
+		// read from R uint16_t and R float images, float from RGBA float images
+		operator std::vector<uint16_t>() const;
+		operator std::vector<float>() const;
+
+		void* CreateRawCopy() const;
+
+		size_t Width() const;
+		size_t Height() const;
+		boost::compute::image_format Format() const;
+
+		// Never Automatic, that's resolved when the heightmap is made
+		HeightmapStorage Storage() const;
+
+		// With the buffer backends a view of Buffer
+		boost::compute::image2d Image;
+
+		// Width() floats per row with the buffer backends, empty for Image
+		boost::compute::buffer Buffer;
+
+		// Counts the image towards Stats::Counter::DeviceBytesAllocated
+		Stats::TrackedAllocation Allocation;
+
+	private:
+		// Every pixel to Out, tightly packed
+		void ReadPixels(void* Out) const;
+
+		HeightmapStorage StorageType;
+	};
+
+	// Optional, the best device from DeviceSelection is used otherwise. The
+	// queue is created on the best ranked of Devices
+	void SetDevices(std::vector<boost::compute::device> Devices);
+
+	// The device the queue runs on, chooses one if that hasn't happened yet
+	boost::compute::device GetDevice();
+
+	// The queue everything runs on unless a ScopedQueue says otherwise
+	boost::compute::command_queue GetSharedQueue();
+
+	// Images of destroyed heightmaps are kept for the next heightmap of the
+	// same size and format, up to the budget (256 MB by default)
+	void SetImagePoolBudget(size_t Bytes);
+
+	// Allocates up to Count images in to the pool up front, as many as fit in the budget
+	void ReserveImages(int32_t SizeX, int32_t SizeY, boost::compute::image_format Format, int32_t Count);
+	void ClearImagePool();
+
+	// Programs are built once per context and kept, clear them to pick up
+	// changes to the .cl files
+	void ClearProgramCache();
+
+	// Gets everything the first node would otherwise wait for out of the way on
+	// a background thread: probes the devices, creates the context, builds
+	// every program and fills the image pool for SizeX * SizeY heightmaps (if
+	// they're not 0). Nodes that run in the meantime wait for the programs
+	// they need rather than building them again
+	void StartWarmUp(int32_t SizeX, int32_t SizeY);
+
+	// Blocks until the warm up is done, if one was started
+	void WaitForWarmUp();
+
+	// While it's alive, everything the calling thread allocates and enqueues
+	// (heightmaps, kernels, transfers) goes to Queue and its context instead of
+	// the shared queue. Scopes nest
+	class ScopedQueue
+	{
+	public:
+		explicit ScopedQueue(boost::compute::command_queue& Queue);
+		~ScopedQueue();
+
+		ScopedQueue(const ScopedQueue&) = delete;
+		ScopedQueue& operator=(const ScopedQueue&) = delete;
+
+		// True if the calling thread is inside a ScopedQueue
+		static bool IsBound();
+
+	private:
+		boost::compute::context			BoundQueueContext;
+		boost::compute::command_queue*	PreviousQueue;
+		boost::compute::context*		PreviousContext;
+	};
+
+	// Creates a heightmap on the device and returns a wrapper pointer to it
+	std::shared_ptr<Heightmap> CreateHeightmap(
+		int SizeX, 
+		int SizeY, 
+		boost::compute::image_format inImageFormat 
+			= ImageFormat,
+		HeightmapStorage inStorage
+			= HeightmapStorage::Automatic
+	);
+
+	// Single channel float image2d_array of Layers Width * Height layers, for
+	// the batched kernels. Throws if the device has no image arrays or fewer
+	// than Layers of them (see GetMaxHeightmapArrayLayers)
+	boost::compute::image_object CreateHeightmapArray(size_t Width, size_t Height, size_t Layers);
+
+	// Most layers an image array can have on the current queue's device, 0
+	// without image arrays
+	size_t GetMaxHeightmapArrayLayers();
+
+	void PushKernel(std::function<void()> KernelFunc);
+
+	// Handle to work pushed with PushJob. Status and progress can be read from
+	// any thread, the future becomes ready with the final status
+	class Job
+	{
+	public:
+		Job();
+
+		JobStatus GetStatus() const { return Status; }
+		float GetProgress() const { return Progress; }
+		std::shared_future<JobStatus> GetFuture() const { return Future; }
+
+		// Jobs that haven't started are skipped. Running jobs stop at their next
+		// CheckCancelled, not every job has one
+		void Cancel() { bCancelRequested = true; }
+		bool IsCancelRequested() const { return bCancelRequested; }
+
+		// Called from the kernel thread while the job is running
+		void SetProgress(float InProgress);
+		// Throws JobCancelled if the job has been cancelled
+		void CheckCancelled() const;
+
+		// Called on the kernel thread whenever the progress changes
+		std::function<void(float)> OnProgress;
+
+	private:
+		friend std::shared_ptr<Job> PushJob(std::function<void(Job&)>,
+			std::vector<std::shared_ptr<Job>>, std::vector<std::weak_ptr<Heightmap>>);
+
+		void Finish(JobStatus FinalStatus);
+
+		std::atomic<JobStatus>			Status;
+		std::atomic<float>				Progress;
+		std::atomic<bool>				bCancelRequested;
+
+		std::promise<JobStatus>		Promise;
+		std::shared_future<JobStatus>	Future;
+	};
+
+	// Thrown from inside a job to stop it once it's been cancelled
+	class JobCancelled : public std::runtime_error
+	{
+	public:
+		JobCancelled() : std::runtime_error("Job cancelled") {}
+	};
+
+	// Pushes KernelFunc on to the kernel queue as a cancellable job.
+	// The job is skipped if it's cancelled before it starts, if any of its
+	// Dependencies didn't succeed, or if none of its Outputs are referenced
+	// by anything anymore (nothing could ever read the result). Exceptions
+	// thrown by KernelFunc fail the job
+	std::shared_ptr<Job> PushJob(std::function<void(Job&)> KernelFunc,
+		std::vector<std::shared_ptr<Job>> Dependencies = std::vector<std::shared_ptr<Job>>(),
+		std::vector<std::weak_ptr<Heightmap>> Outputs = std::vector<std::weak_ptr<Heightmap>>());
+
+	// Manages the kernel thread. Should be ticked regularly from one thread
+	// (the game thread in Unreal)
+	void Tick();
+
+	// Blocks until everything enqueued on the device so far has finished
+	void Finish();
+
+	// Size of mip level Level of a SizeX * SizeY heightmap. Each level is half
+	// the size of the one before rounded up, level 0 is the heightmap itself
+	void GetMipLevelSize(int32_t SizeX, int32_t SizeY, int32_t Level, int32_t& OutSizeX, int32_t& OutSizeY);
+
+	// Number of levels after level 0 until the heightmap is 1x1
+	int32_t GetMipLevelCount(int32_t SizeX, int32_t SizeY);
+
+	namespace Kernels
+	{
+		// Maps the pixels of an output image to world space. Pixel (x, y) is
+		// evaluated at (OriginX + x * Step, OriginY + y * Step), so any region of
+		// the world can be generated at any LOD and neighbouring regions line up.
+		// The default is the whole landscape starting at (0, 0)
+		struct TileRegion
+		{
+			int32_t OriginX	= 0;
+			int32_t OriginY	= 0;
+			int32_t Step		= 1;
+		};
+
+		void PerlinNoise(boost::compute::image2d& Heightmap,
+			float noiseSize, int32_t seed, int32_t depth, float amplitude,
+			const TileRegion& Region = TileRegion());
+
+		// The warp offsets are smooth, so they're evaluated at 1 / Downsample of
+		// the output resolution and sampled bilinearly. Downsample 1 evaluates
+		// them for every pixel. Depth is the octave count of the warp field,
+		// 0 uses the noise's own
+		struct WarpFieldSettings
+		{
+			int32_t Downsample	= 4;
+			int32_t Depth		= 0;
+		};
+
+		void WarpedPerlinNoise(boost::compute::image2d& Heightmap,
+			float noiseSize, int32_t seed, int32_t depth, float amplitude,
+			const TileRegion& Region = TileRegion(),
+			const WarpFieldSettings& Warp = WarpFieldSettings());
+
+		// Simplex and gradient noise from gradientnoise.cl. Cheaper per octave
+		// than PerlinNoise, the permutation table is shuffled from seed
+		void SimplexNoise(boost::compute::image2d& Heightmap,
+			float noiseSize, int32_t seed, int32_t depth, float amplitude,
+			const TileRegion& Region = TileRegion());
+
+		void GradientNoise(boost::compute::image2d& Heightmap,
+			float noiseSize, int32_t seed, int32_t depth, float amplitude,
+			const TileRegion& Region = TileRegion());
+
+		void Mix(boost::compute::image2d& LHeightMap,
+			boost::compute::image2d& RHeightMap,
+			boost::compute::image2d& OutputHeightmap,
+			MixOperation MixType);
+
+		void VoronoiNoise(boost::compute::image2d& Heightmap,
+			int32_t noiseSize,
+			int32_t seed,
+			float amplitude,
+			const TileRegion& Region = TileRegion());
+
+		// Grid Voronoi from voronoigrid.cl, all four outputs in one dispatch.
+		// F1 and F2 are the distances to the nearest and second nearest
+		// feature points, Edge is F2 - F1 (0 on the cell borders), all scaled
+		// by amplitude / noiseSize like VoronoiNoise. CellId is a random
+		// 0 to amplitude value per cell
+		void VoronoiFeatures(boost::compute::image2d& F1,
+			boost::compute::image2d& F2,
+			boost::compute::image2d& Edge,
+			boost::compute::image2d& CellId,
+			int32_t noiseSize,
+			int32_t seed,
+			float amplitude,
+			const TileRegion& Region = TileRegion());
+
+		// Sets every channel of every pixel to Value on the device, with
+		// clEnqueueFillImage or a cached kernel (init.cl) where that's missing.
+		// Nothing goes through the host
+		void Fill(boost::compute::image2d& Image, float Value);
+
+		void Constant(boost::compute::image2d& Heightmap,
+			float height);
+
+		// Builds mip levels 1 to Levels (clamped to the full chain) of a single
+		// channel float heightmap on the device. Element i of the result is level
+		// i + 1, an RGBA float image holding the minimum, maximum and average
+		// heights and the number of full resolution pixels covered by each texel
+		std::vector<std::shared_ptr<Heightmap>> MipPyramid(boost::compute::image2d& Heightmap,
+			int32_t Levels);
+
+		// Copies the minimum, maximum or average of a MipPyramid level in to a
+		// single channel heightmap of the same size
+		void MipChannel(boost::compute::image2d& Level,
+			boost::compute::image2d& OutputHeightmap,
+			MipReduction Reduction);
+
+		// Bilinearly resamples a single channel heightmap to the size of OutputHeightmap
+		void Resample(boost::compute::image2d& Heightmap,
+			boost::compute::image2d& OutputHeightmap);
+
+		// Smoothing filters for single channel float heightmaps, all built
+		// from separable passes that cost the same per pixel whatever the
+		// radius (box_filter.cl). OutputHeightmap has to be the same size.
+		// Pixels past the edges repeat the edge
+		void BoxBlur(boost::compute::image2d& Heightmap,
+			boost::compute::image2d& OutputHeightmap,
+			int32_t Radius);
+
+		// Approximated by three box blurs per axis
+		void GaussianBlur(boost::compute::image2d& Heightmap,
+			boost::compute::image2d& OutputHeightmap,
+			float Sigma);
+
+		// Minimum (erosion) or maximum (dilation) over the square of 2 * Radius + 1 pixels
+		void MinFilter(boost::compute::image2d& Heightmap,
+			boost::compute::image2d& OutputHeightmap,
+			int32_t Radius);
+
+		void MaxFilter(boost::compute::image2d& Heightmap,
+			boost::compute::image2d& OutputHeightmap,
+			int32_t Radius);
+
+		// Reductions of single channel float heightmaps on the device
+		// (reduce.cl). Only one value per work group is read back
+		struct HeightmapStatistics
+		{
+			float		Min		= 0.f;
+			float		Max		= 0.f;
+			double		Sum		= 0.0;
+			double		Mean	= 0.0;
+			double		StdDev	= 0.0;
+			uint64_t	Count	= 0;
+		};
+
+		// Blocks until the reduction has run
+		HeightmapStatistics Statistics(boost::compute::image2d& Heightmap);
+
+		// Bins pixels counts between the heightmap's minimum and maximum, which
+		// are returned in OutMin and OutMax. Blocks until it has run
+		std::vector<uint32_t> Histogram(boost::compute::image2d& Heightmap,
+			int32_t Bins, float& OutMin, float& OutMax);
+
+		// These stay on the device, the statistics they need are never read back.
+		// Maps the heightmap's minimum and maximum to Min and Max
+		void Normalize(boost::compute::image2d& Heightmap,
+			boost::compute::image2d& OutputHeightmap,
+			float Min, float Max);
+
+		// Maps InMin..InMax to OutMin..OutMax, clamped to the output range if bClamp is set
+		void Remap(boost::compute::image2d& Heightmap,
+			boost::compute::image2d& OutputHeightmap,
+			float InMin, float InMax, float OutMin, float OutMax, bool bClamp);
+
+		// Spreads the heights evenly over the heightmap's own range, using a
+		// histogram with Bins bins
+		void HistogramEqualize(boost::compute::image2d& Heightmap,
+			boost::compute::image2d& OutputHeightmap,
+			int32_t Bins);
+
+		// Seeds or parameter sets evaluated together. Layer i of a heightmap
+		// array gets Params[i], the depth is shared so the whole batch is one
+		// (specialised) dispatch
+		struct BatchNoiseParams
+		{
+			int32_t	Seed		= 0;
+			float	NoiseSize	= 1.f;
+			float	Amplitude	= 1.f;
+		};
+
+		void PerlinNoiseLayers(boost::compute::image_object& Layers,
+			const std::vector<BatchNoiseParams>& Params, int32_t depth,
+			const TileRegion& Region = TileRegion());
+
+		// Averages every layer down to one thumbnail. They're placed left to right
+		// in Strip from FirstThumbnail on, each Strip.width() / ThumbnailCount wide
+		// and as high as the strip
+		void ThumbnailStrip(boost::compute::image_object& Layers,
+			boost::compute::image2d& Strip,
+			size_t FirstThumbnail, size_t ThumbnailCount);
+
+		void CopyLayer(boost::compute::image_object& Layers, size_t Layer,
+			boost::compute::image2d& Heightmap);
+
+		struct HeightmapBatch
+		{
+			// Full resolution, one per parameter set
+			std::vector<std::shared_ptr<Heightmap>> Maps;
+
+			// One ThumbnailSize wide thumbnail per map, in the same order
+			std::shared_ptr<Heightmap> Thumbnails;
+		};
+
+		// Count SizeX * SizeY maps and their thumbnail strip. Thumbnails keep the
+		// aspect of the maps
+		HeightmapBatch CreateHeightmapBatch(int32_t SizeX, int32_t SizeY, int32_t Count, int32_t ThumbnailSize);
+
+		// Perlin noise for every parameter set in to Batch (one map per set), in
+		// as few dispatches as the device's image array size allows
+		void PerlinNoiseBatch(HeightmapBatch& Batch,
+			const std::vector<BatchNoiseParams>& Params, int32_t depth,
+			const TileRegion& Region = TileRegion());
+
+		struct ErosionParams
+		{
+			std::shared_ptr<Heightmap> height, water, hardness, sediment, sedimentCapacity, flux, velocity;
+		};
+
+		struct ErosionSettings
+		{
+			float DeltaTime				= 0.016f;
+			float waterMul				= 0.012f;
+			float softeningCoefficient	= 5.0f;
+			float maxErosionDepth		= 10.f;
+			float sedimentCapacity		= 1.f;
+		};
+
+		// Clears everything but the height, so erosion starts from dry terrain
+		// at rest. Maps created for a fresh run need this, Erosion only clears
+		// the hardness
+		void ClearErosionState(ErosionParams& Maps);
+
+		// If InJob is given, its progress is updated and cancellation is checked
+		// every few iterations
+		ErosionParams Erosion(ErosionParams inputMaps,
+			int32_t iterations,
+			float DeltaTime,
+			float waterMul,
+			float softeningCoefficient,
+			float maxErosionDepth,
+			float sedimentCapacity,
+			Job* InJob = nullptr);
+
+		// Every combination of the given values, the other settings (and any
+		// empty list) come from Base
+		std::vector<ErosionSettings> ErosionSweepGrid(const ErosionSettings& Base,
+			const std::vector<float>& waterMuls,
+			const std::vector<float>& softeningCoefficients,
+			const std::vector<float>& maxErosionDepths,
+			const std::vector<float>& sedimentCapacities);
+
+		struct ErosionSweepRun
+		{
+			ErosionSettings	Settings;
+
+			// The eroded maps, in the caller's context whichever device ran them.
+			// The hardness is shared by every run
+			ErosionParams	Maps;
+
+			// The lane (device) the run went to, and how long it took from
+			// copying the inputs to the last kernel
+			std::string		Lane;
+			double			Seconds = 0.0;
+		};
+
+		// Erosion for every entry of Runs on the same inputMaps, which aren't
+		// changed. The inputs are read once and uploaded once per device, the
+		// generic (unspecialised) erosion program is built once per device, and
+		// the runs are handed out to every MultiDevice lane (just the current
+		// queue if it's off) a few at a time per lane. The inputs' hardness is
+		// cleared, like Erosion does. If OutputHeights has one map per run the
+		// eroded heights are written to those
+		std::vector<ErosionSweepRun> ErosionSweep(const ErosionParams& inputMaps,
+			int32_t iterations,
+			const std::vector<ErosionSettings>& Runs,
+			const std::vector<std::shared_ptr<Heightmap>>& OutputHeights = std::vector<std::shared_ptr<Heightmap>>(),
+			Job* InJob = nullptr);
+
+		// Erodes a terrain that doesn't fit in to a single device image.
+		// The terrain is split in to TileSize tiles which are streamed through
+		// the device with a halo wide enough for IterationsPerPass iterations.
+		// Between passes the halos are re-read from the neighbouring tiles so
+		// the result stays seamless. Erosion state that has to survive between
+		// passes is paged to files in ScratchDirectory.
+		void TiledErosion(TiledHeightmap& HeightmapTiles,
+			int32_t iterations,
+			int32_t IterationsPerPass,
+			int32_t TileSize,
+			const ErosionSettings& Settings,
+			const std::string& ScratchDirectory,
+			Job* InJob = nullptr);
+	}
+}
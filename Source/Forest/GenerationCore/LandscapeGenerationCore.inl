@@ -1,7 +1,10 @@
 #pragma once
 
-// Same as the old program, except that it outputs the debug to UE_LOG
-class ue_compute_program : public boost::compute::program
+#include <fstream>
+#include <sstream>
+
+// Same as the old program, except that it outputs the debug to LandscapeGeneration::Log
+class logged_compute_program : public boost::compute::program
 {
 public:
 	void build(const std::string &options = std::string())
@@ -28,7 +31,7 @@ public:
 
 			std::string errorstring(errorstringstream.str());
 
-			UE_LOG(LogTemp, Warning, TEXT("%s"), ANSI_TO_TCHAR(errorstring.c_str()));
+			LandscapeGeneration::Log(errorstring);
 		}
 #endif
 
@@ -0,0 +1,199 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "MultiDevice.h"
+#include "DeviceSelection.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+
+using namespace std;
+namespace compute = boost::compute;
+
+namespace LandscapeGeneration
+{
+	namespace MultiDevice
+	{
+		static std::atomic<bool>					bMultiDeviceEnabled(false);
+		static std::mutex							LanesMutex;
+		static std::vector<std::shared_ptr<Lane>>	Lanes;
+		static bool									bLanesBuilt = false;
+
+		// How much of each new measurement goes in to a lane's throughput
+		static const double ThroughputSmoothing = 0.5;
+
+		void SetEnabled(bool bEnabled)
+		{
+			bMultiDeviceEnabled = bEnabled;
+		}
+
+		bool IsEnabled()
+		{
+			return bMultiDeviceEnabled;
+		}
+
+		// One sub-device per NUMA node, or just Device if it can't be partitioned
+		static std::vector<compute::device> SplitByNumaNode(const compute::device& Device)
+		{
+#ifdef CL_VERSION_1_2
+			try
+			{
+				if (Device.check_version(1, 2))
+				{
+					std::vector<compute::device> Nodes = Device.partition_by_affinity_domain(CL_DEVICE_AFFINITY_DOMAIN_NUMA);
+					if (Nodes.size() > 1)
+						return Nodes;
+				}
+			}
+			catch (const std::exception&)
+			{
+				// Most drivers only have one node, or can't partition at all
+			}
+#endif
+
+			return { Device };
+		}
+
+		static void BuildLanes()
+		{
+			if (bLanesBuilt)
+				return;
+
+			bLanesBuilt = true;
+
+			const compute::device Primary = GetDevice();
+			const auto& Infos = DeviceSelection::GetDevices();
+
+			double PrimaryScore = 1.0;
+			for (const auto& Info : Infos)
+			{
+				if (Info.Device == Primary && Info.Score > 0.0)
+					PrimaryScore = Info.Score;
+			}
+
+			Lanes.push_back(std::make_shared<Lane>(Lane{ Primary.name(), GetSharedQueue(), true, PrimaryScore }));
+
+			for (const auto& Info : Infos)
+			{
+				if (!Info.IsUsable() || Info.Device == Primary)
+					continue;
+
+				// The primary device is never partitioned, the shared queue uses all of it
+				const std::vector<compute::device> Parts = (Info.Device.type() & CL_DEVICE_TYPE_CPU)
+					? SplitByNumaNode(Info.Device)
+					: std::vector<compute::device>{ Info.Device };
+
+				for (size_t i = 0; i < Parts.size(); i++)
+				{
+					try
+					{
+						compute::context LaneContext(Parts[i]);
+						compute::command_queue LaneQueue(LaneContext, Parts[i], compute::command_queue::enable_profiling);
+
+						const std::string Name = Parts.size() > 1
+							? Info.Name + " (node " + std::to_string(i) + ")"
+							: Info.Name;
+
+						Lanes.push_back(std::make_shared<Lane>(Lane{ Name, LaneQueue, false, Info.Score / Parts.size() }));
+					}
+					catch (const std::exception& Exception)
+					{
+						Log("Couldn't create a generation lane on " + Info.Name + ": " + Exception.what());
+					}
+				}
+			}
+
+			for (const auto& Built : Lanes)
+			{
+				Log("Generation lane: " + Built->Name);
+			}
+		}
+
+		std::vector<std::shared_ptr<Lane>> GetLanes()
+		{
+			std::lock_guard<std::mutex> Lock(LanesMutex);
+			BuildLanes();
+
+			return Lanes;
+		}
+
+		std::vector<Band> SplitRows(int32_t Rows, int32_t MinRows)
+		{
+			std::lock_guard<std::mutex> Lock(LanesMutex);
+			BuildLanes();
+
+			// Fastest first, so the slowest is the one dropped
+			std::vector<size_t> Active;
+			for (size_t i = 0; i < Lanes.size(); i++)
+			{
+				Active.push_back(i);
+			}
+
+			std::stable_sort(Active.begin(), Active.end(), [](size_t A, size_t B)
+			{
+				return Lanes[A]->Throughput > Lanes[B]->Throughput;
+			});
+
+			double Total = 0.0;
+			for (size_t i : Active)
+			{
+				Total += Lanes[i]->Throughput;
+			}
+
+			while (Active.size() > 1 && Rows * Lanes[Active.back()]->Throughput / Total < MinRows)
+			{
+				Total -= Lanes[Active.back()]->Throughput;
+				Active.pop_back();
+			}
+
+			// Back in lane order, the primary lane gets the top band
+			std::sort(Active.begin(), Active.end());
+
+			std::vector<Band> Bands;
+			double Accumulated = 0.0;
+			int32_t Start = 0;
+
+			for (size_t i = 0; i < Active.size(); i++)
+			{
+				Accumulated += Lanes[Active[i]]->Throughput;
+
+				const int32_t End = i + 1 == Active.size()
+					? Rows
+					: (int32_t)std::lround(Rows * Accumulated / Total);
+
+				if (End > Start)
+				{
+					const Band NewBand = { Active[i], Start, End - Start };
+					Bands.push_back(NewBand);
+				}
+
+				Start = End;
+			}
+
+			return Bands;
+		}
+
+		void ReportThroughput(size_t LaneIndex, double Pixels, double Seconds)
+		{
+			if (Seconds <= 0.0)
+				return;
+
+			std::lock_guard<std::mutex> Lock(LanesMutex);
+
+			if (LaneIndex >= Lanes.size())
+				return;
+
+			Lane& Target = *Lanes[LaneIndex];
+			Target.Throughput += (Pixels / Seconds / 1e6 - Target.Throughput) * ThroughputSmoothing;
+		}
+
+		bool ShouldSplit(int32_t Rows)
+		{
+			if (!IsEnabled() || ScopedQueue::IsBound() || Rows < 2 * MinBandRows)
+				return false;
+
+			return GetLanes().size() > 1;
+		}
+	}
+}
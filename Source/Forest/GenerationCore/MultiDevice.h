@@ -0,0 +1,64 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "LandscapeGenerationCore.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace LandscapeGeneration
+{
+	// Spreads big images over every usable device. Work is split in to
+	// horizontal bands, one per lane, sized by how fast each lane has been so
+	// far. A lane is a device with its own context and queue, CPUs with several
+	// NUMA nodes get a lane per node (sub-devices from clCreateSubDevices).
+	// Off unless enabled, with a single lane everything runs as before
+	namespace MultiDevice
+	{
+		struct Lane
+		{
+			std::string						Name;
+			boost::compute::command_queue	Queue;
+
+			// The primary lane is the shared queue everything else runs on, so
+			// its bands can be copied in to the result without going through the host
+			bool							bPrimary;
+
+			// Megapixels per second, starts at the DeviceSelection score and
+			// follows what's measured
+			double							Throughput;
+		};
+
+		struct Band
+		{
+			size_t	Lane;
+			int32_t	Start;
+			int32_t	Rows;
+		};
+
+		// Bands smaller than this aren't worth the transfers, their lane is left out
+		static const int32_t MinBandRows = 128;
+
+		void SetEnabled(bool bEnabled);
+		bool IsEnabled();
+
+		// The primary lane first. Built from DeviceSelection the first time
+		// it's needed, the lanes live until the process exits
+		std::vector<std::shared_ptr<Lane>> GetLanes();
+
+		// Splits Rows between the lanes in proportion to their throughput,
+		// dropping the slowest lanes until every band has at least MinRows
+		std::vector<Band> SplitRows(int32_t Rows, int32_t MinRows = MinBandRows);
+
+		// Folds a measured run in to the lane's throughput, so the next split
+		// is balanced by what the lanes actually do
+		void ReportThroughput(size_t LaneIndex, double Pixels, double Seconds);
+
+		// True if Rows rows should be split: enabled, more than one lane, big
+		// enough, and not already running on a lane
+		bool ShouldSplit(int32_t Rows);
+	}
+}
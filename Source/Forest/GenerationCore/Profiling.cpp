@@ -0,0 +1,274 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Profiling.h"
+#include "Stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+namespace compute = boost::compute;
+
+namespace LandscapeGeneration
+{
+	namespace Profiling
+	{
+		// Device work goes on its own row in the trace
+		static const uint64_t DeviceThreadId = 0;
+
+		struct TraceSpan
+		{
+			const char*	Name;
+			const char*	Category;
+			const char*	Parent;
+			uint64_t		ThreadId;
+			double		StartMicroseconds;
+			double		DurationMicroseconds;
+		};
+
+		// Device events that haven't been timed yet. Every event is timed for
+		// Stats, only the ones recorded while profiling become spans
+		struct PendingEvent
+		{
+			compute::event	Event;
+			const char*		Name;
+			const char*		Category;
+			const char*		Parent;
+			double			QueuedMicroseconds;
+			bool			bTrace;
+			bool			bTransfer;
+		};
+
+		// Once this many events are pending, the finished ones are resolved so
+		// the driver can recycle them. Grows while the device is behind so the
+		// pending list isn't scanned on every event
+		static const size_t MinResolveThreshold = 64;
+		static size_t ResolveThreshold = MinResolveThreshold;
+
+		static std::atomic<bool>			bProfilingEnabled(false);
+		static std::mutex					TraceMutex;
+		static std::vector<TraceSpan>		Spans;
+		static std::vector<PendingEvent>	PendingEvents;
+
+		// The innermost span on each thread, device work is tagged with it
+		static thread_local const char*		CurrentSpan = nullptr;
+
+		static double NowMicroseconds()
+		{
+			static const auto Start = std::chrono::steady_clock::now();
+
+			return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - Start).count();
+		}
+
+		static uint64_t CurrentThreadId()
+		{
+			// Chrome trace wants small numbers, and 0 is the device
+			return (uint64_t)(std::hash<std::thread::id>()(std::this_thread::get_id()) % 100000) + 1;
+		}
+
+		void SetEnabled(bool bEnabled)
+		{
+			bProfilingEnabled = bEnabled;
+		}
+
+		bool IsEnabled()
+		{
+			return bProfilingEnabled;
+		}
+
+		void Clear()
+		{
+			std::lock_guard<std::mutex> Lock(TraceMutex);
+
+			Spans.clear();
+
+			// Still timed for Stats, but they're not part of the next trace
+			for (auto& Pending : PendingEvents)
+			{
+				Pending.bTrace = false;
+			}
+		}
+
+		ScopedSpan::ScopedSpan(const char* Name, const char* Category)
+			: Name(Name)
+			, Category(Category)
+			, Parent(CurrentSpan)
+			, StartMicroseconds(0.0)
+			, bRecording(bProfilingEnabled)
+		{
+			if (bRecording)
+			{
+				StartMicroseconds = NowMicroseconds();
+				CurrentSpan = Name;
+			}
+		}
+
+		ScopedSpan::~ScopedSpan()
+		{
+			if (!bRecording)
+				return;
+
+			CurrentSpan = Parent;
+
+			const TraceSpan Span = { Name, Category, Parent, CurrentThreadId(),
+				StartMicroseconds, NowMicroseconds() - StartMicroseconds };
+
+			std::lock_guard<std::mutex> Lock(TraceMutex);
+			Spans.push_back(Span);
+		}
+
+		// Turns a finished event in to a span on the host's timeline. The device
+		// clock is lined up with the host clock at the moment it was queued
+		static void ResolveEvent(const PendingEvent& Pending)
+		{
+			const double Queued	= (double)Pending.Event.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_QUEUED) / 1000.0;
+			const double Start	= (double)Pending.Event.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_START) / 1000.0;
+			const double End	= (double)Pending.Event.get_profiling_info<cl_ulong>(CL_PROFILING_COMMAND_END) / 1000.0;
+
+			Stats::Record(Pending.bTransfer ? Stats::Histogram::TransferTime : Stats::Histogram::KernelTime,
+				(uint64_t)(End - Start));
+
+			if (Pending.bTrace)
+			{
+				const TraceSpan Span = { Pending.Name, Pending.Category, Pending.Parent, DeviceThreadId,
+					Pending.QueuedMicroseconds + (Start - Queued), End - Start };
+				Spans.push_back(Span);
+			}
+		}
+
+		// Resolves the pending events that are done. Only blocks if bWait is set
+		static void ResolvePendingEvents(bool bWait)
+		{
+			std::vector<PendingEvent> StillPending;
+
+			for (auto& Pending : PendingEvents)
+			{
+				if (bWait)
+					Pending.Event.wait();
+
+				if (Pending.Event.status() == CL_COMPLETE)
+				{
+					ResolveEvent(Pending);
+				}
+				else
+				{
+					StillPending.push_back(Pending);
+				}
+			}
+
+			PendingEvents.swap(StillPending);
+			ResolveThreshold = std::max(MinResolveThreshold, PendingEvents.size() * 2);
+		}
+
+		void TraceEvent(const compute::event& Event, const char* Name, const char* Category)
+		{
+			if (Event.get() == nullptr)
+				return;
+
+			const bool bTrace		= bProfilingEnabled;
+			const bool bTransfer	= strcmp(Category, "Transfer") == 0;
+
+			if (!bTransfer)
+				Stats::Add(Stats::Counter::KernelDispatches, 1);
+
+			const PendingEvent Pending = { Event, Name, Category, CurrentSpan,
+				bTrace ? NowMicroseconds() : 0.0, bTrace, bTransfer };
+
+			std::lock_guard<std::mutex> Lock(TraceMutex);
+			PendingEvents.push_back(Pending);
+
+			if (PendingEvents.size() >= ResolveThreshold)
+				ResolvePendingEvents(false);
+		}
+
+		void ResolveFinishedEvents()
+		{
+			std::lock_guard<std::mutex> Lock(TraceMutex);
+			ResolvePendingEvents(false);
+		}
+
+		// Names in the trace are our own literals, but be safe with quotes anyway
+		static std::string EscapeJson(const char* String)
+		{
+			std::string Escaped;
+
+			for (const char* c = String ? String : ""; *c; c++)
+			{
+				if (*c == '"' || *c == '\\')
+					Escaped += '\\';
+
+				Escaped += *c;
+			}
+
+			return Escaped;
+		}
+
+		bool WriteChromeTrace(const std::string& Path)
+		{
+			std::lock_guard<std::mutex> Lock(TraceMutex);
+
+			ResolvePendingEvents(true);
+
+			std::ofstream File(Path, std::ios::out | std::ios::trunc);
+			if (!File.is_open())
+				return false;
+
+			File << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+			File << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << DeviceThreadId
+				<< ",\"args\":{\"name\":\"OpenCL Device\"}}";
+
+			for (auto& Span : Spans)
+			{
+				File << ",\n{\"name\":\"" << EscapeJson(Span.Name)
+					<< "\",\"cat\":\"" << EscapeJson(Span.Category)
+					<< "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << Span.ThreadId
+					<< ",\"ts\":" << Span.StartMicroseconds
+					<< ",\"dur\":" << Span.DurationMicroseconds;
+
+				if (Span.Parent)
+					File << ",\"args\":{\"node\":\"" << EscapeJson(Span.Parent) << "\"}";
+
+				File << "}";
+			}
+
+			File << "\n]}\n";
+
+			return File.good();
+		}
+
+		std::vector<SpanTotal> Summarize()
+		{
+			std::lock_guard<std::mutex> Lock(TraceMutex);
+
+			ResolvePendingEvents(true);
+
+			std::vector<SpanTotal> Totals;
+			for (auto& Span : Spans)
+			{
+				auto Total = std::find_if(Totals.begin(), Totals.end(), [&](const SpanTotal& Existing)
+				{
+					return Existing.Name == Span.Name && Existing.Category == Span.Category
+						&& Existing.bDevice == (Span.ThreadId == DeviceThreadId);
+				});
+
+				if (Total == Totals.end())
+				{
+					Totals.push_back({ Span.Name, Span.Category, Span.ThreadId == DeviceThreadId, 0, 0.0 });
+					Total = Totals.end() - 1;
+				}
+
+				Total->Count++;
+				Total->TotalMicroseconds += Span.DurationMicroseconds;
+			}
+
+			return Totals;
+		}
+	}
+}
@@ -0,0 +1,80 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+// Disable warning for GNU_C not being defined
+#pragma warning(push)
+#pragma warning(disable: 4668)
+#define BOOST_COMPUTE_THREAD_SAFE
+#define BOOST_COMPUTE_DEBUG_KERNEL_COMPILATION
+#define BOOST_DISABLE_ABI_HEADERS
+#include <boost/compute/event.hpp>
+#pragma warning(pop)
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace LandscapeGeneration
+{
+	// Records where generation time goes, both on the host (program builds,
+	// allocations, readbacks, nodes) and on the device (every kernel, timed
+	// with OpenCL event profiling), and writes it out as a Chrome trace
+	// (chrome://tracing or https://ui.perfetto.dev).
+	// Nothing is recorded unless profiling is enabled
+	namespace Profiling
+	{
+		void SetEnabled(bool bEnabled);
+		bool IsEnabled();
+
+		// Throws away everything recorded so far
+		void Clear();
+
+		// Times the scope it lives in on the calling thread. Kernels traced
+		// inside of it are tagged with its name, so device time can be broken
+		// down per node. Name and Category must outlive the trace (literals)
+		class ScopedSpan
+		{
+		public:
+			ScopedSpan(const char* Name, const char* Category);
+			~ScopedSpan();
+
+			ScopedSpan(const ScopedSpan&) = delete;
+			ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+		private:
+			const char*	Name;
+			const char*	Category;
+			const char*	Parent;
+			double		StartMicroseconds;
+			bool		bRecording;
+		};
+
+		// Records the device execution time of Event once it completes. The
+		// queue it was enqueued on needs CL_QUEUE_PROFILING_ENABLE. Events are
+		// always timed for Stats, they're only traced while profiling is enabled
+		void TraceEvent(const boost::compute::event& Event, const char* Name, const char* Category = "Kernel");
+
+		// Times the events that have finished without waiting for the rest,
+		// called every Tick so Stats stay current
+		void ResolveFinishedEvents();
+
+		// Waits for all traced device work and writes everything recorded so
+		// far to Path. Returns false if the file couldn't be written
+		bool WriteChromeTrace(const std::string& Path);
+
+		// Time spent in everything with the same name and category, device
+		// work is totalled separately from host spans
+		struct SpanTotal
+		{
+			std::string	Name;
+			std::string	Category;
+			bool		bDevice;
+			int32_t		Count;
+			double		TotalMicroseconds;
+		};
+
+		// Waits for all traced device work and totals everything recorded so far
+		std::vector<SpanTotal> Summarize();
+	}
+}
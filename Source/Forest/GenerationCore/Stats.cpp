@@ -0,0 +1,198 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "Stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+
+namespace LandscapeGeneration
+{
+	namespace Stats
+	{
+		struct AtomicHistogram
+		{
+			std::atomic<uint64_t>	Count;
+			std::atomic<uint64_t>	Sum;
+			std::atomic<uint64_t>	Max;
+			std::array<std::atomic<uint64_t>, HistogramBuckets> Buckets;
+		};
+
+		// Zero initialised, they have static storage
+		static std::array<std::atomic<int64_t>, (size_t)Counter::Count>		Counters;
+		static std::array<AtomicHistogram, (size_t)Histogram::Count>		Histograms;
+
+		static size_t GetBucket(uint64_t Value)
+		{
+			size_t Bucket = 0;
+			while (Value > 0 && Bucket < HistogramBuckets - 1)
+			{
+				Value >>= 1;
+				Bucket++;
+			}
+
+			return Bucket;
+		}
+
+		void Add(Counter Which, int64_t Delta)
+		{
+			Counters[(size_t)Which].fetch_add(Delta, std::memory_order_relaxed);
+		}
+
+		void Record(Histogram Which, uint64_t Microseconds)
+		{
+			auto& Target = Histograms[(size_t)Which];
+
+			Target.Count.fetch_add(1, std::memory_order_relaxed);
+			Target.Sum.fetch_add(Microseconds, std::memory_order_relaxed);
+			Target.Buckets[GetBucket(Microseconds)].fetch_add(1, std::memory_order_relaxed);
+
+			uint64_t Max = Target.Max.load(std::memory_order_relaxed);
+			while (Microseconds > Max && !Target.Max.compare_exchange_weak(Max, Microseconds, std::memory_order_relaxed))
+			{
+			}
+		}
+
+		void Reset()
+		{
+			for (size_t i = (size_t)Counter::JobsSucceeded; i < (size_t)Counter::Count; i++)
+			{
+				Counters[i].store(0, std::memory_order_relaxed);
+			}
+
+			for (auto& Target : Histograms)
+			{
+				Target.Count.store(0, std::memory_order_relaxed);
+				Target.Sum.store(0, std::memory_order_relaxed);
+				Target.Max.store(0, std::memory_order_relaxed);
+
+				for (auto& Bucket : Target.Buckets)
+				{
+					Bucket.store(0, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		const char* GetName(Counter Which)
+		{
+			switch (Which)
+			{
+			case Counter::QueueDepth:			return "Queue Depth";
+			case Counter::LiveHeightmaps:		return "Live Heightmaps";
+			case Counter::DeviceBytesAllocated:	return "Device Bytes Allocated";
+			case Counter::JobsSucceeded:		return "Jobs Succeeded";
+			case Counter::JobsFailed:			return "Jobs Failed";
+			case Counter::JobsCancelled:		return "Jobs Cancelled";
+			case Counter::BytesUploaded:		return "Bytes Uploaded";
+			case Counter::BytesDownloaded:		return "Bytes Downloaded";
+			case Counter::ProgramBuilds:		return "Program Builds";
+			case Counter::ProgramCacheHits:		return "Program Cache Hits";
+			case Counter::KernelDispatches:		return "Kernel Dispatches";
+			default:							return "Unknown";
+			}
+		}
+
+		const char* GetName(Histogram Which)
+		{
+			switch (Which)
+			{
+			case Histogram::KernelTime:		return "Kernel Time";
+			case Histogram::TransferTime:	return "Transfer Time";
+			case Histogram::JobTime:		return "Job Time";
+			case Histogram::BuildTime:		return "Build Time";
+			default:						return "Unknown";
+			}
+		}
+
+		uint64_t HistogramSnapshot::Percentile(double Fraction) const
+		{
+			const uint64_t Target = (uint64_t)(Fraction * Count);
+			uint64_t Seen = 0;
+
+			for (size_t i = 0; i < HistogramBuckets; i++)
+			{
+				Seen += Buckets[i];
+				if (Seen > Target)
+					return i == 0 ? 1 : std::min<uint64_t>(1ull << i, Max);
+			}
+
+			return Max;
+		}
+
+		Snapshot TakeSnapshot()
+		{
+			Snapshot Out;
+
+			for (size_t i = 0; i < (size_t)Counter::Count; i++)
+			{
+				Out.Counters[i] = Counters[i].load(std::memory_order_relaxed);
+			}
+
+			for (size_t i = 0; i < (size_t)Histogram::Count; i++)
+			{
+				auto& Source = Histograms[i];
+				auto& Target = Out.Histograms[i];
+
+				Target.Count	= Source.Count.load(std::memory_order_relaxed);
+				Target.Sum		= Source.Sum.load(std::memory_order_relaxed);
+				Target.Max		= Source.Max.load(std::memory_order_relaxed);
+
+				for (size_t b = 0; b < HistogramBuckets; b++)
+				{
+					Target.Buckets[b] = Source.Buckets[b].load(std::memory_order_relaxed);
+				}
+			}
+
+			return Out;
+		}
+
+		std::string ToString(const Snapshot& InSnapshot)
+		{
+			std::ostringstream Out;
+
+			for (size_t i = 0; i < (size_t)Counter::Count; i++)
+			{
+				Out << GetName((Counter)i) << ": " << InSnapshot.Counters[i] << "\n";
+			}
+
+			for (size_t i = 0; i < (size_t)Histogram::Count; i++)
+			{
+				const auto& Target = InSnapshot.Histograms[i];
+
+				Out << GetName((Histogram)i) << ": " << Target.Count << " samples"
+					<< ", mean " << Target.Mean() << " us"
+					<< ", p50 " << Target.Percentile(0.5) << " us"
+					<< ", p99 " << Target.Percentile(0.99) << " us"
+					<< ", max " << Target.Max << " us\n";
+			}
+
+			return Out.str();
+		}
+
+		TrackedAllocation::TrackedAllocation(size_t Bytes)
+			: Bytes(Bytes)
+		{
+			Add(Counter::LiveHeightmaps, 1);
+			Add(Counter::DeviceBytesAllocated, (int64_t)Bytes);
+		}
+
+		TrackedAllocation::TrackedAllocation(const TrackedAllocation& Other)
+			: TrackedAllocation(Other.Bytes)
+		{
+		}
+
+		TrackedAllocation& TrackedAllocation::operator=(const TrackedAllocation& Other)
+		{
+			Add(Counter::DeviceBytesAllocated, (int64_t)Other.Bytes - (int64_t)Bytes);
+			Bytes = Other.Bytes;
+
+			return *this;
+		}
+
+		TrackedAllocation::~TrackedAllocation()
+		{
+			Add(Counter::LiveHeightmaps, -1);
+			Add(Counter::DeviceBytesAllocated, -(int64_t)Bytes);
+		}
+	}
+}
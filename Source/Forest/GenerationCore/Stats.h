@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace LandscapeGeneration
+{
+	// Counters and histograms that are always on, cheap enough to update from
+	// the kernel thread for every kernel (relaxed atomics, no locks). Read them
+	// with TakeSnapshot, the Unreal adapter also publishes them as STAT counters
+	namespace Stats
+	{
+		enum class Counter : uint8_t
+		{
+			// Gauges, these go up and down
+			QueueDepth,
+			LiveHeightmaps,
+			DeviceBytesAllocated,
+
+			// Totals since the last Reset
+			JobsSucceeded,
+			JobsFailed,
+			JobsCancelled,
+			BytesUploaded,
+			BytesDownloaded,
+			ProgramBuilds,
+			ProgramCacheHits,
+			KernelDispatches,
+
+			Count
+		};
+
+		// All in microseconds
+		enum class Histogram : uint8_t
+		{
+			KernelTime,		// Device time of each kernel
+			TransferTime,	// Device time of each read or write
+			JobTime,		// Host time of each job on the kernel thread
+			BuildTime,		// Host time of each program build
+
+			Count
+		};
+
+		// Bucket i counts values in [2^(i - 1), 2^i), bucket 0 is everything under 1
+		static const size_t HistogramBuckets = 32;
+
+		void Add(Counter Which, int64_t Delta);
+		void Record(Histogram Which, uint64_t Microseconds);
+
+		// Zeroes the totals and histograms, gauges are left alone
+		void Reset();
+
+		const char* GetName(Counter Which);
+		const char* GetName(Histogram Which);
+
+		struct HistogramSnapshot
+		{
+			uint64_t	Count	= 0;
+			uint64_t	Sum		= 0;
+			uint64_t	Max		= 0;
+			std::array<uint64_t, HistogramBuckets> Buckets = {};
+
+			double Mean() const { return Count > 0 ? (double)Sum / Count : 0.0; }
+
+			// Upper bound of the bucket the Fraction'th value falls in
+			uint64_t Percentile(double Fraction) const;
+		};
+
+		// Each value is read atomically, but not all of them at the same instant
+		struct Snapshot
+		{
+			std::array<int64_t, (size_t)Counter::Count>				Counters = {};
+			std::array<HistogramSnapshot, (size_t)Histogram::Count>	Histograms;
+
+			int64_t Get(Counter Which) const { return Counters[(size_t)Which]; }
+			const HistogramSnapshot& Get(Histogram Which) const { return Histograms[(size_t)Which]; }
+		};
+
+		Snapshot TakeSnapshot();
+
+		// One line per counter and histogram, for logs and console output
+		std::string ToString(const Snapshot& InSnapshot);
+
+		// Keeps DeviceBytesAllocated and LiveHeightmaps up to date for as long as
+		// it's alive, copies count as another allocation
+		class TrackedAllocation
+		{
+		public:
+			explicit TrackedAllocation(size_t Bytes = 0);
+			TrackedAllocation(const TrackedAllocation& Other);
+			TrackedAllocation& operator=(const TrackedAllocation& Other);
+			~TrackedAllocation();
+
+		private:
+			size_t Bytes;
+		};
+	}
+}
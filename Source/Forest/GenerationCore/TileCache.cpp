@@ -0,0 +1,187 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TileCache.h"
+
+#include <cassert>
+#include <cstring>
+
+using namespace std;
+namespace compute = boost::compute;
+
+namespace LandscapeGeneration
+{
+	// FNV-1a, good enough to tell graph parameters apart
+	template<class T>
+	static uint64_t HashCombine(uint64_t Hash, const T& Value)
+	{
+		uint8_t Bytes[sizeof(T)];
+		memcpy(Bytes, &Value, sizeof(T));
+
+		for (size_t i = 0; i < sizeof(T); i++)
+		{
+			Hash ^= Bytes[i];
+			Hash *= 1099511628211ull;
+		}
+
+		return Hash;
+	}
+
+	static const uint64_t HashBasis = 14695981039346656037ull;
+
+	TileGraph PerlinTileGraph(float noiseSize, int32_t seed, int32_t depth, float amplitude)
+	{
+		TileGraph Graph;
+		Graph.Hash = HashCombine(HashCombine(HashCombine(HashCombine(HashCombine(HashBasis,
+			'P'), noiseSize), seed), depth), amplitude);
+		Graph.Evaluate = [=](compute::image2d& Out, const Kernels::TileRegion& Region)
+		{
+			Kernels::PerlinNoise(Out, noiseSize, seed, depth, amplitude, Region);
+		};
+
+		return Graph;
+	}
+
+	TileGraph WarpedPerlinTileGraph(float noiseSize, int32_t seed, int32_t depth, float amplitude,
+		const Kernels::WarpFieldSettings& Warp)
+	{
+		TileGraph Graph;
+		Graph.Hash = HashCombine(HashCombine(HashCombine(HashCombine(HashCombine(HashCombine(HashCombine(HashBasis,
+			'W'), noiseSize), seed), depth), amplitude), Warp.Downsample), Warp.Depth);
+		Graph.Evaluate = [=](compute::image2d& Out, const Kernels::TileRegion& Region)
+		{
+			Kernels::WarpedPerlinNoise(Out, noiseSize, seed, depth, amplitude, Region, Warp);
+		};
+
+		return Graph;
+	}
+
+	TileGraph SimplexTileGraph(float noiseSize, int32_t seed, int32_t depth, float amplitude)
+	{
+		TileGraph Graph;
+		Graph.Hash = HashCombine(HashCombine(HashCombine(HashCombine(HashCombine(HashBasis,
+			'S'), noiseSize), seed), depth), amplitude);
+		Graph.Evaluate = [=](compute::image2d& Out, const Kernels::TileRegion& Region)
+		{
+			Kernels::SimplexNoise(Out, noiseSize, seed, depth, amplitude, Region);
+		};
+
+		return Graph;
+	}
+
+	TileGraph GradientTileGraph(float noiseSize, int32_t seed, int32_t depth, float amplitude)
+	{
+		TileGraph Graph;
+		Graph.Hash = HashCombine(HashCombine(HashCombine(HashCombine(HashCombine(HashBasis,
+			'G'), noiseSize), seed), depth), amplitude);
+		Graph.Evaluate = [=](compute::image2d& Out, const Kernels::TileRegion& Region)
+		{
+			Kernels::GradientNoise(Out, noiseSize, seed, depth, amplitude, Region);
+		};
+
+		return Graph;
+	}
+
+	TileGraph VoronoiTileGraph(int32_t noiseSize, int32_t seed, float amplitude)
+	{
+		TileGraph Graph;
+		Graph.Hash = HashCombine(HashCombine(HashCombine(HashCombine(HashBasis,
+			'V'), noiseSize), seed), amplitude);
+		Graph.Evaluate = [=](compute::image2d& Out, const Kernels::TileRegion& Region)
+		{
+			Kernels::VoronoiNoise(Out, noiseSize, seed, amplitude, Region);
+		};
+
+		return Graph;
+	}
+
+	TileGraph MixTileGraph(const TileGraph& L, const TileGraph& R, MixOperation MixType)
+	{
+		TileGraph Graph;
+		Graph.Hash = HashCombine(HashCombine(HashCombine(HashCombine(HashBasis,
+			'M'), L.Hash), R.Hash), MixType);
+		Graph.Evaluate = [=](compute::image2d& Out, const Kernels::TileRegion& Region)
+		{
+			auto LTile = CreateHeightmap((int32_t)Out.width(), (int32_t)Out.height());
+			auto RTile = CreateHeightmap((int32_t)Out.width(), (int32_t)Out.height());
+
+			L.Evaluate(LTile->Image, Region);
+			R.Evaluate(RTile->Image, Region);
+
+			Kernels::Mix(LTile->Image, RTile->Image, Out, MixType);
+		};
+
+		return Graph;
+	}
+
+	TileCache::TileCache(int32_t TileSize, int32_t Border, int32_t MaxTiles)
+		: TileSize(TileSize)
+		, Border(Border)
+		, MaxTiles(MaxTiles)
+	{
+		assert(TileSize > 0 && Border >= 0 && MaxTiles > 0);
+	}
+
+	Kernels::TileRegion TileCache::GetTileRegion(int32_t TileX, int32_t TileY, int32_t LOD) const
+	{
+		Kernels::TileRegion Region;
+		Region.Step		= 1 << LOD;
+		Region.OriginX	= TileX * TileSize * Region.Step;
+		Region.OriginY	= TileY * TileSize * Region.Step;
+
+		return Region;
+	}
+
+	std::shared_ptr<Heightmap> TileCache::FindTile(const TileGraph& Graph, int32_t TileX, int32_t TileY, int32_t LOD)
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+
+		auto Found = Tiles.find(KeyType(Graph.Hash, TileX, TileY, LOD));
+		if (Found == Tiles.end())
+			return nullptr;
+
+		LRU.splice(LRU.begin(), LRU, Found->second.LRUIt);
+		return Found->second.Tile;
+	}
+
+	std::shared_ptr<Heightmap> TileCache::GetTile(const TileGraph& Graph, int32_t TileX, int32_t TileY, int32_t LOD)
+	{
+		if (auto Found = FindTile(Graph, TileX, TileY, LOD))
+			return Found;
+
+		// Evaluate outside of the lock, this is the slow part
+		auto Tile = CreateHeightmap(GetTileResolution(), GetTileResolution());
+		Graph.Evaluate(Tile->Image, GetTileRegion(TileX, TileY, LOD));
+
+		std::lock_guard<std::mutex> Lock(Mutex);
+
+		const KeyType Key(Graph.Hash, TileX, TileY, LOD);
+
+		// Someone else might have evaluated the same tile in the meantime
+		auto Found = Tiles.find(Key);
+		if (Found != Tiles.end())
+		{
+			LRU.splice(LRU.begin(), LRU, Found->second.LRUIt);
+			return Found->second.Tile;
+		}
+
+		LRU.push_front(Key);
+		Tiles[Key] = CachedTile{ Tile, LRU.begin() };
+
+		// Evicted tiles stay alive for as long as someone still holds them
+		while ((int32_t)LRU.size() > MaxTiles)
+		{
+			Tiles.erase(LRU.back());
+			LRU.pop_back();
+		}
+
+		return Tile;
+	}
+
+	void TileCache::Clear()
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+
+		Tiles.clear();
+		LRU.clear();
+	}
+}
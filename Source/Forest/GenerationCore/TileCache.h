@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "LandscapeGenerationCore.h"
+
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+namespace LandscapeGeneration
+{
+	// Something that can be evaluated over any region of the world, e.g. a
+	// noise function or a mix of several of them. Hash identifies the graph
+	// and its parameters, two graphs with the same hash must produce the same
+	// heights
+	struct TileGraph
+	{
+		uint64_t Hash = 0;
+		std::function<void(boost::compute::image2d& Out, const Kernels::TileRegion& Region)> Evaluate;
+	};
+
+	TileGraph PerlinTileGraph(float noiseSize, int32_t seed, int32_t depth, float amplitude);
+	TileGraph WarpedPerlinTileGraph(float noiseSize, int32_t seed, int32_t depth, float amplitude,
+		const Kernels::WarpFieldSettings& Warp = Kernels::WarpFieldSettings());
+	TileGraph SimplexTileGraph(float noiseSize, int32_t seed, int32_t depth, float amplitude);
+	TileGraph GradientTileGraph(float noiseSize, int32_t seed, int32_t depth, float amplitude);
+	TileGraph VoronoiTileGraph(int32_t noiseSize, int32_t seed, float amplitude);
+	TileGraph MixTileGraph(const TileGraph& L, const TileGraph& R, MixOperation MixType);
+
+	// Evaluates tiles of a graph on demand and keeps the most recently used
+	// ones around. Tile (TileX, TileY) at LOD covers TileSize << LOD world
+	// pixels starting at (TileX, TileY) * (TileSize << LOD), sampled every
+	// 1 << LOD pixels. Each tile image is TileSize + Border pixels wide so
+	// neighbouring tiles can share their edge vertices.
+	// GetTile runs kernels, so it should be called from the kernel thread
+	class TileCache
+	{
+	public:
+		TileCache(int32_t TileSize, int32_t Border = 1, int32_t MaxTiles = 256);
+
+		std::shared_ptr<Heightmap> GetTile(const TileGraph& Graph, int32_t TileX, int32_t TileY, int32_t LOD);
+
+		// Returns the tile if it's already been evaluated, without evaluating it
+		std::shared_ptr<Heightmap> FindTile(const TileGraph& Graph, int32_t TileX, int32_t TileY, int32_t LOD);
+
+		Kernels::TileRegion GetTileRegion(int32_t TileX, int32_t TileY, int32_t LOD) const;
+
+		void Clear();
+
+		int32_t GetTileSize() const { return TileSize; }
+		int32_t GetTileResolution() const { return TileSize + Border; }
+
+	private:
+		using KeyType = std::tuple<uint64_t, int32_t, int32_t, int32_t>;
+
+		struct CachedTile
+		{
+			std::shared_ptr<Heightmap>		Tile;
+			std::list<KeyType>::iterator	LRUIt;
+		};
+
+		int32_t							TileSize;
+		int32_t							Border;
+		int32_t							MaxTiles;
+
+		std::map<KeyType, CachedTile>	Tiles;
+		// Front is the most recently used tile
+		std::list<KeyType>				LRU;
+
+		std::mutex						Mutex;
+	};
+}
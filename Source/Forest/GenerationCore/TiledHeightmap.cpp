@@ -0,0 +1,183 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TiledHeightmap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace LandscapeGeneration
+{
+	TiledHeightmap::TiledHeightmap(int32_t SizeX, int32_t SizeY, int32_t TileSize, int32_t Channels,
+		const std::string& BackingFile, int32_t MaxResidentTiles)
+		: SizeX(SizeX)
+		, SizeY(SizeY)
+		, TileSize(TileSize)
+		, Channels(Channels)
+		, TilesX((SizeX + TileSize - 1) / TileSize)
+		, TilesY((SizeY + TileSize - 1) / TileSize)
+		, MaxResidentTiles(std::max(MaxResidentTiles, 1))
+		, BackingFileName(BackingFile)
+	{
+		assert(SizeX > 0 && SizeY > 0 && TileSize > 0 && Channels > 0);
+
+		Tiles.resize((size_t)TilesX * TilesY);
+
+		if (!BackingFileName.empty())
+		{
+			this->BackingFile.open(BackingFileName,
+				std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+
+			if (!this->BackingFile.is_open())
+				throw std::runtime_error("Failed to open tiled heightmap backing file " + BackingFileName);
+		}
+	}
+
+	TiledHeightmap::~TiledHeightmap()
+	{
+		if (BackingFile.is_open())
+		{
+			BackingFile.close();
+			std::remove(BackingFileName.c_str());
+		}
+	}
+
+	TiledHeightmap::Tile& TiledHeightmap::FetchTile(int32_t TileX, int32_t TileY)
+	{
+		const int32_t Index = TileY * TilesX + TileX;
+		Tile& FoundTile = Tiles[Index];
+
+		if (FoundTile.bResident)
+		{
+			// Move it to the front of the LRU list
+			ResidentTiles.splice(ResidentTiles.begin(), ResidentTiles, FoundTile.ResidentIt);
+			return FoundTile;
+		}
+
+		FoundTile.Data.assign(TileFloats(), 0.f);
+
+		if (FoundTile.bOnDisk)
+		{
+			BackingFile.clear();
+			BackingFile.seekg((std::streamoff)Index * TileFloats() * sizeof(float));
+			BackingFile.read((char*)FoundTile.Data.data(), TileFloats() * sizeof(float));
+		}
+
+		ResidentTiles.push_front(Index);
+		FoundTile.ResidentIt	= ResidentTiles.begin();
+		FoundTile.bResident		= true;
+		FoundTile.bDirty		= false;
+
+		EvictTiles();
+
+		return FoundTile;
+	}
+
+	void TiledHeightmap::EvictTiles()
+	{
+		// Without a backing file everything has to stay in memory
+		if (!BackingFile.is_open())
+			return;
+
+		while ((int32_t)ResidentTiles.size() > MaxResidentTiles)
+		{
+			const int32_t Index = ResidentTiles.back();
+			Tile& EvictedTile = Tiles[Index];
+
+			if (EvictedTile.bDirty)
+			{
+				BackingFile.clear();
+				BackingFile.seekp((std::streamoff)Index * TileFloats() * sizeof(float));
+				BackingFile.write((const char*)EvictedTile.Data.data(), TileFloats() * sizeof(float));
+				EvictedTile.bOnDisk = true;
+			}
+
+			std::vector<float>().swap(EvictedTile.Data);
+			EvictedTile.bResident	= false;
+			EvictedTile.bDirty		= false;
+
+			ResidentTiles.pop_back();
+		}
+	}
+
+	void TiledHeightmap::ReadRegion(int32_t X, int32_t Y, int32_t W, int32_t H, float* Out)
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+
+		for (int32_t OutY = 0; OutY < H; OutY++)
+		{
+			const int32_t SrcY	= std::min(std::max(Y + OutY, 0), SizeY - 1);
+			const int32_t LocalY	= SrcY % TileSize;
+			float* OutRow		= Out + (size_t)OutY * W * Channels;
+
+			int32_t OutX = 0;
+			while (OutX < W)
+			{
+				const int32_t WorldX = X + OutX;
+
+				// Outside of the heightmap, replicate the edge pixel
+				if (WorldX < 0 || WorldX >= SizeX)
+				{
+					const int32_t SrcX = std::min(std::max(WorldX, 0), SizeX - 1);
+					const Tile& SrcTile = FetchTile(SrcX / TileSize, SrcY / TileSize);
+
+					memcpy(OutRow + (size_t)OutX * Channels,
+						SrcTile.Data.data() + ((size_t)LocalY * TileSize + SrcX % TileSize) * Channels,
+						Channels * sizeof(float));
+
+					OutX++;
+					continue;
+				}
+
+				// Copy the longest span that stays inside of one tile
+				const int32_t LocalX	= WorldX % TileSize;
+				const int32_t Span	= std::min(W - OutX, std::min(TileSize - LocalX, SizeX - WorldX));
+				const Tile& SrcTile = FetchTile(WorldX / TileSize, SrcY / TileSize);
+
+				memcpy(OutRow + (size_t)OutX * Channels,
+					SrcTile.Data.data() + ((size_t)LocalY * TileSize + LocalX) * Channels,
+					(size_t)Span * Channels * sizeof(float));
+
+				OutX += Span;
+			}
+		}
+	}
+
+	void TiledHeightmap::WriteRegion(int32_t X, int32_t Y, int32_t W, int32_t H, const float* In)
+	{
+		std::lock_guard<std::mutex> Lock(Mutex);
+
+		const int32_t BeginX	= std::max(X, 0);
+		const int32_t EndX	= std::min(X + W, SizeX);
+
+		for (int32_t InY = 0; InY < H; InY++)
+		{
+			const int32_t DstY = Y + InY;
+
+			if (DstY < 0 || DstY >= SizeY)
+				continue;
+
+			const int32_t LocalY	= DstY % TileSize;
+			const float* InRow	= In + (size_t)InY * W * Channels;
+
+			int32_t WorldX = BeginX;
+			while (WorldX < EndX)
+			{
+				const int32_t LocalX	= WorldX % TileSize;
+				const int32_t Span	= std::min(EndX - WorldX, TileSize - LocalX);
+				Tile& DstTile		= FetchTile(WorldX / TileSize, DstY / TileSize);
+
+				memcpy(DstTile.Data.data() + ((size_t)LocalY * TileSize + LocalX) * Channels,
+					InRow + (size_t)(WorldX - X) * Channels,
+					(size_t)Span * Channels * sizeof(float));
+
+				DstTile.bDirty = true;
+				WorldX += Span;
+			}
+		}
+	}
+}
@@ -0,0 +1,90 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include <vector>
+#include <list>
+#include <mutex>
+#include <string>
+#include <fstream>
+#include <cstdint>
+
+namespace LandscapeGeneration
+{
+	// Host side heightmap that is split into square tiles so that terrains
+	// larger than a single device image (or larger than RAM) can be streamed
+	// through the kernels a piece at a time.
+	// Tiles are allocated the first time they're written to. If a backing file
+	// is given, the least recently used tiles are paged out to it once more
+	// than MaxResidentTiles are in memory. Tiles that were never written read
+	// back as zero.
+	class TiledHeightmap
+	{
+	public:
+		TiledHeightmap(
+			int32_t SizeX,
+			int32_t SizeY,
+			int32_t TileSize,
+			int32_t Channels = 1,
+			const std::string& BackingFile = std::string(),
+			int32_t MaxResidentTiles = 64
+		);
+
+		~TiledHeightmap();
+
+		TiledHeightmap(const TiledHeightmap&) = delete;
+		TiledHeightmap& operator=(const TiledHeightmap&) = delete;
+
+		// Copies W * H pixels starting at X, Y in to Out (W * H * Channels floats)
+		// Coordinates outside of the heightmap are clamped to the edge, the same
+		// way CLK_ADDRESS_CLAMP_TO_EDGE works in the kernels
+		void ReadRegion(int32_t X, int32_t Y, int32_t W, int32_t H, float* Out);
+
+		// Copies W * H pixels from In to the heightmap starting at X, Y.
+		// Pixels outside of the heightmap are ignored
+		void WriteRegion(int32_t X, int32_t Y, int32_t W, int32_t H, const float* In);
+
+		int32_t GetSizeX() const { return SizeX; }
+		int32_t GetSizeY() const { return SizeY; }
+		int32_t GetTileSize() const { return TileSize; }
+		int32_t GetChannels() const { return Channels; }
+		int32_t GetTilesX() const { return TilesX; }
+		int32_t GetTilesY() const { return TilesY; }
+
+	private:
+		struct Tile
+		{
+			std::vector<float>			Data;
+			std::list<int32_t>::iterator	ResidentIt;
+			bool						bResident	= false;
+			bool						bOnDisk		= false;
+			bool						bDirty		= false;
+		};
+
+		// Makes sure the tile is in memory and marks it as most recently used
+		Tile& FetchTile(int32_t TileX, int32_t TileY);
+
+		// Writes the least recently used tiles out to the backing file until
+		// we're under the resident tile budget
+		void EvictTiles();
+
+		size_t TileFloats() const { return (size_t)TileSize * TileSize * Channels; }
+
+		int32_t						SizeX;
+		int32_t						SizeY;
+		int32_t						TileSize;
+		int32_t						Channels;
+		int32_t						TilesX;
+		int32_t						TilesY;
+		int32_t						MaxResidentTiles;
+
+		std::vector<Tile>			Tiles;
+		// Front is the most recently used tile
+		std::list<int32_t>			ResidentTiles;
+
+		std::string					BackingFileName;
+		std::fstream				BackingFile;
+
+		std::mutex					Mutex;
+	};
+}
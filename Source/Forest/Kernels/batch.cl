@@ -0,0 +1,63 @@
+#include "perlin.h"
+
+// Batched kernels, built together with perlin.cl. Every layer of an
+// image2d_array is one seed or parameter set of the same node, the third
+// dimension of the NDRange picks the layer, so a whole batch is one dispatch
+
+const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+// seeds and scales (1 / size, amplitude) hold one entry per layer
+__kernel void perlin_layers(__write_only image2d_array_t heightOut,
+	__global const int* seeds,
+	__global const float2* scales,
+	int depth,
+	int originX,
+	int originY,
+	int step)
+{
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	const int layer = get_global_id(2);
+
+	const float wx = (float)(originX + x * step);
+	const float wy = (float)(originY + y * step);
+	const float2 scale = scales[layer];
+
+	const float out = perlin2d(wx, wy, scale.x, depth, seeds[layer]) * scale.y;
+
+	write_imagef(heightOut, (int4)(x, y, layer, 0), out);
+}
+
+// Averages every layer down to a thumbWidth x thumbHeight thumbnail, placed
+// left to right in strip starting at firstThumbnail. Each thumbnail pixel
+// covers at least one layer pixel
+__kernel void thumbnail_strip(__read_only image2d_array_t layers,
+	__write_only image2d_t strip,
+	int thumbWidth,
+	int thumbHeight,
+	int firstThumbnail)
+{
+	const int tx = get_global_id(0);
+	const int ty = get_global_id(1);
+	const int layer = get_global_id(2);
+
+	const int width = get_image_width(layers);
+	const int height = get_image_height(layers);
+
+	const int x0 = tx * width / thumbWidth;
+	const int x1 = max((tx + 1) * width / thumbWidth, x0 + 1);
+	const int y0 = ty * height / thumbHeight;
+	const int y1 = max((ty + 1) * height / thumbHeight, y0 + 1);
+
+	float sum = 0.f;
+	for (int y = y0; y < y1; y++)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			sum += read_imagef(layers, sampler, (int4)(x, y, layer, 0)).x;
+		}
+	}
+
+	const int2 coord = (int2)((firstThumbnail + layer) * thumbWidth + tx, ty);
+	write_imagef(strip, coord, sum / (float)((x1 - x0) * (y1 - y0)));
+}
@@ -1,58 +1,141 @@
-__kernel void box_filter(__read_only image2d_t input,
-		__write_only image2d_t output,
-		uint box_height,
-		uint box_width)
-{
-	int x = get_global_id(0);
-	int y = get_global_id(1);
-	int h = get_image_height(input);
-	int w = get_image_width(input);
-	int k = box_width;
-	int l = box_height;
-
-	/*if (x < k / 2 || y < l / 2 || x >= w - (k / 2) || y >= h - (l / 2)) {
-		write_imagef(output, (int2)(x, y), (float4)(0, 0, 0, 1));
+// Separable filters over single channel heightmaps. Every pass runs along
+// rows (horizontal != 0) or columns, one work item per segment of a line, and
+// costs the same per pixel whatever the radius. Reads past the edge of the
+// image return the edge pixel
+
+const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+inline int2 line_coord(int horizontal, int line, int pos)
+{
+	return horizontal ? (int2)(pos, line) : (int2)(line, pos);
+}
+
+inline float read_line(__read_only image2d_t input, int horizontal, int line, int pos)
+{
+	return read_imagef(input, sampler, line_coord(horizontal, line, pos)).x;
+}
+
+inline int line_length(__read_only image2d_t input, int horizontal)
+{
+	return horizontal ? get_image_width(input) : get_image_height(input);
+}
+
+inline int line_count(__read_only image2d_t input, int horizontal)
+{
+	return horizontal ? get_image_height(input) : get_image_width(input);
+}
+
+// Kahan summation, the running sum adds and removes thousands of values
+// along a line and would drift otherwise
+inline void kahan_add(float* sum, float* compensation, float value)
+{
+	const float y = value - *compensation;
+	const float t = *sum + y;
+	*compensation = (t - *sum) - y;
+	*sum = t;
+}
+
+// Mean of the 2 * radius + 1 pixels around each pixel. Each work item
+// starts a window at the beginning of its segment and slides it along, so a
+// pixel costs two reads. The host keeps segments at least as long as the
+// window, so starting the window is at most one more read per pixel
+__kernel void box_pass(__read_only image2d_t input,
+	__write_only image2d_t output,
+	int radius,
+	int horizontal,
+	int segment)
+{
+	const int line = get_global_id(0);
+	const int start = get_global_id(1) * segment;
+	const int length = line_length(input, horizontal);
+
+	if (line >= line_count(input, horizontal) || start >= length)
+		return;
+
+	const int end = min(start + segment, length);
+	const float scale = 1.f / (float)(2 * radius + 1);
+
+	float sum = 0.f;
+	float compensation = 0.f;
+
+	for (int i = start - radius; i <= start + radius; i++)
+	{
+		kahan_add(&sum, &compensation, read_line(input, horizontal, line, i));
 	}
-	else {
-		const sampler_t sampler = CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
-
-		float4 sum = { 0, 0, 0, 1 };
-		for (int i = 0; i < k; i++) {
-			for (int j = 0; j < l; j++) {
-				sum += read_imagef(input, sampler, (int2)(x + i - k, y + j - l));
-			}
-		}
-		sum /= (float)k * l;
-		float4 value = (float4)(sum.x, 0.f, 0.f, 1.f);
-		write_imagef(output, (int2)(x, y), value);
-	}*/
-
-	if (x < k / 2 || y < l / 2 || x >= w - (k / 2) || y >= h - (l / 2)) {
-		write_imageui(output, (int2)(x, y), (uint4)(0, 0, 0, 1));
+
+	for (int i = start; i < end; i++)
+	{
+		write_imagef(output, line_coord(horizontal, line, i), sum * scale);
+
+		kahan_add(&sum, &compensation, read_line(input, horizontal, line, i + radius + 1));
+		kahan_add(&sum, &compensation, -read_line(input, horizontal, line, i - radius));
+	}
+}
+
+// van Herk/Gil-Werman min/max filter. The line, padded by radius on both
+// sides, is split in to blocks of window = 2 * radius + 1 pixels. Every block
+// stores its running prefix and suffix min/max, then any window is covered by
+// the suffix of one block and the prefix of the next: three operations per
+// pixel whatever the radius.
+// prefix and suffix hold paddedLength floats per line
+inline float morph_op(float a, float b, int takeMin)
+{
+	return takeMin ? fmin(a, b) : fmax(a, b);
+}
+
+__kernel void vhgw_blocks(__read_only image2d_t input,
+	__global float* prefix,
+	__global float* suffix,
+	int radius,
+	int horizontal,
+	int paddedLength,
+	int takeMin)
+{
+	const int line = get_global_id(0);
+	const int block = get_global_id(1);
+	const int window = 2 * radius + 1;
+	const int first = block * window;
+
+	if (line >= line_count(input, horizontal) || first >= paddedLength)
+		return;
+
+	__global float* linePrefix = prefix + (size_t)line * paddedLength;
+	__global float* lineSuffix = suffix + (size_t)line * paddedLength;
+
+	const int last = min(first + window, paddedLength) - 1;
+
+	// Padded position i is pixel i - radius
+	float running = read_line(input, horizontal, line, first - radius);
+	linePrefix[first] = running;
+	for (int i = first + 1; i <= last; i++)
+	{
+		running = morph_op(running, read_line(input, horizontal, line, i - radius), takeMin);
+		linePrefix[i] = running;
 	}
-	else {
-		const sampler_t sampler = CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
-
-		uint4 sum = { 0, 0, 0, 1 };
-		for (int i = 0; i < k; i++) {
-			for (int j = 0; j < l; j++) {
-				sum += read_imageui(input, sampler, (int2)(x + i - k, y + j - l));
-			}
-		}
-		sum /= (uint)k * l;
-		uint4 value = (uint4)(sum.x, 0.f, 0.f, 1.f);
-		write_imageui(output, (int2)(x, y), value);
+
+	running = read_line(input, horizontal, line, last - radius);
+	lineSuffix[last] = running;
+	for (int i = last - 1; i >= first; i--)
+	{
+		running = morph_op(running, read_line(input, horizontal, line, i - radius), takeMin);
+		lineSuffix[i] = running;
 	}
-	
-	/*const sampler_t sampler = CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
-	uint4 value = (uint4)(0, 0, 0, 0);
-	value = read_imageui(input, sampler, (int2)(x, y));
-	value = value + (uint4)(x, 0, 0, 0);
-	write_imageui(output, (int2)(x, y), value);*/
-
-	/*const sampler_t sampler = CLK_ADDRESS_NONE | CLK_FILTER_NEAREST;
-	float4 value = (float4)(0, 0, 0, 0);
-	value = read_imagef(input, sampler, (int2)(x, y));
-	value = value + (float4)(x, 0, 0, 0);
-	write_imagef(output, (int2)(x, y), value);*/
-}
\ No newline at end of file
+}
+
+__kernel void vhgw_combine(__global const float* prefix,
+	__global const float* suffix,
+	__write_only image2d_t output,
+	int radius,
+	int horizontal,
+	int paddedLength,
+	int takeMin)
+{
+	const int pos = get_global_id(0);
+	const int line = get_global_id(1);
+
+	// The window of pixel pos is padded positions pos to pos + 2 * radius
+	const size_t base = (size_t)line * paddedLength;
+	const float value = morph_op(suffix[base + pos], prefix[base + pos + 2 * radius], takeMin);
+
+	write_imagef(output, line_coord(horizontal, line, pos), value);
+}
@@ -6,6 +6,19 @@
 
 const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_FILTER_NEAREST | CLK_ADDRESS_CLAMP_TO_EDGE;
 
+// Physical constants of the pipe model, can be overridden with -D
+#ifndef EROSION_GRAVITY
+#define EROSION_GRAVITY 9.80665f
+#endif
+
+#ifndef EROSION_PIPE_AREA
+#define EROSION_PIPE_AREA 20.f
+#endif
+
+#ifndef EROSION_PIPE_LENGTH
+#define EROSION_PIPE_LENGTH 5.f
+#endif
+
 // Take an input Water Height map and add a random amount of rain to it
 __kernel void rainfall(
 	__read_only image2d_t 	inWaterHeight, // These can be the same value
@@ -45,9 +58,9 @@ __kernel void flux(
 	int x = get_global_id(0);
 	int y = get_global_id(1);
 
-	const float grav = 9.80665f;
-	const float area = 20.f;
-	const float len = 5.f;
+	const float grav = EROSION_GRAVITY;
+	const float area = EROSION_PIPE_AREA;
+	const float len = EROSION_PIPE_LENGTH;
 
 	float4 lastflux = read_imagef(inFluxHeight, sampler, (int2)(x, y));
 
@@ -87,7 +100,7 @@ __kernel void calculate_k_factor(
 	int x = get_global_id(0);
 	int y = get_global_id(1);
 
-	const float len = 5.f;
+	const float len = EROSION_PIPE_LENGTH;
 
 	float waterHeight = read_imagef(inWaterHeight, sampler, (int2)(x, y)).x;
 	float4 flux = read_imagef(inFluxHeight, sampler, (int2)(x, y));
@@ -113,7 +126,7 @@ __kernel void calculate_water_height_change(
 	int x = get_global_id(0);
 	int y = get_global_id(1);
 
-	const float len = 5.f;
+	const float len = EROSION_PIPE_LENGTH;
 
 	// fluxImg.x = fL
 	// fluxImg.y = fR
@@ -0,0 +1,243 @@
+#include "vector.h"
+
+// Row variants of the erosion kernels, built together with perlin.cl and
+// erosion.cl for the sampler and the constants.
+// Single channel maps are row-major buffers. Flux and velocity are planes in
+// the order of the image channels (left, right, bottom, top), pack_planes and
+// unpack_planes move them in and out of the RGBA images
+
+__kernel void unpack_planes(__read_only image2d_t input,
+	__global float* planes,
+	int planeCount)
+{
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	const int width = get_image_width(input);
+	const int height = get_image_height(input);
+
+	const float4 value = read_imagef(input, sampler, (int2)(x, y));
+	const float channels[4] = { value.x, value.y, value.z, value.w };
+
+	for (int p = 0; p < planeCount; p++)
+	{
+		map_plane(planes, width, height, p)[(size_t)y * width + x] = channels[p];
+	}
+}
+
+// Channels past planeCount are written as 0
+__kernel void pack_planes(__global const float* planes,
+	__write_only image2d_t output,
+	int planeCount)
+{
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+	const int width = get_image_width(output);
+	const int height = get_image_height(output);
+
+	float channels[4] = { 0.f, 0.f, 0.f, 0.f };
+	for (int p = 0; p < planeCount; p++)
+	{
+		channels[p] = map_plane(planes, width, height, p)[(size_t)y * width + x];
+	}
+
+	write_imagef(output, (int2)(x, y), (float4)(channels[0], channels[1], channels[2], channels[3]));
+}
+
+__kernel void rainfall_rows(__global float* water,
+	int width,
+	int height,
+	uint seed,
+	float deltaTime,
+	float waterMul)
+{
+	const int x = row_x();
+	const int y = get_global_id(1);
+
+	store_row(load_row(water, width, height, x, y, 0) + waterMul * deltaTime, water, width, x, y);
+}
+
+__kernel void flux_rows(__global const float* terrain,
+	__global const float* water,
+	__global const float* inFlux,
+	__global float* outFlux,
+	int width,
+	int height,
+	float deltaTime)
+{
+	const int x = row_x();
+	const int y = get_global_id(1);
+
+	const float grav = EROSION_GRAVITY;
+	const float area = EROSION_PIPE_AREA;
+	const float len = EROSION_PIPE_LENGTH;
+
+	const floatN level = load_row(terrain, width, height, x, y, 0) + load_row(water, width, height, x, y, 0);
+
+	const floatN levelAdj[4] =
+	{
+		load_row(terrain, width, height, x, y, -1) + load_row(water, width, height, x, y, -1),
+		load_row(terrain, width, height, x, y, 1) + load_row(water, width, height, x, y, 1),
+		load_row(terrain, width, height, x, y - 1, 0) + load_row(water, width, height, x, y - 1, 0),
+		load_row(terrain, width, height, x, y + 1, 0) + load_row(water, width, height, x, y + 1, 0)
+	};
+
+	for (int p = 0; p < 4; p++)
+	{
+		const floatN lastFlux = load_row(map_plane(inFlux, width, height, p), width, height, x, y, 0);
+		const floatN fluxHeight = fmax(lastFlux + (deltaTime * area * ((grav * (level - levelAdj[p])) / len)), 0.f);
+
+		store_row(fluxHeight, map_plane(outFlux, width, height, p), width, x, y);
+	}
+}
+
+__kernel void k_factor_rows(__global const float* water,
+	__global float* flux,
+	int width,
+	int height,
+	float deltaTime)
+{
+	const int x = row_x();
+	const int y = get_global_id(1);
+
+	const float len = EROSION_PIPE_LENGTH;
+
+	floatN planes[4];
+	for (int p = 0; p < 4; p++)
+	{
+		planes[p] = load_row(map_plane(flux, width, height, p), width, height, x, y, 0);
+	}
+
+	const floatN waterHeight = load_row(water, width, height, x, y, 0);
+	const floatN fluxAdd = fmax(planes[0] + planes[1] + planes[2] + planes[3], 0.001f);
+	const floatN K = fmin((waterHeight * len) / (fluxAdd * deltaTime), 1.f);
+
+	for (int p = 0; p < 4; p++)
+	{
+		store_row(planes[p] * K, map_plane(flux, width, height, p), width, x, y);
+	}
+}
+
+__kernel void water_height_rows(__global float* water,
+	__global const float* flux,
+	int width,
+	int height,
+	float deltaTime)
+{
+	const int x = row_x();
+	const int y = get_global_id(1);
+
+	const float len = EROSION_PIPE_LENGTH;
+
+	__global const float* fluxL = map_plane(flux, width, height, 0);
+	__global const float* fluxR = map_plane(flux, width, height, 1);
+	__global const float* fluxB = map_plane(flux, width, height, 2);
+	__global const float* fluxT = map_plane(flux, width, height, 3);
+
+	// The neighbours' flux towards this pixel
+	const floatN fluxIn =
+		  load_row(fluxR, width, height, x, y, -1)		// Left
+		+ load_row(fluxL, width, height, x, y, 1)		// Right
+		+ load_row(fluxT, width, height, x, y - 1, 0)	// Bottom
+		+ load_row(fluxB, width, height, x, y + 1, 0);	// Top
+
+	const floatN fluxOut =
+		  load_row(fluxL, width, height, x, y, 0)
+		+ load_row(fluxR, width, height, x, y, 0)
+		+ load_row(fluxB, width, height, x, y, 0)
+		+ load_row(fluxT, width, height, x, y, 0);
+
+	const floatN waterDif = (fluxIn - fluxOut) * deltaTime;
+
+	store_row(load_row(water, width, height, x, y, 0) + (waterDif / (len * len)), water, width, x, y);
+}
+
+// Only the x and y planes of velocity are written
+__kernel void velocity_rows(__global const float* flux,
+	__global float* velocity,
+	int width,
+	int height)
+{
+	const int x = row_x();
+	const int y = get_global_id(1);
+
+	__global const float* fluxL = map_plane(flux, width, height, 0);
+	__global const float* fluxR = map_plane(flux, width, height, 1);
+	__global const float* fluxB = map_plane(flux, width, height, 2);
+	__global const float* fluxT = map_plane(flux, width, height, 3);
+
+	const floatN adjL = load_row(fluxR, width, height, x, y, -1);
+	const floatN adjR = load_row(fluxL, width, height, x, y, 1);
+	const floatN adjB = load_row(fluxT, width, height, x, y - 1, 0);
+	const floatN adjT = load_row(fluxB, width, height, x, y + 1, 0);
+
+	const floatN velocityX = ((adjL - load_row(fluxL, width, height, x, y, 0)) + (load_row(fluxR, width, height, x, y, 0) - adjR)) / 2.f;
+	const floatN velocityY = ((adjB - load_row(fluxB, width, height, x, y, 0)) + (load_row(fluxT, width, height, x, y, 0) - adjT)) / 2.f;
+
+	store_row(velocityX, map_plane(velocity, width, height, 0), width, x, y);
+	store_row(velocityY, map_plane(velocity, width, height, 1), width, x, y);
+}
+
+// lmax in erosion.cl, one lane per pixel
+inline floatN lmax_rows(floatN waterHeight, float maxErosionDepth)
+{
+	floatN depth = 1.f - ((maxErosionDepth - waterHeight) / maxErosionDepth);
+	depth = select(depth, (floatN)(1.f), waterHeight >= maxErosionDepth);
+	return select(depth, (floatN)(0.f), waterHeight <= 0.f);
+}
+
+__kernel void sediment_capacity_rows(float sedimentCapacity,
+	float maxErosionDepth,
+	__global const float* water,
+	__global const float* velocity,
+	__global float* outSedimentCapacity,
+	int width,
+	int height)
+{
+	const int x = row_x();
+	const int y = get_global_id(1);
+
+	const floatN velocityX = load_row(map_plane(velocity, width, height, 0), width, height, x, y, 0);
+	const floatN velocityY = load_row(map_plane(velocity, width, height, 1), width, height, x, y, 0);
+	const floatN waterHeight = load_row(water, width, height, x, y, 0);
+
+	const floatN capacity = sedimentCapacity * sqrt(velocityX * velocityX + velocityY * velocityY) * lmax_rows(waterHeight, maxErosionDepth);
+
+	store_row(capacity, outSedimentCapacity, width, x, y);
+}
+
+__kernel void erosion_deposition_rows(__global float* terrain,
+	__global const float* hardness,
+	__global const float* inSediment,
+	__global float* outSediment,
+	__global const float* inSedimentCapacity,
+	__global float* water,
+	int width,
+	int height,
+
+	float depositionSpeed,
+	float sedimentCoefficient,
+	float softeningCoefficient,
+	float hardnessMin,
+	float deltaTime)
+{
+	const int x = row_x();
+	const int y = get_global_id(1);
+
+	const floatN sediment = load_row(inSediment, width, height, x, y, 0);
+	const floatN sedimentCapacity = load_row(inSedimentCapacity, width, height, x, y, 0);
+
+	// Rt+∆t(x, y) = max(Rmin,Rt(x, y) − (∆t ·Kh * Ks(st −C)))
+	const floatN hardnessCoefficient = fmax(load_row(hardness, width, height, x, y, 0)
+		- (deltaTime * softeningCoefficient * sedimentCoefficient * (sediment - sedimentCapacity)), hardnessMin);
+
+	// ∆t · Rt(x, y) · Ks(C − st) is picked up below the capacity,
+	// ∆t · Kd(st − C) is deposited above it
+	const floatN diff = select(
+		-(deltaTime * depositionSpeed * (sediment - sedimentCapacity)),
+		deltaTime * hardnessCoefficient * sedimentCoefficient * (sedimentCapacity - sediment),
+		sediment < sedimentCapacity);
+
+	store_row(load_row(terrain, width, height, x, y, 0) - diff, terrain, width, x, y);
+	store_row(sediment + diff, outSediment, width, x, y);
+	store_row(load_row(water, width, height, x, y, 0) + diff, water, width, x, y);
+}
@@ -0,0 +1,194 @@
+// Simplex and gradient noise. Every work group stages the permutation table
+// (shuffled on the host from the seed) in to local memory, indices wrap with
+// a mask because the table size is a power of two. Octaves are evaluated four
+// at a time as float4, so one pass over the corners covers four octaves
+
+#define PERM_SIZE 256
+#define PERM_MASK (PERM_SIZE - 1)
+
+// Per octave offsets, so the octaves don't all have a lattice point at the origin
+#define OCTAVE_OFFSET ((float2)(31.7f, 17.3f))
+
+inline void stage_permutation(__global const uchar* permutation, __local uchar* perm)
+{
+	const int lid = get_local_id(1) * get_local_size(0) + get_local_id(0);
+	const int lsize = get_local_size(0) * get_local_size(1);
+
+	for (int i = lid; i < PERM_SIZE; i += lsize)
+	{
+		perm[i] = permutation[i];
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+inline int hash(__local const uchar* perm, int x, int y)
+{
+	return perm[(perm[x & PERM_MASK] + y) & PERM_MASK];
+}
+
+inline int4 hash4(__local const uchar* perm, int4 x, int4 y)
+{
+	return (int4)(hash(perm, x.x, y.x), hash(perm, x.y, y.y), hash(perm, x.z, y.z), hash(perm, x.w, y.w));
+}
+
+// Dot product with one of the four diagonal gradients
+inline float4 grad4(int4 h, float4 x, float4 y)
+{
+	return select(x, -x, (h & 1) != 0) + select(y, -y, (h & 2) != 0);
+}
+
+inline float4 fade4(float4 t)
+{
+	return t * t * t * (t * (t * 6.f - 15.f) + 10.f);
+}
+
+// -1 to 1
+inline float4 gradient4(__local const uchar* perm, float4 x, float4 y)
+{
+	const float4 fx = floor(x);
+	const float4 fy = floor(y);
+	const int4 ix = convert_int4(fx);
+	const int4 iy = convert_int4(fy);
+
+	const float4 x0 = x - fx;
+	const float4 y0 = y - fy;
+
+	const float4 n00 = grad4(hash4(perm, ix, iy), x0, y0);
+	const float4 n10 = grad4(hash4(perm, ix + 1, iy), x0 - 1.f, y0);
+	const float4 n01 = grad4(hash4(perm, ix, iy + 1), x0, y0 - 1.f);
+	const float4 n11 = grad4(hash4(perm, ix + 1, iy + 1), x0 - 1.f, y0 - 1.f);
+
+	const float4 u = fade4(x0);
+	return mix(mix(n00, n10, u), mix(n01, n11, u), fade4(y0));
+}
+
+// -1 to 1, three corners per sample instead of four
+inline float4 simplex4(__local const uchar* perm, float4 x, float4 y)
+{
+	const float F2 = 0.366025403f;	// (sqrt(3) - 1) / 2
+	const float G2 = 0.211324865f;	// (3 - sqrt(3)) / 6
+
+	const float4 s = (x + y) * F2;
+	const float4 i = floor(x + s);
+	const float4 j = floor(y + s);
+	const float4 t = (i + j) * G2;
+
+	const float4 x0 = x - (i - t);
+	const float4 y0 = y - (j - t);
+
+	// Lower or upper triangle of the skewed cell
+	const int4 lower = isgreater(x0, y0);
+	const int4 i1 = select((int4)(0), (int4)(1), lower);
+	const int4 j1 = 1 - i1;
+
+	const float4 x1 = x0 - convert_float4(i1) + G2;
+	const float4 y1 = y0 - convert_float4(j1) + G2;
+	const float4 x2 = x0 - 1.f + 2.f * G2;
+	const float4 y2 = y0 - 1.f + 2.f * G2;
+
+	const int4 ii = convert_int4(i);
+	const int4 jj = convert_int4(j);
+
+	float4 t0 = max(0.5f - x0 * x0 - y0 * y0, 0.f);
+	float4 t1 = max(0.5f - x1 * x1 - y1 * y1, 0.f);
+	float4 t2 = max(0.5f - x2 * x2 - y2 * y2, 0.f);
+	t0 *= t0;
+	t1 *= t1;
+	t2 *= t2;
+
+	const float4 n = t0 * t0 * grad4(hash4(perm, ii, jj), x0, y0)
+		+ t1 * t1 * grad4(hash4(perm, ii + i1, jj + j1), x1, y1)
+		+ t2 * t2 * grad4(hash4(perm, ii + 1, jj + 1), x2, y2);
+
+	return 70.f * n;
+}
+
+// 0 to 1, octaves halve in amplitude and double in frequency like perlin2d
+inline float fbm(__local const uchar* perm, float2 p, int depth, bool bSimplex)
+{
+	// Same define as perlin.cl, specialised variants have a fixed octave count
+#ifdef PERLIN_DEPTH
+	depth = PERLIN_DEPTH;
+#endif
+
+	float4 sum = (float4)(0.f);
+	float4 norm = (float4)(0.f);
+
+	int4 octave = (int4)(0, 1, 2, 3);
+	float4 amp = (float4)(1.f, 0.5f, 0.25f, 0.125f);
+	float4 freq = (float4)(1.f, 2.f, 4.f, 8.f);
+
+	for (int first = 0; first < depth; first += 4)
+	{
+		const float4 offset = convert_float4(octave);
+		const float4 x = p.x * freq + offset * OCTAVE_OFFSET.x;
+		const float4 y = p.y * freq + offset * OCTAVE_OFFSET.y;
+
+		const float4 n = bSimplex ? simplex4(perm, x, y) : gradient4(perm, x, y);
+
+		// Lanes past the last octave don't count
+		const float4 weight = select((float4)(0.f), amp, octave < depth);
+		sum += n * weight;
+		norm += weight;
+
+		octave += 4;
+		amp *= 0.0625f;
+		freq *= 16.f;
+	}
+
+	const float total = norm.x + norm.y + norm.z + norm.w;
+	return ((sum.x + sum.y + sum.z + sum.w) / total) * 0.5f + 0.5f;
+}
+
+// The global size is rounded up to the work group size, so every work item
+// can help stage the table before the ones outside the image return
+inline void noise(__write_only image2d_t heightOut,
+	__global const uchar* permutation,
+	__local uchar* perm,
+	float size,
+	int depth,
+	float amplitude,
+	int originX,
+	int originY,
+	int step,
+	bool bSimplex)
+{
+	stage_permutation(permutation, perm);
+
+	const int x = get_global_id(0);
+	const int y = get_global_id(1);
+
+	if (x >= get_image_width(heightOut) || y >= get_image_height(heightOut))
+		return;
+
+	const float2 world = (float2)((float)(originX + x * step), (float)(originY + y * step));
+
+	write_imagef(heightOut, (int2)(x, y), fbm(perm, world / size, depth, bSimplex) * amplitude);
+}
+
+__kernel void simplex_noise(__write_only image2d_t heightOut,
+	__global const uchar* permutation,
+	float size,
+	int depth,
+	float amplitude,
+	int originX,
+	int originY,
+	int step)
+{
+	__local uchar perm[PERM_SIZE];
+	noise(heightOut, permutation, perm, size, depth, amplitude, originX, originY, step, true);
+}
+
+__kernel void gradient_noise(__write_only image2d_t heightOut,
+	__global const uchar* permutation,
+	float size,
+	int depth,
+	float amplitude,
+	int originX,
+	int originY,
+	int step)
+{
+	__local uchar perm[PERM_SIZE];
+	noise(heightOut, permutation, perm, size, depth, amplitude, originX, originY, step, false);
+}
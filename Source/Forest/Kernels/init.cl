@@ -0,0 +1,15 @@
+// Fills images with a constant on devices without clEnqueueFillImage
+// (before OpenCL 1.2). Every channel the format has gets its part of value
+
+__kernel void fill_float(__write_only image2d_t output,
+	float4 value)
+{
+	write_imagef(output, (int2)(get_global_id(0), get_global_id(1)), value);
+}
+
+// For the unsigned integer formats (R uint16 heightmaps)
+__kernel void fill_uint(__write_only image2d_t output,
+	uint4 value)
+{
+	write_imageui(output, (int2)(get_global_id(0), get_global_id(1)), value);
+}
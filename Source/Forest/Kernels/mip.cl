@@ -0,0 +1,133 @@
+// Builds mip levels of a heightmap. Every level is an RGBA float image:
+// x = minimum, y = maximum, z = average, w = number of full resolution
+// pixels the texel covers. Levels are half the size of the previous one
+// rounded up, so texels on the edge of odd sized levels cover less pixels
+// and the count keeps the average weighted correctly.
+
+// Each work group reduces an 8x8 block of level 1 texels in local memory,
+// so one dispatch writes up to 4 levels
+#define MIP_GROUP_SIZE 8
+
+// Combines two (min, max, sum, count) tuples
+float4 mip_combine(float4 a, float4 b)
+{
+	return (float4)(min(a.x, b.x), max(a.y, b.y), a.z + b.z, a.w + b.w);
+}
+
+// Reads one source texel as a (min, max, sum, count) tuple, texels outside
+// of the image count as nothing
+float4 mip_read(__read_only image2d_t input, int is_mip, int2 coord)
+{
+	const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+	if (coord.x >= get_image_width(input) || coord.y >= get_image_height(input))
+		return (float4)(INFINITY, -INFINITY, 0.f, 0.f);
+
+	float4 value = read_imagef(input, sampler, coord);
+
+	if (is_mip)
+		return (float4)(value.x, value.y, value.z * value.w, value.w);
+
+	return (float4)(value.x, value.x, value.x, 1.f);
+}
+
+void mip_write(__write_only image2d_t level, int2 coord, float4 value)
+{
+	if (coord.x < get_image_width(level) && coord.y < get_image_height(level))
+		write_imagef(level, coord, (float4)(value.x, value.y, value.z / max(value.w, 1.f), value.w));
+}
+
+// input is either the full resolution heightmap (is_mip = 0) or the last
+// level written by the previous dispatch. Only the first level_count of
+// level1..level4 are written
+__kernel void mip_reduce(__read_only image2d_t input,
+		int is_mip,
+		__write_only image2d_t level1,
+		__write_only image2d_t level2,
+		__write_only image2d_t level3,
+		__write_only image2d_t level4,
+		int level_count)
+{
+	__local float4 block[MIP_GROUP_SIZE][MIP_GROUP_SIZE];
+
+	int2 gid = (int2)(get_global_id(0), get_global_id(1));
+	int2 lid = (int2)(get_local_id(0), get_local_id(1));
+	int2 group = (int2)(get_group_id(0), get_group_id(1));
+
+	float4 value = mip_combine(
+		mip_combine(mip_read(input, is_mip, gid * 2), mip_read(input, is_mip, gid * 2 + (int2)(1, 0))),
+		mip_combine(mip_read(input, is_mip, gid * 2 + (int2)(0, 1)), mip_read(input, is_mip, gid * 2 + (int2)(1, 1))));
+
+	mip_write(level1, gid, value);
+	block[lid.y][lid.x] = value;
+
+	// Every work item has to reach the barriers, so the loop bounds can't
+	// depend on the work item
+	for (int level = 2, size = MIP_GROUP_SIZE / 2; level <= 4; level++, size /= 2)
+	{
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		int active = lid.x < size && lid.y < size;
+		if (active)
+		{
+			value = mip_combine(
+				mip_combine(block[lid.y * 2][lid.x * 2], block[lid.y * 2][lid.x * 2 + 1]),
+				mip_combine(block[lid.y * 2 + 1][lid.x * 2], block[lid.y * 2 + 1][lid.x * 2 + 1]));
+		}
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		if (active && level <= level_count)
+		{
+			block[lid.y][lid.x] = value;
+
+			int2 coord = group * size + lid;
+			if (level == 2)
+				mip_write(level2, coord, value);
+			else if (level == 3)
+				mip_write(level3, coord, value);
+			else
+				mip_write(level4, coord, value);
+		}
+	}
+}
+
+// Copies one channel of a mip level to a single channel heightmap
+__kernel void mip_channel(__read_only image2d_t level,
+		__write_only image2d_t output,
+		int channel)
+{
+	const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+	int2 coord = (int2)(get_global_id(0), get_global_id(1));
+	float4 value = read_imagef(level, sampler, coord);
+
+	float result = channel == 0 ? value.x : (channel == 1 ? value.y : value.z);
+	write_imagef(output, coord, (float4)(result, 0.f, 0.f, 1.f));
+}
+
+// Bilinearly resamples input to the size of output, used to show low
+// resolution previews in full size textures. Texel centres line up
+// between the two images
+__kernel void resample_bilinear(__read_only image2d_t input,
+		__write_only image2d_t output)
+{
+	const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+	int2 coord = (int2)(get_global_id(0), get_global_id(1));
+	float2 scale = (float2)((float)get_image_width(input) / get_image_width(output),
+		(float)get_image_height(input) / get_image_height(output));
+
+	float2 pos = ((float2)(coord.x, coord.y) + 0.5f) * scale - 0.5f;
+	float2 base = floor(pos);
+	float2 t = pos - base;
+	int2 i = (int2)((int)base.x, (int)base.y);
+
+	float a = read_imagef(input, sampler, i).x;
+	float b = read_imagef(input, sampler, i + (int2)(1, 0)).x;
+	float c = read_imagef(input, sampler, i + (int2)(0, 1)).x;
+	float d = read_imagef(input, sampler, i + (int2)(1, 1)).x;
+
+	float result = mix(mix(a, b, t.x), mix(c, d, t.x), t.y);
+	write_imagef(output, coord, (float4)(result, 0.f, 0.f, 1.f));
+}
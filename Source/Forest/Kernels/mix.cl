@@ -12,7 +12,12 @@ __kernel void mix_kernel(__write_only image2d_t output,
 		E_Max = 4
 	} EMixType;
 
+	// Variants built with -D MIX_TYPE=n only keep one case of the switch
+#ifdef MIX_TYPE
+	EMixType MixType = (EMixType)MIX_TYPE;
+#else
 	EMixType MixType = (EMixType)MixTypeChar;
+#endif
 
 	int x = get_global_id(0);
 	int y = get_global_id(1);
@@ -0,0 +1,37 @@
+#include "vector.h"
+
+// Row variant of mix_kernel over row-major buffers, the whole segment is
+// one vector operation. Built with -D MIX_TYPE=n, like the specialised mix
+// variants, the host always passes it
+#ifndef MIX_TYPE
+#define MIX_TYPE 0
+#endif
+
+__kernel void mix_rows(__global float* output,
+	int width,
+	int height,
+	__global const float* input_l,
+	__global const float* input_r)
+{
+	const int x = row_x();
+	const int y = get_global_id(1);
+
+	const floatN valueL = load_row(input_l, width, height, x, y, 0);
+	const floatN valueR = load_row(input_r, width, height, x, y, 0);
+
+#if MIX_TYPE == 0
+	const floatN out = valueL + valueR;
+#elif MIX_TYPE == 1
+	const floatN out = valueL - valueR;
+#elif MIX_TYPE == 2
+	const floatN out = valueL * valueR;
+#elif MIX_TYPE == 3
+	const floatN out = fmin(valueL, valueR);
+#elif MIX_TYPE == 4
+	const floatN out = fmax(valueL, valueR);
+#else
+	const floatN out = valueL;
+#endif
+
+	store_row(out, output, width, x, y);
+}
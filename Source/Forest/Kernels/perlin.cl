@@ -126,8 +126,9 @@ float smooth_inter(float x, float y, float s)
 
 float noise2d(float x, float y, int seed)
 {
-	int x_int = x;
-	int y_int = y;
+	// floor instead of truncating so negative world coordinates don't mirror
+	int x_int = (int)floor(x);
+	int y_int = (int)floor(y);
 	float x_frac = x - x_int;
 	float y_frac = y - y_int;
 	float s = noise2(x_int, y_int, seed);
@@ -147,8 +148,13 @@ float perlin2d(float x, float y, float freq, int depth, int seed)
 	float fin = 0.0;
 	float div = 0.0;
 
-	int i;
-	for (i = 0; i < depth; i++)
+	// Variants built with -D PERLIN_DEPTH=n have a fixed octave count, so
+	// the loop can be unrolled
+#ifdef PERLIN_DEPTH
+	depth = PERLIN_DEPTH;
+	#pragma unroll
+#endif
+	for (int i = 0; i < depth; i++)
 	{
 		div += 1.0 * amp;
 		fin += noise2d(xa, ya, seed) * amp;
@@ -160,17 +166,25 @@ float perlin2d(float x, float y, float freq, int depth, int seed)
 	return fin / div;
 }
 
+// originX, originY and step map the output pixel to world space, so any
+// region of the world can be evaluated and the tiles will line up
 __kernel void perlin(__read_only image2d_t heightIn,
 	__write_only image2d_t heightOut,
 	float size,
 	int seed,
 	int depth,
-	float amplitude)
+	float amplitude,
+	int originX,
+	int originY,
+	int step)
 {
 	int x = get_global_id(0);
 	int y = get_global_id(1);
 
-	float out = perlin2d((float)x, (float)y, 1.f / size, depth, seed) * amplitude;
+	float wx = (float)(originX + x * step);
+	float wy = (float)(originY + y * step);
+
+	float out = perlin2d(wx, wy, 1.f / size, depth, seed) * amplitude;
 
 	write_imagef(heightOut, (int2)(x, y), out);
 }
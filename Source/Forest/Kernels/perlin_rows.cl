@@ -0,0 +1,31 @@
+#include "perlin.h"
+#include "vector.h"
+
+// Row variant of perlin, built together with perlin.cl. Writes a width wide
+// row-major buffer, the host copies it in to the heightmap. The hashes are
+// per pixel, the lanes only share the stores
+__kernel void perlin_rows(__global float* heightOut,
+	int width,
+	float size,
+	int seed,
+	int depth,
+	float amplitude,
+	int originX,
+	int originY,
+	int step)
+{
+	const int x = row_x();
+	const int y = get_global_id(1);
+
+	const float freq = 1.f / size;
+	const float wy = (float)(originY + y * step);
+
+	float lanes[VECTOR_WIDTH];
+	for (int i = 0; i < VECTOR_WIDTH; i++)
+	{
+		const float wx = (float)(originX + (x + i) * step);
+		lanes[i] = perlin2d(wx, wy, freq, depth, seed);
+	}
+
+	store_row(vloadN(0, lanes) * amplitude, heightOut, width, x, y);
+}
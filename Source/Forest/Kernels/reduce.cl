@@ -0,0 +1,207 @@
+// Reductions over single channel heightmaps. Only a few values per work
+// group come back from the image, the rest (normalising, equalising) reads
+// those from device memory, so nothing has to go through the host.
+// Statistics are float4 (min, max, sum, sum of squares). Work groups have to
+// be a power of two in size
+
+const sampler_t sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+inline float read_pixel(__read_only image2d_t input, int index, int width)
+{
+	return read_imagef(input, sampler, (int2)(index % width, index / width)).x;
+}
+
+inline float4 combine_stats(float4 a, float4 b)
+{
+	return (float4)(fmin(a.x, b.x), fmax(a.y, b.y), a.z + b.z, a.w + b.w);
+}
+
+inline float4 empty_stats()
+{
+	return (float4)(MAXFLOAT, -MAXFLOAT, 0.f, 0.f);
+}
+
+// Tree reduction of scratch, the result ends up in scratch[0]
+inline void reduce_group(__local float4* scratch)
+{
+	const int lid = get_local_id(0);
+
+	for (int stride = get_local_size(0) / 2; stride > 0; stride /= 2)
+	{
+		barrier(CLK_LOCAL_MEM_FENCE);
+		if (lid < stride)
+			scratch[lid] = combine_stats(scratch[lid], scratch[lid + stride]);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+}
+
+// One partial per work group, the pixels are strided over the whole launch
+__kernel void reduce_stats(__read_only image2d_t input,
+	__global float4* partials,
+	__local float4* scratch)
+{
+	const int width = get_image_width(input);
+	const int count = width * get_image_height(input);
+
+	float4 stats = empty_stats();
+	for (int i = get_global_id(0); i < count; i += get_global_size(0))
+	{
+		const float value = read_pixel(input, i, width);
+		stats = combine_stats(stats, (float4)(value, value, value, value * value));
+	}
+
+	scratch[get_local_id(0)] = stats;
+	reduce_group(scratch);
+
+	if (get_local_id(0) == 0)
+		partials[get_group_id(0)] = scratch[0];
+}
+
+// Run as a single work group, combines the partials in to stats[0]
+__kernel void finish_stats(__global const float4* partials,
+	int partialCount,
+	__global float4* stats,
+	__local float4* scratch)
+{
+	float4 combined = empty_stats();
+	for (int i = get_local_id(0); i < partialCount; i += get_local_size(0))
+	{
+		combined = combine_stats(combined, partials[i]);
+	}
+
+	scratch[get_local_id(0)] = combined;
+	reduce_group(scratch);
+
+	if (get_local_id(0) == 0)
+		stats[0] = scratch[0];
+}
+
+__kernel void clear_counts(__global uint* counts)
+{
+	counts[get_global_id(0)] = 0;
+}
+
+inline int to_bin(float value, float minimum, float maximum, int bins)
+{
+	const float range = maximum - minimum;
+	const int bin = range > 0.f ? (int)((value - minimum) / range * bins) : 0;
+	return clamp(bin, 0, bins - 1);
+}
+
+// Counts in local memory first, so the global atomics are one per bin per group.
+// The range is stats[0].xy
+__kernel void histogram(__read_only image2d_t input,
+	__global const float4* stats,
+	int bins,
+	__global uint* counts,
+	__local uint* localCounts)
+{
+	for (int i = get_local_id(0); i < bins; i += get_local_size(0))
+	{
+		localCounts[i] = 0;
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	const float minimum = stats[0].x;
+	const float maximum = stats[0].y;
+	const int width = get_image_width(input);
+	const int count = width * get_image_height(input);
+
+	for (int i = get_global_id(0); i < count; i += get_global_size(0))
+	{
+		atomic_inc(&localCounts[to_bin(read_pixel(input, i, width), minimum, maximum, bins)]);
+	}
+
+	barrier(CLK_LOCAL_MEM_FENCE);
+
+	for (int i = get_local_id(0); i < bins; i += get_local_size(0))
+	{
+		if (localCounts[i] != 0)
+			atomic_add(&counts[i], localCounts[i]);
+	}
+}
+
+// Single work item, there are only a few thousand bins at most.
+// cdf[i] is the fraction of pixels in bins 0 to i
+__kernel void histogram_cdf(__global const uint* counts,
+	int bins,
+	__global float* cdf)
+{
+	uint total = 0;
+	for (int i = 0; i < bins; i++)
+	{
+		total += counts[i];
+	}
+
+	uint running = 0;
+	for (int i = 0; i < bins; i++)
+	{
+		running += counts[i];
+		cdf[i] = total > 0 ? (float)running / (float)total : 0.f;
+	}
+}
+
+// Moves every height to its place in the distribution, within the same range.
+// Interpolates inside a bin so the result doesn't band
+__kernel void equalize(__read_only image2d_t input,
+	__write_only image2d_t output,
+	__global const float4* stats,
+	__global const float* cdf,
+	int bins)
+{
+	const int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+	const float minimum = stats[0].x;
+	const float maximum = stats[0].y;
+	const float range = maximum - minimum;
+
+	const float value = read_imagef(input, sampler, coord).x;
+	const float position = range > 0.f ? clamp((value - minimum) / range * bins, 0.f, (float)bins) : 0.f;
+	const int bin = min((int)position, bins - 1);
+
+	const float lower = bin > 0 ? cdf[bin - 1] : 0.f;
+	const float upper = cdf[bin];
+
+	write_imagef(output, coord, minimum + mix(lower, upper, position - bin) * range);
+}
+
+// Linear map of stats[0].xy to outMin..outMax
+__kernel void normalize_stats(__read_only image2d_t input,
+	__write_only image2d_t output,
+	__global const float4* stats,
+	float outMin,
+	float outMax)
+{
+	const int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+	const float minimum = stats[0].x;
+	const float range = stats[0].y - minimum;
+
+	const float value = read_imagef(input, sampler, coord).x;
+	const float t = range > 0.f ? (value - minimum) / range : 0.f;
+
+	write_imagef(output, coord, outMin + t * (outMax - outMin));
+}
+
+// Linear map of inMin..inMax to outMin..outMax, optionally clamped to the output range
+__kernel void remap(__read_only image2d_t input,
+	__write_only image2d_t output,
+	float inMin,
+	float inMax,
+	float outMin,
+	float outMax,
+	int clampOutput)
+{
+	const int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+	const float range = inMax - inMin;
+	const float value = read_imagef(input, sampler, coord).x;
+
+	float t = range != 0.f ? (value - inMin) / range : 0.f;
+	if (clampOutput)
+		t = clamp(t, 0.f, 1.f);
+
+	write_imagef(output, coord, outMin + t * (outMax - outMin));
+}
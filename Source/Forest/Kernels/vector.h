@@ -0,0 +1,78 @@
+#pragma once
+
+// Row kernels, the buffer variants the host picks on CPU devices. Every work
+// item covers VECTOR_WIDTH (4, 8 or 16) neighbouring pixels of one row of a
+// row-major float buffer with vload/vstore, so the CPU runtime doesn't go
+// through its emulated image reads and writes. Four channel maps are stored
+// as four planes of width * height floats one after the other.
+// Only one file per program can include this
+
+#ifndef VECTOR_WIDTH
+#define VECTOR_WIDTH 8
+#endif
+
+#define VECTOR_CAT_(a, b) a##b
+#define VECTOR_CAT(a, b) VECTOR_CAT_(a, b)
+
+#define floatN VECTOR_CAT(float, VECTOR_WIDTH)
+#define vloadN VECTOR_CAT(vload, VECTOR_WIDTH)
+#define vstoreN VECTOR_CAT(vstore, VECTOR_WIDTH)
+
+// Position of each lane in the row segment
+#if VECTOR_WIDTH == 4
+#define LANE_OFFSETS ((float4)(0.f, 1.f, 2.f, 3.f))
+#elif VECTOR_WIDTH == 8
+#define LANE_OFFSETS ((float8)(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f))
+#elif VECTOR_WIDTH == 16
+#define LANE_OFFSETS ((float16)(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f, 8.f, 9.f, 10.f, 11.f, 12.f, 13.f, 14.f, 15.f))
+#else
+#error VECTOR_WIDTH has to be 4, 8 or 16
+#endif
+
+// First pixel of the work item's segment
+inline int row_x()
+{
+	return get_global_id(0) * VECTOR_WIDTH;
+}
+
+// Plane plane of a map stored as planes, const or not
+#define map_plane(map, width, height, plane) ((map) + (size_t)(plane) * (width) * (height))
+
+// The segment of row y starting at x + dx. Reads past the edges return the
+// edge pixel, like CLK_ADDRESS_CLAMP_TO_EDGE
+inline floatN load_row(__global const float* map, int width, int height, int x, int y, int dx)
+{
+	__global const float* row = map + (size_t)clamp(y, 0, height - 1) * width;
+	const int first = x + dx;
+
+	if (first >= 0 && first + VECTOR_WIDTH <= width)
+		return vloadN(0, row + first);
+
+	float lanes[VECTOR_WIDTH];
+	for (int i = 0; i < VECTOR_WIDTH; i++)
+	{
+		lanes[i] = row[clamp(first + i, 0, width - 1)];
+	}
+
+	return vloadN(0, lanes);
+}
+
+// Lanes past the end of the row are dropped
+inline void store_row(floatN value, __global float* map, int width, int x, int y)
+{
+	__global float* row = map + (size_t)y * width;
+
+	if (x + VECTOR_WIDTH <= width)
+	{
+		vstoreN(value, 0, row + x);
+		return;
+	}
+
+	float lanes[VECTOR_WIDTH];
+	vstoreN(value, 0, lanes);
+
+	for (int i = 0; x + i < width; i++)
+	{
+		row[x + i] = lanes[i];
+	}
+}
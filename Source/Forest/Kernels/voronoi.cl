@@ -4,17 +4,27 @@ inline float rand(int2 co, int seed)
 	return fract(sin(dot((float2)(co.x + seed, co.y + seed), (float2)(12.9898, 78.233))) * 43758.5453, &garbage);
 }
 
-// xy_dim: width, height of the image
-inline float2 getPoint(int2 xy, int2 xy_dim, int size, int seed)
+// Rounds towards negative infinity so that cells keep the same size on both
+// sides of the world origin
+inline int floor_div(int a, int b)
 {
-	int2 dxy = xy / size;
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+// Offset for the cell's y coordinate hash, so x and y aren't correlated.
+// This has to be fixed rather than the image size so tiles line up
+#define CELL_HASH_OFFSET ((int2)(1031, 1033))
 
-	return (float2)(dxy.x * size, dxy.y * size) + ((float2)(rand(dxy, seed), rand(dxy + xy_dim, seed)) * (float2)(size, size));
+inline float2 getPoint(int2 xy, int size, int seed)
+{
+	int2 dxy = (int2)(floor_div(xy.x, size), floor_div(xy.y, size));
+
+	return (float2)(dxy.x * size, dxy.y * size) + ((float2)(rand(dxy, seed), rand(dxy + CELL_HASH_OFFSET, seed)) * (float2)(size, size));
 }
 
-inline float getDist(int x1, int y1, int x2, int y2, int w, int h, int size, int seed)
+inline float getDist(int x1, int y1, int x2, int y2, int size, int seed)
 {
-	return distance((float2)(x1, y1), getPoint((int2)(x2, y2), (int2)(w, h), size, seed));
+	return distance((float2)(x1, y1), getPoint((int2)(x2, y2), size, seed));
 }
 
 // Helper func sorta
@@ -52,34 +62,26 @@ inline float get_f2(float x1, float x2, float x3, float x4, float x5, float x6,
 	return xarr[0];//xarr[1] - xarr[0];
 }
 
-__kernel void voronoi(__read_only image2d_t heightIn,
-	__write_only image2d_t heightOut,
-	int size,
-	int seed,
-	float amplitude)
+// Distance to the nearest cell point from world position x, y, scaled to amplitude
+inline float voronoi_height(int x, int y, int size, int seed, float amplitude)
 {
-	int x = get_global_id(0);
-	int y = get_global_id(1);
-	int h = get_image_height(heightIn);
-	int w = get_image_width(heightIn);
-
-	float randPoint = getDist(x, y, x, y, w, h, size, seed);
+	float randPoint = getDist(x, y, x, y, size, seed);
 
 	// adjacent points
 	// x+, x-, y+, y-
 	// x+ y+, x- y+, x+ y-, x- y-
 	float8 adjRandPoints = {
-		getDist(x, y, x + size, y, w, h, size, seed),
-		getDist(x, y, x - size, y, w, h, size, seed),
-		getDist(x, y, x, y + size, w, h, size, seed),
-		getDist(x, y, x, y - size, w, h, size, seed),
-		getDist(x, y, x + size, y + size, w, h, size, seed),
-		getDist(x, y, x - size, y + size, w, h, size, seed),
-		getDist(x, y, x + size, y - size, w, h, size, seed),
-		getDist(x, y, x - size, y - size, w, h, size, seed)
+		getDist(x, y, x + size, y, size, seed),
+		getDist(x, y, x - size, y, size, seed),
+		getDist(x, y, x, y + size, size, seed),
+		getDist(x, y, x, y - size, size, seed),
+		getDist(x, y, x + size, y + size, size, seed),
+		getDist(x, y, x - size, y + size, size, seed),
+		getDist(x, y, x + size, y - size, size, seed),
+		getDist(x, y, x - size, y - size, size, seed)
 	};
 
-	float out = multi_min(
+	return multi_min(
 		randPoint,
 		adjRandPoints.s0,
 		adjRandPoints.s1,
@@ -89,8 +91,26 @@ __kernel void voronoi(__read_only image2d_t heightIn,
 		adjRandPoints.s5,
 		adjRandPoints.s6,
 		adjRandPoints.s7) * (amplitude / size);
+}
+
+__kernel void voronoi(__read_only image2d_t heightIn,
+	__write_only image2d_t heightOut,
+	int size,
+	int seed,
+	float amplitude,
+	int originX,
+	int originY,
+	int step)
+{
+	int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+	// World space position of this pixel
+	int x = originX + coord.x * step;
+	int y = originY + coord.y * step;
+
+	float out = voronoi_height(x, y, size, seed, amplitude);
 
 	//out = (uint) amplitude;
 
-	write_imagef(heightOut, (int2)(x, y), out);
+	write_imagef(heightOut, coord, out);
 }
\ No newline at end of file
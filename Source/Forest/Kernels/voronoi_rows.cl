@@ -0,0 +1,26 @@
+#include "vector.h"
+
+// Row variant of voronoi, built together with perlin.cl and voronoi.cl.
+// Writes a width wide row-major buffer, the host copies it in to the heightmap
+__kernel void voronoi_rows(__global float* heightOut,
+	int width,
+	int size,
+	int seed,
+	float amplitude,
+	int originX,
+	int originY,
+	int step)
+{
+	const int x = row_x();
+	const int y = get_global_id(1);
+
+	const int wy = originY + y * step;
+
+	float lanes[VECTOR_WIDTH];
+	for (int i = 0; i < VECTOR_WIDTH; i++)
+	{
+		lanes[i] = voronoi_height(originX + (x + i) * step, wy, size, seed, amplitude);
+	}
+
+	store_row(vloadN(0, lanes), heightOut, width, x, y);
+}
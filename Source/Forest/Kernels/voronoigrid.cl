@@ -0,0 +1,88 @@
+// Grid Voronoi. Every size x size cell of the world has one feature point,
+// placed by an integer hash of the cell and the seed. The 3x3 cells around
+// the pixel are searched keeping the two smallest distances as they go, so
+// F1, F2, F2 - F1 and the ID of the nearest cell all come out of one pass.
+// 3x3 is exact for F1, F2 can very rarely be in the ring outside it
+
+inline uint hash_uint(uint x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+inline uint hash_cell(int2 cell, int seed)
+{
+	return hash_uint((uint)cell.x * 0x8da6b343u ^ (uint)cell.y * 0xd8163841u ^ (uint)seed * 0xcb1ab31fu);
+}
+
+// 0 to 1 from the top 24 bits
+inline float to_unit(uint h)
+{
+	return (float)(h >> 8) * (1.f / 16777216.f);
+}
+
+// Rounds towards negative infinity so that cells keep the same size on both
+// sides of the world origin
+inline int floor_div(int a, int b)
+{
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+__kernel void voronoi_features(__write_only image2d_t f1Out,
+	__write_only image2d_t f2Out,
+	__write_only image2d_t edgeOut,
+	__write_only image2d_t cellOut,
+	int size,
+	int seed,
+	float amplitude,
+	int originX,
+	int originY,
+	int step)
+{
+	int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+	// World space position of this pixel
+	int2 world = (int2)(originX + coord.x * step, originY + coord.y * step);
+	int2 cell = (int2)(floor_div(world.x, size), floor_div(world.y, size));
+	float2 p = convert_float2(world);
+
+	float f1 = MAXFLOAT;
+	float f2 = MAXFLOAT;
+	uint nearest = 0;
+
+	for (int dy = -1; dy <= 1; dy++)
+	{
+		for (int dx = -1; dx <= 1; dx++)
+		{
+			int2 c = cell + (int2)(dx, dy);
+			uint h = hash_cell(c, seed);
+
+			float2 point = (convert_float2(c) + (float2)(to_unit(h), to_unit(hash_uint(h)))) * (float)size;
+			float d = distance(p, point);
+
+			if (d < f1)
+			{
+				f2 = f1;
+				f1 = d;
+				nearest = h;
+			}
+			else if (d < f2)
+			{
+				f2 = d;
+			}
+		}
+	}
+
+	float scale = amplitude / size;
+
+	write_imagef(f1Out, coord, f1 * scale);
+	write_imagef(f2Out, coord, f2 * scale);
+	write_imagef(edgeOut, coord, (f2 - f1) * scale);
+
+	// Rehashed so the ID isn't correlated with the point's position
+	write_imagef(cellOut, coord, to_unit(hash_uint(nearest ^ 0x9e3779b9u)) * amplitude);
+}
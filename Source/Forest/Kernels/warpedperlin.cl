@@ -5,16 +5,78 @@ __kernel void warpedperlin(__read_only image2d_t heightIn,
 	float size,
 	int seed,
 	int depth,
-	float amplitude)
+	float amplitude,
+	int originX,
+	int originY,
+	int step)
 {
 	int x = get_global_id(0);
 	int y = get_global_id(1);
 
-	float2 warpedcoords = (float2)(perlin2d((float)x, (float)y, 1.f / size, depth, seed),
-								 perlin2d((float)x + 5.2f, (float)y + 1.3f, 1.f / size, depth, seed));
+	// World space position of this pixel
+	float wx = (float)(originX + x * step);
+	float wy = (float)(originY + y * step);
+
+	float2 warpedcoords = (float2)(perlin2d(wx, wy, 1.f / size, depth, seed),
+								 perlin2d(wx + 5.2f, wy + 1.3f, 1.f / size, depth, seed));
 	warpedcoords *= 256.f;
 
-	float out = perlin2d((float)x + warpedcoords.x, (float)y + warpedcoords.y, 1.f / (size + warpedcoords.x), depth, seed) * amplitude;
+	float out = perlin2d(wx + warpedcoords.x, wy + warpedcoords.y, 1.f / (size + warpedcoords.x), depth, seed) * amplitude;
+
+	write_imagef(heightOut, (int2)(x, y), out);
+}
+
+// Warp offsets at a lower resolution, the field is smooth so it's sampled
+// bilinearly by warpedperlin_field. Texel (x, y) is at world position
+// (fieldOriginX + x * fieldStep, fieldOriginY + y * fieldStep), the host
+// aligns the origin to fieldStep so tiles share the same texels
+__kernel void warp_field(__write_only image2d_t fieldOut,
+	float size,
+	int seed,
+	int warpDepth,
+	int fieldOriginX,
+	int fieldOriginY,
+	int fieldStep)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+
+	float wx = (float)(fieldOriginX + x * fieldStep);
+	float wy = (float)(fieldOriginY + y * fieldStep);
+
+	float2 warpedcoords = (float2)(perlin2d(wx, wy, 1.f / size, warpDepth, seed),
+								 perlin2d(wx + 5.2f, wy + 1.3f, 1.f / size, warpDepth, seed));
+
+	write_imagef(fieldOut, (int2)(x, y), (float4)(warpedcoords * 256.f, 0.f, 0.f));
+}
+
+__kernel void warpedperlin_field(__read_only image2d_t field,
+	__write_only image2d_t heightOut,
+	float size,
+	int seed,
+	int depth,
+	float amplitude,
+	int originX,
+	int originY,
+	int step,
+	int fieldOriginX,
+	int fieldOriginY,
+	int fieldStep)
+{
+	const sampler_t linearSampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_LINEAR;
+
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+
+	// World space position of this pixel
+	float wx = (float)(originX + x * step);
+	float wy = (float)(originY + y * step);
+
+	// Texel centres are at .5 with unnormalised coordinates
+	float2 fieldCoord = (float2)((wx - fieldOriginX) / fieldStep, (wy - fieldOriginY) / fieldStep) + 0.5f;
+	float2 warpedcoords = read_imagef(field, linearSampler, fieldCoord).xy;
+
+	float out = perlin2d(wx + warpedcoords.x, wy + warpedcoords.y, 1.f / (size + warpedcoords.x), depth, seed) * amplitude;
 
 	write_imagef(heightOut, (int2)(x, y), out);
 }
@@ -1,19 +1,24 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "LandscapeGen.h"
+#include "TiledHeightmap.h"
+#include "Profiling.h"
 #include "EngineUtils.h"
+#include "HAL/FileManager.h"
 #include "Classes/Landscape.h"
 #include "Classes/LandscapeComponent.h"
 #include "Classes/LandscapeInfo.h"
 #include "Classes/LandscapeProxy.h"
 #include "Engine/Texture2D.h"
 
+#if WITH_EDITOR
 // Disable warning for WITH_KISSFFT not being defined
 #pragma warning(push)
 #pragma warning(disable: 4668)
 #include "LandscapeEdModeTools.h"
 #include "LandscapeEditorUtils.h"
 #pragma warning(pop)
+#endif
 
 #include "NotificationManager.h"
 #include "SNotificationList.h"
@@ -34,6 +39,7 @@
 
 #define LOCTEXT_NAMESPACE "Landscape Generation"
 
+#if WITH_EDITOR
 // Return the heightmap for the landscape
 TMap<FIntPoint, uint16> LandscapeEditorUtils::GetHeightmapData(ALandscapeProxy* Landscape)
 {
@@ -47,6 +53,7 @@ TMap<FIntPoint, uint16> LandscapeEditorUtils::GetHeightmapData(ALandscapeProxy*
 
 	return Data;
 }
+#endif
 
 
 #include <iostream>
@@ -82,11 +89,113 @@ ALandscapeGen::ALandscapeGen(const FObjectInitializer& ObjectInitializer)
 	PrimaryActorTick.bCanEverTick = true;
 	PrimaryActorTick.bStartWithTickEnabled = true;
 	PrimaryActorTick.bTickEvenWhenPaused = true;
+
+	PreviewLODs = { 3, 2 };
+	PreviewLOD = 0;
+	bEvaluatingPreview = false;
+}
+
+void ALandscapeGen::GetGraphSize(int32& SizeX, int32& SizeY) const
+{
+	SizeX = SizeY = 0;
+
+	if (Landscape.IsValid())
+	{
+		auto LandscapeBounds = Landscape.Get()->GetBoundingRect();
+
+		LandscapeGeneration::GetMipLevelSize(LandscapeBounds.Max.X + 1, LandscapeBounds.Max.Y + 1, PreviewLOD, SizeX, SizeY);
+
+		// Previews would only swap the warm up size back and forth
+		if (PreviewLOD == 0)
+			LandscapeGeneration::RememberGraphSize(SizeX, SizeY);
+	}
+}
+
+LandscapeGeneration::Kernels::TileRegion ALandscapeGen::GetGraphRegion() const
+{
+	LandscapeGeneration::Kernels::TileRegion Region;
+	Region.Step = 1 << PreviewLOD;
+
+	return Region;
+}
+
+std::shared_ptr<LandscapeGeneration::Job> ALandscapeGen::PushNodeKernel(const char* NodeName, std::function<void(LandscapeGeneration::Job&)> KernelFunc,
+	const std::vector<const FHeightmapWrapper*>& Inputs, const std::vector<FHeightmapWrapper*>& Outputs)
+{
+	std::vector<std::shared_ptr<LandscapeGeneration::Job>> Dependencies;
+	for (auto* Input : Inputs)
+	{
+		Dependencies.push_back(Input->Job);
+	}
+
+	std::vector<std::weak_ptr<LandscapeGeneration::Heightmap>> OutputHeightmaps;
+	for (auto* Output : Outputs)
+	{
+		OutputHeightmaps.push_back(Output->Heightmap);
+	}
+
+	// Kernels traced while the node runs are attributed to it
+	auto NodeFunc = [NodeName, KernelFunc](LandscapeGeneration::Job& ThisJob) -> void
+	{
+		LandscapeGeneration::Profiling::ScopedSpan Span(NodeName, "Node");
+		KernelFunc(ThisJob);
+	};
+
+	auto NewJob = LandscapeGeneration::PushJob(NodeFunc, Dependencies, OutputHeightmaps);
+
+	for (auto* Output : Outputs)
+	{
+		Output->Job = NewJob;
+	}
+
+	if (bEvaluatingPreview)
+	{
+		PreviewJobs.push_back(NewJob);
+	}
+
+	return NewJob;
+}
+
+void ALandscapeGen::Progressive_Preview(UTexture2D* Texture)
+{
+	UE_LOG(LogTemp, Warning, TEXT("Progressive Preview"));
+
+	// Whatever is left of the last preview is stale now
+	for (auto& PreviewJob : PreviewJobs)
+	{
+		PreviewJob->Cancel();
+	}
+
+	PreviewJobs.clear();
+
+	TArray<int32> LODs;
+	for (int32 LOD : PreviewLODs)
+	{
+		if (LOD > 0)
+			LODs.Add(LOD);
+	}
+
+	// Coarsest first, then the full resolution refinement
+	LODs.Sort([](int32 A, int32 B) { return A > B; });
+	LODs.Add(0);
+
+	for (int32 LOD : LODs)
+	{
+		PreviewLOD = LOD;
+		bEvaluatingPreview = true;
+
+		SetTransientHeightmap(Texture, Evaluate_Graph());
+	}
+
+	PreviewLOD = 0;
+	bEvaluatingPreview = false;
 }
 
 TArray<uint16> ALandscapeGen::GetLandscapeHeightmapSorted()
 {
 	TArray<uint16> Data;
+
+#if WITH_EDITOR
 	static bool GotLandscapeStuff = false;
 	if (!GotLandscapeStuff)
 	{
@@ -119,6 +228,7 @@ TArray<uint16> ALandscapeGen::GetLandscapeHeightmapSorted()
 
 		return Data;
 	}
+#endif
 
 	// Should probably throw an error here...
 	return Data;
@@ -141,14 +251,17 @@ UTexture2D* ALandscapeGen::CreateTransientTexture()
 	return nullptr;
 }
 
-UTexture2D* ALandscapeGen::CreateTransientHeightmap()
+UTexture2D* ALandscapeGen::CreateTransientHeightmap(int32 MipLevel)
 {
 	if (Landscape.IsValid())
 	{
 		auto LandscapeRef = Landscape.Get();
 		auto LandscapeBounds = LandscapeRef->GetBoundingRect();
 
-		auto* Texture = UTexture2D::CreateTransient(LandscapeBounds.Max.X + 1, LandscapeBounds.Max.Y + 1, EPixelFormat::PF_R16F);
+		int32 SizeX, SizeY;
+		LandscapeGeneration::GetMipLevelSize(LandscapeBounds.Max.X + 1, LandscapeBounds.Max.Y + 1, FMath::Max(MipLevel, 0), SizeX, SizeY);
+
+		auto* Texture = UTexture2D::CreateTransient(SizeX, SizeY, EPixelFormat::PF_R16F);
 		Texture->CompressionSettings = TextureCompressionSettings::TC_Displacementmap;
 		Texture->SRGB = 0;
 
@@ -162,25 +275,51 @@ void ALandscapeGen::SetTransientHeightmap(UTexture2D* Texture, FHeightmapWrapper
 {
 	if (Landscape.IsValid())
 	{
-		auto LandscapeRef = Landscape.Get();
-		auto LandscapeBounds = LandscapeRef->GetBoundingRect();
-
 		UE_LOG(LogTemp, Warning, TEXT("Set Transient Heightmap"));
 
 		// Check that the heightmap exists
 		if (HeightMap.Heightmap != nullptr && Texture != nullptr)
 		{
+			const int32 SizeX = (int32)HeightMap.Heightmap->Width();
+			const int32 SizeY = (int32)HeightMap.Heightmap->Height();
+			const int32 TextureX = Texture->GetSizeX();
+			const int32 TextureY = Texture->GetSizeY();
+
+			// Smaller textures (previews) get the mip level that matches their size
+			int32 MipLevel = -1;
+			for (int32 Level = 0; Level <= LandscapeGeneration::GetMipLevelCount(SizeX, SizeY); Level++)
+			{
+				int32 LevelX, LevelY;
+				LandscapeGeneration::GetMipLevelSize(SizeX, SizeY, Level, LevelX, LevelY);
+
+				if (LevelX == TextureX && LevelY == TextureY)
+				{
+					MipLevel = Level;
+					break;
+				}
+			}
+
+			// Low resolution previews are stretched to fit instead
+			const bool bIsFloat = HeightMap.Heightmap->Format() == LandscapeGeneration::ImageFormat;
+			const bool bUpsample = MipLevel < 0 && bIsFloat && TextureX >= SizeX && TextureY >= SizeY;
+
+			if ((MipLevel < 0 && !bUpsample) || (MipLevel > 0 && !bIsFloat))
+			{
+				UE_LOG(LogTemp, Warning, TEXT("Set Transient Heightmap failed, the texture doesn't match any mip level of the heightmap"));
+				return;
+			}
+
 			// This has to be added to the queue so that its executed in order
-			LandscapeGeneration::PushKernel([=, this]() -> void
+			PushNodeKernel("Set Transient Heightmap", [=, this](LandscapeGeneration::Job&) -> void
 			{
-				FUpdateTextureRegion2D* UpdateRegion = new FUpdateTextureRegion2D(0, 0, 0, 0, HeightMap.Heightmap->Image.width(), HeightMap.Heightmap->Image.height());
+				FUpdateTextureRegion2D* UpdateRegion = new FUpdateTextureRegion2D(0, 0, 0, 0, TextureX, TextureY);
 
 				const auto deleteFunction = [](uint8* Data, const FUpdateTextureRegion2D* UpdateRegion) { delete[] Data; delete UpdateRegion; };
 
-				if (HeightMap.Heightmap->Image.format() == boost::compute::image_format(CL_R, CL_UNSIGNED_INT16))
+				if (HeightMap.Heightmap->Format() == boost::compute::image_format(CL_R, CL_UNSIGNED_INT16))
 				{
 					uint16* RawCopy = (uint16*)HeightMap.Heightmap->CreateRawCopy();
-					const auto PxNum = HeightMap.Heightmap->Image.width() * HeightMap.Heightmap->Image.height();
+					const auto PxNum = HeightMap.Heightmap->Width() * HeightMap.Heightmap->Height();
 					
 					// Convert in place
 					for (int32 i = 0; i < PxNum; i++)
@@ -190,14 +329,36 @@ void ALandscapeGen::SetTransientHeightmap(UTexture2D* Texture, FHeightmapWrapper
 						RawCopy[i] = *(uint16*)&conv;
 					}
 
-					Texture->UpdateTextureRegions(0, 1, UpdateRegion, HeightMap.Heightmap->Image.width() * 2, 2, (uint8*)RawCopy,
+					Texture->UpdateTextureRegions(0, 1, UpdateRegion, HeightMap.Heightmap->Width() * 2, 2, (uint8*)RawCopy,
 						deleteFunction);
 				}
-				else if (HeightMap.Heightmap->Image.format() == boost::compute::image_format(CL_R, CL_FLOAT))
+				else if (HeightMap.Heightmap->Format() == boost::compute::image_format(CL_R, CL_FLOAT))
 				{
 					UE_LOG(LogTemp, Warning, TEXT("CL_R, CL_FLOAT"));
-					float* RawCopy = (float*)HeightMap.Heightmap->CreateRawCopy();
-					const auto PxNum = HeightMap.Heightmap->Image.width() * HeightMap.Heightmap->Image.height();
+
+					// Resample on the device so only a texture sized image is read back
+					auto Source = HeightMap.Heightmap;
+					if ((MipLevel > 0 || bUpsample) && !catch_error([&]() -> void
+					{
+						Source = LandscapeGeneration::CreateHeightmap(TextureX, TextureY);
+
+						if (bUpsample)
+						{
+							LandscapeGeneration::Kernels::Resample(HeightMap.Heightmap->Image, Source->Image);
+						}
+						else
+						{
+							auto Pyramid = LandscapeGeneration::Kernels::MipPyramid(HeightMap.Heightmap->Image, MipLevel);
+							LandscapeGeneration::Kernels::MipChannel(Pyramid.back()->Image, Source->Image, LandscapeGeneration::MipReduction::Average);
+						}
+					}))
+					{
+						delete UpdateRegion;
+						return;
+					}
+
+					float* RawCopy = (float*)Source->CreateRawCopy();
+					const auto PxNum = TextureX * TextureY;
 					FFloat16* ConvCopy = new FFloat16[PxNum];
 					
 					for (int32 i = 0; i < PxNum; i++)
@@ -207,19 +368,19 @@ void ALandscapeGen::SetTransientHeightmap(UTexture2D* Texture, FHeightmapWrapper
 
 					delete[] RawCopy;
 
-					Texture->UpdateTextureRegions(0, 1, UpdateRegion, HeightMap.Heightmap->Image.width() * 2, 2, (uint8*)ConvCopy,
+					Texture->UpdateTextureRegions(0, 1, UpdateRegion, TextureX * 2, 2, (uint8*)ConvCopy,
 						deleteFunction);
 				}
-				else if (HeightMap.Heightmap->Image.format() == boost::compute::image_format(CL_RGBA, CL_FLOAT))
+				else if (HeightMap.Heightmap->Format() == boost::compute::image_format(CL_RGBA, CL_FLOAT))
 				{
-					Texture->UpdateTextureRegions(0, 1, UpdateRegion, HeightMap.Heightmap->Image.width() * 16, 16, (uint8*)HeightMap.Heightmap->CreateRawCopy(),
+					Texture->UpdateTextureRegions(0, 1, UpdateRegion, HeightMap.Heightmap->Width() * 16, 16, (uint8*)HeightMap.Heightmap->CreateRawCopy(),
 						deleteFunction);
 				}
 				else
 				{
 					delete UpdateRegion;
 				}
-			});
+			}, { &HeightMap });
 
 		}
 	}
@@ -284,16 +445,18 @@ FHeightmapWrapper ALandscapeGen::Constant(float Height)
 
 	if (Landscape.IsValid())
 	{
-		auto LandscapeRef = Landscape.Get();
-		auto LandscapeBounds = LandscapeRef->GetBoundingRect();
+		int32 SizeX, SizeY;
+		GetGraphSize(SizeX, SizeY);
 
-		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(
-			LandscapeBounds.Max.X + 1, LandscapeBounds.Max.Y + 1);
+		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
 
-		LandscapeGeneration::PushKernel([=]() -> void
+		std::weak_ptr<LandscapeGeneration::Heightmap> Output = NewHeightmap.Heightmap;
+
+		PushNodeKernel("Constant", [=](LandscapeGeneration::Job&) -> void
 		{
-			LandscapeGeneration::Kernels::Constant(NewHeightmap.Heightmap->Image, Height);
-		});
+			if (auto OutputHeightmap = Output.lock())
+				LandscapeGeneration::Kernels::Constant(OutputHeightmap->Image, Height);
+		}, {}, { &NewHeightmap });
 	}
 
 	return NewHeightmap;
@@ -306,56 +469,187 @@ FHeightmapWrapper ALandscapeGen::Perlin_Noise(float Size, int32 Seed, int32 Dept
 
 	if (Landscape.IsValid())
 	{
-		auto LandscapeRef = Landscape.Get();
-		auto LandscapeBounds = LandscapeRef->GetBoundingRect();
+		int32 SizeX, SizeY;
+		GetGraphSize(SizeX, SizeY);
+		const auto Region = GetGraphRegion();
 
-		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(
-			LandscapeBounds.Max.X + 1, LandscapeBounds.Max.Y + 1);
+		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
+
+		// Only a weak reference, the kernel is skipped once nothing needs the output
+		std::weak_ptr<LandscapeGeneration::Heightmap> Output = NewHeightmap.Heightmap;
+
+		PushNodeKernel("Perlin Noise", [=](LandscapeGeneration::Job&) -> void
+		{
+			if (auto OutputHeightmap = Output.lock())
+				LandscapeGeneration::Kernels::PerlinNoise(OutputHeightmap->Image, Size, Seed, Depth, Amplitude, Region);
+		}, {}, { &NewHeightmap });
+	}
+
+	return NewHeightmap;
+}
+
+FHeightmapBatchOutput ALandscapeGen::Perlin_Noise_Batch(const TArray<FBatchNoiseParams>& ParamSets, int32 Depth,
+	int32 ThumbnailSize)
+{
+	UE_LOG(LogTemp, Warning, TEXT("Perlin Noise Batch"));
+	FHeightmapBatchOutput Output;
+
+	if (Landscape.IsValid() && ParamSets.Num() > 0)
+	{
+		int32 SizeX, SizeY;
+		GetGraphSize(SizeX, SizeY);
+		const auto Region = GetGraphRegion();
 
-		LandscapeGeneration::PushKernel([=]() -> void
+		std::vector<LandscapeGeneration::Kernels::BatchNoiseParams> Params;
+		for (const auto& ParamSet : ParamSets)
 		{
-			//CreateNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Generating Perlin Noise..."));
+			LandscapeGeneration::Kernels::BatchNoiseParams Param;
+			Param.Seed		= ParamSet.Seed;
+			Param.NoiseSize	= ParamSet.Size;
+			Param.Amplitude	= ParamSet.Amplitude;
+			Params.push_back(Param);
+		}
+
+		auto Batch = LandscapeGeneration::Kernels::CreateHeightmapBatch(SizeX, SizeY, ParamSets.Num(), ThumbnailSize);
+
+		// Only weak references, the kernel is skipped once nothing needs any of the outputs.
+		// It writes every layer, so the maps that are gone are replaced with scratch images
+		std::vector<std::weak_ptr<LandscapeGeneration::Heightmap>> Maps;
+		std::vector<FHeightmapWrapper*> Outputs;
+
+		Output.Maps.SetNum(ParamSets.Num());
+		for (int32 i = 0; i < ParamSets.Num(); i++)
+		{
+			Output.Maps[i].Heightmap = Batch.Maps[i];
+			Maps.push_back(Batch.Maps[i]);
+			Outputs.push_back(&Output.Maps[i]);
+		}
 
-			catch_error([=]() -> void
+		Output.Thumbnails.Heightmap = Batch.Thumbnails;
+		std::weak_ptr<LandscapeGeneration::Heightmap> Thumbnails = Batch.Thumbnails;
+		const int32 StripX = (int32)Batch.Thumbnails->Width();
+		const int32 StripY = (int32)Batch.Thumbnails->Height();
+		Outputs.push_back(&Output.Thumbnails);
+
+		PushNodeKernel("Perlin Noise Batch", [=](LandscapeGeneration::Job&) -> void
+		{
+			LandscapeGeneration::Kernels::HeightmapBatch Locked;
+
+			bool bAnyAlive = false;
+			for (const auto& Map : Maps)
 			{
-				LandscapeGeneration::Kernels::PerlinNoise(NewHeightmap.Heightmap->Image, Size, Seed, Depth, Amplitude);
-			}); //?
-				// Notify the user that a kernel finished
-				//FinishNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Finished Generating Perlin Noise"), false) :
-				// Notify the user that a kernel failed
-				//FinishNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Failed Generating Perlin Noise"), true);
-		});
+				auto LockedMap = Map.lock();
+				bAnyAlive |= (bool)LockedMap;
+				Locked.Maps.push_back(LockedMap ? LockedMap : LandscapeGeneration::CreateHeightmap(SizeX, SizeY));
+			}
+
+			auto LockedThumbnails = Thumbnails.lock();
+			if (!bAnyAlive && !LockedThumbnails)
+				return;
+
+			Locked.Thumbnails = LockedThumbnails ? LockedThumbnails : LandscapeGeneration::CreateHeightmap(StripX, StripY);
+
+			LandscapeGeneration::Kernels::PerlinNoiseBatch(Locked, Params, Depth, Region);
+		}, {}, Outputs);
 	}
 
-	return NewHeightmap;
+	return Output;
 }
 
-FHeightmapWrapper ALandscapeGen::Warped_Perlin_Noise(float Size, int32 Seed, int32 Depth, float Amplitude)
+FHeightmapBatchOutput ALandscapeGen::Perlin_Noise_Seeds(const TArray<int32>& Seeds, float Size, int32 Depth, float Amplitude,
+	int32 ThumbnailSize)
+{
+	TArray<FBatchNoiseParams> ParamSets;
+	for (int32 Seed : Seeds)
+	{
+		FBatchNoiseParams ParamSet;
+		ParamSet.Seed		= Seed;
+		ParamSet.Size		= Size;
+		ParamSet.Amplitude	= Amplitude;
+		ParamSets.Add(ParamSet);
+	}
+
+	return Perlin_Noise_Batch(ParamSets, Depth, ThumbnailSize);
+}
+
+FHeightmapWrapper ALandscapeGen::Warped_Perlin_Noise(float Size, int32 Seed, int32 Depth, float Amplitude,
+	int32 WarpDownsample, int32 WarpDepth)
 {
 	UE_LOG(LogTemp, Warning, TEXT("Warped Perlin Noise"));
 	FHeightmapWrapper NewHeightmap;
 
 	if (Landscape.IsValid())
 	{
-		auto LandscapeRef = Landscape.Get();
-		auto LandscapeBounds = LandscapeRef->GetBoundingRect();
+		int32 SizeX, SizeY;
+		GetGraphSize(SizeX, SizeY);
+		const auto Region = GetGraphRegion();
 
-		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(
-			LandscapeBounds.Max.X + 1, LandscapeBounds.Max.Y + 1);
+		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
+
+		// Only a weak reference, the kernel is skipped once nothing needs the output
+		std::weak_ptr<LandscapeGeneration::Heightmap> Output = NewHeightmap.Heightmap;
 
-		LandscapeGeneration::PushKernel([=]() -> void
+		LandscapeGeneration::Kernels::WarpFieldSettings Warp;
+		Warp.Downsample	= FMath::Max(WarpDownsample, 1);
+		Warp.Depth		= FMath::Max(WarpDepth, 0);
+
+		PushNodeKernel("Warped Perlin Noise", [=](LandscapeGeneration::Job&) -> void
 		{
-			//CreateNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Generating Perlin Noise..."));
+			if (auto OutputHeightmap = Output.lock())
+				LandscapeGeneration::Kernels::WarpedPerlinNoise(OutputHeightmap->Image, Size, Seed, Depth, Amplitude, Region, Warp);
+		}, {}, { &NewHeightmap });
+	}
 
-			catch_error([=]() -> void
-			{
-				LandscapeGeneration::Kernels::WarpedPerlinNoise(NewHeightmap.Heightmap->Image, Size, Seed, Depth, Amplitude);
-			}); //?
-				// Notify the user that a kernel finished
-				//FinishNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Finished Generating Perlin Noise"), false) :
-				// Notify the user that a kernel failed
-				//FinishNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Failed Generating Perlin Noise"), true);
-		});
+	return NewHeightmap;
+}
+
+FHeightmapWrapper ALandscapeGen::Simplex_Noise(float Size, int32 Seed, int32 Depth, float Amplitude)
+{
+	UE_LOG(LogTemp, Warning, TEXT("Simplex Noise"));
+	FHeightmapWrapper NewHeightmap;
+
+	if (Landscape.IsValid())
+	{
+		int32 SizeX, SizeY;
+		GetGraphSize(SizeX, SizeY);
+		const auto Region = GetGraphRegion();
+
+		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
+
+		// Only a weak reference, the kernel is skipped once nothing needs the output
+		std::weak_ptr<LandscapeGeneration::Heightmap> Output = NewHeightmap.Heightmap;
+
+		PushNodeKernel("Simplex Noise", [=](LandscapeGeneration::Job&) -> void
+		{
+			if (auto OutputHeightmap = Output.lock())
+				LandscapeGeneration::Kernels::SimplexNoise(OutputHeightmap->Image, Size, Seed, Depth, Amplitude, Region);
+		}, {}, { &NewHeightmap });
+	}
+
+	return NewHeightmap;
+}
+
+FHeightmapWrapper ALandscapeGen::Gradient_Noise(float Size, int32 Seed, int32 Depth, float Amplitude)
+{
+	UE_LOG(LogTemp, Warning, TEXT("Gradient Noise"));
+	FHeightmapWrapper NewHeightmap;
+
+	if (Landscape.IsValid())
+	{
+		int32 SizeX, SizeY;
+		GetGraphSize(SizeX, SizeY);
+		const auto Region = GetGraphRegion();
+
+		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
+
+		// Only a weak reference, the kernel is skipped once nothing needs the output
+		std::weak_ptr<LandscapeGeneration::Heightmap> Output = NewHeightmap.Heightmap;
+
+		PushNodeKernel("Gradient Noise", [=](LandscapeGeneration::Job&) -> void
+		{
+			if (auto OutputHeightmap = Output.lock())
+				LandscapeGeneration::Kernels::GradientNoise(OutputHeightmap->Image, Size, Seed, Depth, Amplitude, Region);
+		}, {}, { &NewHeightmap });
 	}
 
 	return NewHeightmap;
@@ -368,28 +662,80 @@ FHeightmapWrapper ALandscapeGen::Voronoi_Noise(int32 Size, int32 Seed, float Amp
 
 	if (Landscape.IsValid())
 	{
-		auto LandscapeRef = Landscape.Get();
-		auto LandscapeBounds = LandscapeRef->GetBoundingRect();
+		int32 SizeX, SizeY;
+		GetGraphSize(SizeX, SizeY);
+		const auto Region = GetGraphRegion();
 
-		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(
-			LandscapeBounds.Max.X + 1, LandscapeBounds.Max.Y + 1);
+		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
 
-		LandscapeGeneration::PushKernel([=]() -> void
+		// Only a weak reference, the kernel is skipped once nothing needs the output
+		std::weak_ptr<LandscapeGeneration::Heightmap> Output = NewHeightmap.Heightmap;
+
+		PushNodeKernel("Voronoi Noise", [=](LandscapeGeneration::Job&) -> void
 		{
-			//CreateNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Generating Perlin Noise..."));
+			if (auto OutputHeightmap = Output.lock())
+				LandscapeGeneration::Kernels::VoronoiNoise(OutputHeightmap->Image, Size, Seed, Amplitude, Region);
+		}, {}, { &NewHeightmap });
+	}
 
-			catch_error([=]() -> void
+	return NewHeightmap;
+}
+
+FVoronoiOutput ALandscapeGen::Voronoi_Features(int32 Size, int32 Seed, float Amplitude)
+{
+	UE_LOG(LogTemp, Warning, TEXT("Voronoi Features"));
+	FVoronoiOutput Output;
+
+	if (Landscape.IsValid() && Size > 0)
+	{
+		int32 SizeX, SizeY;
+		GetGraphSize(SizeX, SizeY);
+		const auto Region = GetGraphRegion();
+
+		Output.F1.Heightmap		= LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
+		Output.F2.Heightmap		= LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
+		Output.Edge.Heightmap	= LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
+		Output.CellId.Heightmap	= LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
+
+		// Only weak references, the kernel is skipped once nothing needs any of the outputs.
+		// It writes all four, so the ones that are gone are replaced with scratch images
+		std::weak_ptr<LandscapeGeneration::Heightmap> F1		= Output.F1.Heightmap;
+		std::weak_ptr<LandscapeGeneration::Heightmap> F2		= Output.F2.Heightmap;
+		std::weak_ptr<LandscapeGeneration::Heightmap> Edge		= Output.Edge.Heightmap;
+		std::weak_ptr<LandscapeGeneration::Heightmap> CellId	= Output.CellId.Heightmap;
+
+		PushNodeKernel("Voronoi Features", [=](LandscapeGeneration::Job&) -> void
+		{
+			const auto LockOrScratch = [=](const std::weak_ptr<LandscapeGeneration::Heightmap>& Map)
 			{
-				LandscapeGeneration::Kernels::VoronoiNoise(NewHeightmap.Heightmap->Image, Size, Seed, Amplitude);
-			}); //?
-				// Notify the user that a kernel finished
-				//FinishNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Finished Generating Perlin Noise"), false) :
-				// Notify the user that a kernel failed
-				//FinishNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Failed Generating Perlin Noise"), true);
-		});
+				auto Locked = Map.lock();
+				return Locked ? Locked : LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
+			};
+
+			auto F1Map		= LockOrScratch(F1);
+			auto F2Map		= LockOrScratch(F2);
+			auto EdgeMap	= LockOrScratch(Edge);
+			auto CellIdMap	= LockOrScratch(CellId);
+
+			LandscapeGeneration::Kernels::VoronoiFeatures(F1Map->Image, F2Map->Image, EdgeMap->Image, CellIdMap->Image,
+				Size, Seed, Amplitude, Region);
+		}, {}, { &Output.F1, &Output.F2, &Output.Edge, &Output.CellId });
 	}
 
-	return NewHeightmap;
+	return Output;
+}
+
+// Returns a job progress callback that shows the progress in Notification.
+// Format gets the percentage as {0}
+static std::function<void(float)> NotificationProgress(TSharedPtr<SNotificationItem> Notification, const FText& Format)
+{
+	return [=](float Progress)
+	{
+		AsyncTask(ENamedThreads::GameThread, [=]()
+		{
+			Notification->SetText(FText::Format(Format, FText::AsNumber(FMath::RoundToInt(Progress * 100.f))));
+		});
+	};
 }
 
 static FErosionOutput fromErosionParams(const LandscapeGeneration::Kernels::ErosionParams& ErosionParams)
@@ -417,35 +763,252 @@ FErosionOutput ALandscapeGen::Erode_Landscape(FHeightmapWrapper HeightmapInput,
 	const auto WaterImageFormat = compute::image_format(CL_R, CL_FLOAT);
 
 	Input.height = HeightmapInput.Heightmap;
-	Input.water = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Image.width(), HeightmapInput.Heightmap->Image.width(), WaterImageFormat);
-	Input.hardness = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Image.width(), HeightmapInput.Heightmap->Image.width(), WaterImageFormat);
-	Input.sediment = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Image.width(), HeightmapInput.Heightmap->Image.width(), WaterImageFormat);
-	Input.sedimentCapacity = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Image.width(), HeightmapInput.Heightmap->Image.width(), WaterImageFormat);
-	Input.flux = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Image.width(), HeightmapInput.Heightmap->Image.width(), FluxImageFormat);
-	Input.velocity = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Image.width(), HeightmapInput.Heightmap->Image.width(), FluxImageFormat);
+	Input.water = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Width(), HeightmapInput.Heightmap->Width(), WaterImageFormat);
+	Input.hardness = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Width(), HeightmapInput.Heightmap->Width(), WaterImageFormat);
+	Input.sediment = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Width(), HeightmapInput.Heightmap->Width(), WaterImageFormat);
+	Input.sedimentCapacity = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Width(), HeightmapInput.Heightmap->Width(), WaterImageFormat);
+	Input.flux = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Width(), HeightmapInput.Heightmap->Width(), FluxImageFormat);
+	Input.velocity = LandscapeGeneration::CreateHeightmap(HeightmapInput.Heightmap->Width(), HeightmapInput.Heightmap->Width(), FluxImageFormat);
 
-	LandscapeGeneration::PushKernel([=]() -> void
+	FErosionOutput Output = fromErosionParams(Input);
+
+	// The rest of the maps are only erosion state, whether the job is still
+	// needed depends on the height
+	std::weak_ptr<LandscapeGeneration::Heightmap> Height = Input.height;
+	Input.height = nullptr;
+
+	auto ErosionJob = PushNodeKernel("Erosion", [=](LandscapeGeneration::Job& ThisJob) -> void
 	{
-		//CreateNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Generating Perlin Noise..."));
+		auto Maps = Input;
+		Maps.height = Height.lock();
+		if (!Maps.height)
+			return;
+
 		auto NotificationFuture = CreateNotification(LOCTEXT("LandscapeGenNotifications", "Simulating erosion..."));
+		NotificationFuture.wait();
+		auto Notification = NotificationFuture.get();
 
-		catch_error([=]() -> void
+		ThisJob.OnProgress = NotificationProgress(Notification, LOCTEXT("ErosionProgress", "Simulating erosion... {0}%"));
+
+		const auto FinishNotification = [=](SNotificationItem::ECompletionState State)
 		{
-			auto ErosionRet = LandscapeGeneration::Kernels::Erosion(Input,
-				iterations, DeltaTime, waterMul, softeningCoefficient, maxErosionDepth, sedimentCapacity);
-		}); 
-		
+			AsyncTask(ENamedThreads::GameThread, [=]()
+			{
+				Notification->SetCompletionState(State);
+				Notification->ExpireAndFadeout();
+			});
+		};
+
+		// The state maps are new, erosion starts from dry terrain
+		LandscapeGeneration::Kernels::ClearErosionState(Maps);
+
+		try
+		{
+			LandscapeGeneration::Kernels::Erosion(Maps,
+				iterations, DeltaTime, waterMul, softeningCoefficient, maxErosionDepth, sedimentCapacity, &ThisJob);
+		}
+		catch (...)
+		{
+			// Failed or cancelled, the job works out which
+			FinishNotification(SNotificationItem::CS_Fail);
+			throw;
+		}
+
+		FinishNotification(SNotificationItem::CS_Success);
+	}, { &HeightmapInput }, { &Output.height });
+
+	// All of the outputs come from the same job
+	Output.water.Job			= ErosionJob;
+	Output.hardness.Job			= ErosionJob;
+	Output.sediment.Job			= ErosionJob;
+	Output.sedimentCapacity.Job	= ErosionJob;
+	Output.flux.Job				= ErosionJob;
+	Output.velocity.Job			= ErosionJob;
+
+	return Output;
+}
+
+TArray<FErosionSweepRun> ALandscapeGen::Erode_Landscape_Sweep(FHeightmapWrapper HeightmapInput, int32 iterations,
+	const TArray<float>& WaterMuls, const TArray<float>& SofteningCoefficients,
+	const TArray<float>& MaxErosionDepths, const TArray<float>& SedimentCapacities, float DeltaTime)
+{
+	UE_LOG(LogTemp, Warning, TEXT("Erosion Sweep"));
+	TArray<FErosionSweepRun> Output;
+
+	if (!HeightmapInput.Heightmap)
+		return Output;
+
+	const auto ToVector = [](const TArray<float>& Values)
+	{
+		return std::vector<float>(Values.GetData(), Values.GetData() + Values.Num());
+	};
+
+	LandscapeGeneration::Kernels::ErosionSettings Base;
+	Base.DeltaTime = DeltaTime;
+
+	const auto Runs = LandscapeGeneration::Kernels::ErosionSweepGrid(Base, ToVector(WaterMuls), ToVector(SofteningCoefficients),
+		ToVector(MaxErosionDepths), ToVector(SedimentCapacities));
+
+	const int32 SizeX = HeightmapInput.Heightmap->Width();
+	const int32 SizeY = HeightmapInput.Heightmap->Height();
+
+	std::vector<std::weak_ptr<LandscapeGeneration::Heightmap>> Heights;
+	std::vector<FHeightmapWrapper*> Outputs;
+
+	Output.SetNum(Runs.size());
+	for (int32 i = 0; i < Output.Num(); i++)
+	{
+		Output[i].Height.Heightmap		= LandscapeGeneration::CreateHeightmap(SizeX, SizeY);
+		Output[i].WaterMul				= Runs[i].waterMul;
+		Output[i].SofteningCoefficient	= Runs[i].softeningCoefficient;
+		Output[i].MaxErosionDepth		= Runs[i].maxErosionDepth;
+		Output[i].SedimentCapacity		= Runs[i].sedimentCapacity;
+
+		Heights.push_back(Output[i].Height.Heightmap);
+		Outputs.push_back(&Output[i].Height);
+	}
+
+	std::weak_ptr<LandscapeGeneration::Heightmap> Input = HeightmapInput.Heightmap;
+
+	PushNodeKernel("Erosion Sweep", [=](LandscapeGeneration::Job& ThisJob) -> void
+	{
+		const auto FluxImageFormat = compute::image_format(CL_RGBA, CL_FLOAT);
+		const auto WaterImageFormat = compute::image_format(CL_R, CL_FLOAT);
+
+		// Runs whose height is gone still run, so the rest keep their place in the grid
+		bool bAnyAlive = false;
+		std::vector<std::shared_ptr<LandscapeGeneration::Heightmap>> OutputHeights;
+		for (const auto& Height : Heights)
+		{
+			auto Locked = Height.lock();
+			bAnyAlive |= (bool)Locked;
+			OutputHeights.push_back(Locked ? Locked : LandscapeGeneration::CreateHeightmap(SizeX, SizeY));
+		}
+
+		LandscapeGeneration::Kernels::ErosionParams Maps;
+		Maps.height = Input.lock();
+		if (!bAnyAlive || !Maps.height)
+			return;
+
+		Maps.water				= LandscapeGeneration::CreateHeightmap(SizeX, SizeY, WaterImageFormat);
+		Maps.hardness			= LandscapeGeneration::CreateHeightmap(SizeX, SizeY, WaterImageFormat);
+		Maps.sediment			= LandscapeGeneration::CreateHeightmap(SizeX, SizeY, WaterImageFormat);
+		Maps.sedimentCapacity	= LandscapeGeneration::CreateHeightmap(SizeX, SizeY, WaterImageFormat);
+		Maps.flux				= LandscapeGeneration::CreateHeightmap(SizeX, SizeY, FluxImageFormat);
+		Maps.velocity			= LandscapeGeneration::CreateHeightmap(SizeX, SizeY, FluxImageFormat);
+
+		LandscapeGeneration::Kernels::ClearErosionState(Maps);
+
+		const auto Results = LandscapeGeneration::Kernels::ErosionSweep(Maps, iterations, Runs, OutputHeights, &ThisJob);
+
+		for (const auto& Result : Results)
+		{
+			UE_LOG(LogTemp, Log, TEXT("Erosion sweep waterMul %f softening %f maxDepth %f sedimentCapacity %f: %.1f ms on %s"),
+				Result.Settings.waterMul, Result.Settings.softeningCoefficient, Result.Settings.maxErosionDepth,
+				Result.Settings.sedimentCapacity, Result.Seconds * 1000.0, ANSI_TO_TCHAR(Result.Lane.c_str()));
+		}
+	}, { &HeightmapInput }, Outputs);
+
+	return Output;
+}
+
+void ALandscapeGen::Erode_Landscape_Tiled(int32 iterations, int32 IterationsPerPass, int32 TileSize,
+	float DeltaTime, float waterMul, float softeningCoefficient, float maxErosionDepth, float sedimentCapacity)
+{
+	UE_LOG(LogTemp, Warning, TEXT("Tiled Erosion"));
+
+	if (!Landscape.IsValid())
+		return;
+
+	auto LandscapeBounds = Landscape.Get()->GetBoundingRect();
+	const int32 SizeX = LandscapeBounds.Max.X + 1;
+	const int32 SizeY = LandscapeBounds.Max.Y + 1;
+
+	TArray<uint16> LandscapeData = GetLandscapeHeightmapSorted();
+	if (LandscapeData.Num() != SizeX * SizeY)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("Tiled Erosion failed, couldn't read the landscape's heightmap"));
+		return;
+	}
+
+	// Tiles that aren't being worked on get paged out to here
+	const FString ScratchDir = FPaths::ProjectSavedDir() + TEXT("LandscapeGeneration/");
+	IFileManager::Get().MakeDirectory(*ScratchDir, true);
+	const std::string ScratchPath(TCHAR_TO_UTF8(*ScratchDir));
+
+	TileSize = FMath::Max(TileSize, 1);
+
+	std::shared_ptr<LandscapeGeneration::TiledHeightmap> Tiles(new LandscapeGeneration::TiledHeightmap(
+		SizeX, SizeY, TileSize, 1, ScratchPath + "landscape.tiles"));
+
+	// Fill the tiles from the landscape a row at a time
+	{
+		std::vector<float> Row(SizeX);
+		for (int32 y = 0; y < SizeY; y++)
+		{
+			for (int32 x = 0; x < SizeX; x++)
+			{
+				Row[x] = (float)LandscapeData[y * SizeX + x];
+			}
+
+			Tiles->WriteRegion(0, y, SizeX, 1, Row.data());
+		}
+	}
+
+	LandscapeGeneration::Kernels::ErosionSettings Settings;
+	Settings.DeltaTime				= DeltaTime;
+	Settings.waterMul				= waterMul;
+	Settings.softeningCoefficient	= softeningCoefficient;
+	Settings.maxErosionDepth		= maxErosionDepth;
+	Settings.sedimentCapacity		= sedimentCapacity;
+
+	LandscapeGeneration::PushJob([=, this](LandscapeGeneration::Job& ThisJob) -> void
+	{
+		LandscapeGeneration::Profiling::ScopedSpan Span("Tiled Erosion", "Node");
+
+		auto NotificationFuture = CreateNotification(LOCTEXT("LandscapeGenNotifications", "Simulating tiled erosion..."));
 		NotificationFuture.wait();
 		auto Notification = NotificationFuture.get();
 
-		AsyncTask(ENamedThreads::GameThread, [=]()
+		ThisJob.OnProgress = NotificationProgress(Notification, LOCTEXT("TiledErosionProgress", "Simulating tiled erosion... {0}%"));
+
+		const bool bSuccess = catch_error([&]() -> void
+		{
+			LandscapeGeneration::Kernels::TiledErosion(*Tiles, iterations, IterationsPerPass, TileSize, Settings, ScratchPath, &ThisJob);
+		});
+
+		TArray<uint16> HeightMapArray;
+		if (bSuccess)
+		{
+			HeightMapArray.SetNumUninitialized(SizeX * SizeY);
+
+			std::vector<float> Row(SizeX);
+			for (int32 y = 0; y < SizeY; y++)
+			{
+				Tiles->ReadRegion(0, y, SizeX, 1, Row.data());
+
+				for (int32 x = 0; x < SizeX; x++)
+				{
+					HeightMapArray[y * SizeX + x] = (uint16)roundf(FMath::Clamp(Row[x], 0.f, (float)UINT16_MAX));
+				}
+			}
+		}
+
+		// We can't call the editorutil function from the async thread, so it has to be from here
+		AsyncTask(ENamedThreads::GameThread, [=, this]()
 		{
-			Notification->SetCompletionState(SNotificationItem::CS_Success);
+			Notification->SetCompletionState(bSuccess ? SNotificationItem::CS_Success : SNotificationItem::CS_Fail);
 			Notification->ExpireAndFadeout();
+
+#if WITH_EDITOR
+			if (bSuccess)
+			{
+				LandscapeGeneration::Profiling::ScopedSpan Span("Landscape Update", "Game Thread");
+				LandscapeEditorUtils::SetHeightmapData(Landscape.Get(), HeightMapArray);
+			}
+#endif
 		});
 	});
-
-	return fromErosionParams(Input);
 }
 
 FHeightmapWrapper ALandscapeGen::Mix(FHeightmapWrapper LHeightMap, FHeightmapWrapper RHeightMap, EMixType MixType)
@@ -457,26 +1020,132 @@ FHeightmapWrapper ALandscapeGen::Mix(FHeightmapWrapper LHeightMap, FHeightmapWra
 	if (LHeightMap.Heightmap != nullptr && RHeightMap.Heightmap != nullptr)
 	{
 		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(
-			LHeightMap.Heightmap->Image.width(), LHeightMap.Heightmap->Image.height());
+			LHeightMap.Heightmap->Width(), LHeightMap.Heightmap->Height());
+
+		std::weak_ptr<LandscapeGeneration::Heightmap> Output = NewHeightmap.Heightmap;
 
-		LandscapeGeneration::PushKernel([=]() -> void
+		PushNodeKernel("Mix", [=](LandscapeGeneration::Job&) -> void
 		{
-			//CreateNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Mixing Heightmaps..."));
+			if (auto OutputHeightmap = Output.lock())
+				LandscapeGeneration::Kernels::Mix(LHeightMap.Heightmap->Image,
+					RHeightMap.Heightmap->Image, OutputHeightmap->Image, LandscapeGeneration::ToCore(MixType));
+		}, { &LHeightMap, &RHeightMap }, { &NewHeightmap });
+	}
 
-			catch_error([=]() -> void
+	return NewHeightmap;
+}
+
+FHeightmapWrapper ALandscapeGen::Downsample(FHeightmapWrapper HeightMap, int32 MipLevel, EMipReduction Reduction)
+{
+	UE_LOG(LogTemp, Warning, TEXT("Downsample"));
+	FHeightmapWrapper NewHeightmap;
+
+	if (HeightMap.Heightmap != nullptr)
+	{
+		const int32 SizeX = (int32)HeightMap.Heightmap->Width();
+		const int32 SizeY = (int32)HeightMap.Heightmap->Height();
+		MipLevel = FMath::Clamp(MipLevel, 1, FMath::Max(LandscapeGeneration::GetMipLevelCount(SizeX, SizeY), 1));
+
+		int32 LevelX, LevelY;
+		LandscapeGeneration::GetMipLevelSize(SizeX, SizeY, MipLevel, LevelX, LevelY);
+		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(LevelX, LevelY);
+
+		std::weak_ptr<LandscapeGeneration::Heightmap> Output = NewHeightmap.Heightmap;
+
+		PushNodeKernel("Downsample", [=](LandscapeGeneration::Job&) -> void
+		{
+			if (auto OutputHeightmap = Output.lock())
 			{
-				LandscapeGeneration::Kernels::Mix(LHeightMap.Heightmap->Image,
-					RHeightMap.Heightmap->Image, NewHeightmap.Heightmap->Image, MixType);
-			}); //?
-				//FinishNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Finished Mixing Heightmaps"), false) :
-				// Notify the user that a kernel failed
-				//FinishNotification(OutFuture, LOCTEXT("LandscapeGenNotifications", "Failed Mixing Heightmaps"), true);
-		});
+				auto Pyramid = LandscapeGeneration::Kernels::MipPyramid(HeightMap.Heightmap->Image, MipLevel);
+				LandscapeGeneration::Kernels::MipChannel(Pyramid.back()->Image, OutputHeightmap->Image, LandscapeGeneration::ToCore(Reduction));
+			}
+		}, { &HeightMap }, { &NewHeightmap });
+	}
+
+	return NewHeightmap;
+}
+
+FHeightmapWrapper ALandscapeGen::PushFilterNode(const char* NodeName, const FHeightmapWrapper& HeightMap,
+	std::function<void(boost::compute::image2d&, boost::compute::image2d&)> Filter)
+{
+	UE_LOG(LogTemp, Warning, TEXT("%s"), UTF8_TO_TCHAR(NodeName));
+	FHeightmapWrapper NewHeightmap;
+
+	if (HeightMap.Heightmap != nullptr)
+	{
+		NewHeightmap.Heightmap = LandscapeGeneration::CreateHeightmap(
+			HeightMap.Heightmap->Width(), HeightMap.Heightmap->Height());
+
+		std::weak_ptr<LandscapeGeneration::Heightmap> Output = NewHeightmap.Heightmap;
+		const FHeightmapWrapper Input = HeightMap;
+
+		PushNodeKernel(NodeName, [=](LandscapeGeneration::Job&) -> void
+		{
+			if (auto OutputHeightmap = Output.lock())
+				Filter(Input.Heightmap->Image, OutputHeightmap->Image);
+		}, { &HeightMap }, { &NewHeightmap });
 	}
 
 	return NewHeightmap;
 }
 
+FHeightmapWrapper ALandscapeGen::Box_Blur(FHeightmapWrapper HeightMap, int32 Radius)
+{
+	return PushFilterNode("Box Blur", HeightMap, [=](boost::compute::image2d& Input, boost::compute::image2d& Output)
+	{
+		LandscapeGeneration::Kernels::BoxBlur(Input, Output, Radius);
+	});
+}
+
+FHeightmapWrapper ALandscapeGen::Gaussian_Blur(FHeightmapWrapper HeightMap, float Sigma)
+{
+	return PushFilterNode("Gaussian Blur", HeightMap, [=](boost::compute::image2d& Input, boost::compute::image2d& Output)
+	{
+		LandscapeGeneration::Kernels::GaussianBlur(Input, Output, Sigma);
+	});
+}
+
+FHeightmapWrapper ALandscapeGen::Min_Filter(FHeightmapWrapper HeightMap, int32 Radius)
+{
+	return PushFilterNode("Min Filter", HeightMap, [=](boost::compute::image2d& Input, boost::compute::image2d& Output)
+	{
+		LandscapeGeneration::Kernels::MinFilter(Input, Output, Radius);
+	});
+}
+
+FHeightmapWrapper ALandscapeGen::Max_Filter(FHeightmapWrapper HeightMap, int32 Radius)
+{
+	return PushFilterNode("Max Filter", HeightMap, [=](boost::compute::image2d& Input, boost::compute::image2d& Output)
+	{
+		LandscapeGeneration::Kernels::MaxFilter(Input, Output, Radius);
+	});
+}
+
+FHeightmapWrapper ALandscapeGen::Normalize(FHeightmapWrapper HeightMap, float Min, float Max)
+{
+	return PushFilterNode("Normalize", HeightMap, [=](boost::compute::image2d& Input, boost::compute::image2d& Output)
+	{
+		LandscapeGeneration::Kernels::Normalize(Input, Output, Min, Max);
+	});
+}
+
+FHeightmapWrapper ALandscapeGen::Remap(FHeightmapWrapper HeightMap, float InMin, float InMax,
+	float OutMin, float OutMax, bool bClamp)
+{
+	return PushFilterNode("Remap", HeightMap, [=](boost::compute::image2d& Input, boost::compute::image2d& Output)
+	{
+		LandscapeGeneration::Kernels::Remap(Input, Output, InMin, InMax, OutMin, OutMax, bClamp);
+	});
+}
+
+FHeightmapWrapper ALandscapeGen::Histogram_Equalize(FHeightmapWrapper HeightMap, int32 Bins)
+{
+	return PushFilterNode("Histogram Equalize", HeightMap, [=](boost::compute::image2d& Input, boost::compute::image2d& Output)
+	{
+		LandscapeGeneration::Kernels::HistogramEqualize(Input, Output, Bins);
+	});
+}
+
 void ALandscapeGen::SetHeightmap(FHeightmapWrapper HeightMap)
 {
 	UE_LOG(LogTemp, Warning, TEXT("Set Heightmap"));
@@ -484,29 +1153,91 @@ void ALandscapeGen::SetHeightmap(FHeightmapWrapper HeightMap)
 	// Check that the heightmap exists
 	if (HeightMap.Heightmap != nullptr)
 	{
-		if (HeightMap.Heightmap->Image.format() != boost::compute::image_format(CL_R, CL_UNSIGNED_INT16)
-			&& HeightMap.Heightmap->Image.format() != boost::compute::image_format(CL_R, CL_FLOAT))
+		if (HeightMap.Heightmap->Format() != boost::compute::image_format(CL_R, CL_UNSIGNED_INT16)
+			&& HeightMap.Heightmap->Format() != boost::compute::image_format(CL_R, CL_FLOAT))
 		{
 			UE_LOG(LogTemp, Warning, TEXT("Set Heightmap failed"));
 			return;
 		}
 
 		// This has to be added to the queue so that its executed in order
-		LandscapeGeneration::PushKernel([=, this]() -> void
+		PushNodeKernel("Set Heightmap", [=, this](LandscapeGeneration::Job&) -> void
 		{
 			// Read from the device to this height map array
-			TArray<uint16> HeightMapArray = *HeightMap.Heightmap.get();
+			TArray<uint16> HeightMapArray = LandscapeGeneration::ReadHeightmap<uint16>(*HeightMap.Heightmap);
 
 			// We can't call the editorutil function from the async thread, so it has to be from here
 			AsyncTask(ENamedThreads::GameThread, [=, this]()
 			{
 				UE_LOG(LogTemp, Warning, TEXT("Set Heightmap Async"));
+#if WITH_EDITOR
+				LandscapeGeneration::Profiling::ScopedSpan Span("Landscape Update", "Game Thread");
 				LandscapeEditorUtils::SetHeightmapData(Landscape.Get(), HeightMapArray);
+#else
+				UE_LOG(LogTemp, Warning, TEXT("Set Heightmap is only available in the editor"));
+#endif
 			});
-		});
+		}, { &HeightMap });
 	}
 }
 
+EJobStatus ALandscapeGen::Get_Job_Status(FHeightmapWrapper HeightMap)
+{
+	if (HeightMap.Job != nullptr)
+		return LandscapeGeneration::ToUnreal(HeightMap.Job->GetStatus());
+
+	// Heightmaps that weren't made by a job are ready straight away
+	return HeightMap.Heightmap != nullptr ? EJobStatus::E_Succeeded : EJobStatus::E_Failed;
+}
+
+float ALandscapeGen::Get_Job_Progress(FHeightmapWrapper HeightMap)
+{
+	if (HeightMap.Job != nullptr)
+		return HeightMap.Job->GetProgress();
+
+	return HeightMap.Heightmap != nullptr ? 1.f : 0.f;
+}
+
+void ALandscapeGen::Cancel_Job(FHeightmapWrapper HeightMap)
+{
+	if (HeightMap.Job != nullptr)
+		HeightMap.Job->Cancel();
+}
+
+void ALandscapeGen::Start_Profiling()
+{
+	UE_LOG(LogTemp, Warning, TEXT("Start Profiling"));
+
+	LandscapeGeneration::Profiling::Clear();
+	LandscapeGeneration::Profiling::SetEnabled(true);
+}
+
+void ALandscapeGen::Stop_Profiling(FString FileName)
+{
+	const FString Directory = FPaths::ProjectSavedDir() + TEXT("Profiling/");
+	IFileManager::Get().MakeDirectory(*Directory, true);
+
+	const FString Path = FPaths::ConvertRelativePathToFull(Directory + FileName);
+	const std::string PathString = TCHAR_TO_UTF8(*Path);
+
+	// Goes through the queue so everything pushed before it is in the trace
+	LandscapeGeneration::PushKernel([=]() -> void
+	{
+		LandscapeGeneration::Profiling::SetEnabled(false);
+
+		if (LandscapeGeneration::Profiling::WriteChromeTrace(PathString))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Profile written to %s"), *Path);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Couldn't write the profile to %s"), *Path);
+		}
+
+		LandscapeGeneration::Profiling::Clear();
+	});
+}
+
 // Called when the game starts or when spawned
 void ALandscapeGen::BeginPlay()
 {
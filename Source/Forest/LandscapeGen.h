@@ -10,6 +10,7 @@
 
 #include <memory>
 #include <future>
+#include <vector>
 
 #include "LandscapeGen.generated.h"
 
@@ -23,6 +24,9 @@ struct FHeightmapWrapper
 	GENERATED_BODY()
 
 	std::shared_ptr<LandscapeGeneration::Heightmap> Heightmap;
+
+	// The job that writes Heightmap, if it's still being generated
+	std::shared_ptr<LandscapeGeneration::Job> Job;
 };
 	
 USTRUCT(BlueprintType, meta = (DisplayName = "Erosion Output"))
@@ -52,10 +56,88 @@ struct FErosionOutput
 	FHeightmapWrapper velocity;
 };
 
+// All come from one dispatch, see LandscapeGeneration::Kernels::VoronoiFeatures
+USTRUCT(BlueprintType, meta = (DisplayName = "Voronoi Output"))
+struct FVoronoiOutput
+{
+	GENERATED_BODY()
+
+	// Distance to the nearest feature point
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Heightmaps")
+	FHeightmapWrapper F1;
+
+	// Distance to the second nearest feature point
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Heightmaps")
+	FHeightmapWrapper F2;
+
+	// F2 - F1, 0 on the cell borders
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Heightmaps")
+	FHeightmapWrapper Edge;
+
+	// A random 0 to Amplitude value per cell
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Heightmaps")
+	FHeightmapWrapper CellId;
+};
+
+// One combination of an erosion sweep and the height it eroded
+USTRUCT(BlueprintType, meta = (DisplayName = "Erosion Sweep Run"))
+struct FErosionSweepRun
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Heightmaps")
+	FHeightmapWrapper Height;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion")
+	float WaterMul = 0.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion")
+	float SofteningCoefficient = 0.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion")
+	float MaxErosionDepth = 0.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Erosion")
+	float SedimentCapacity = 0.f;
+};
+
+// One parameter set of a batched noise node
+USTRUCT(BlueprintType, meta = (DisplayName = "Batch Noise Parameters"))
+struct FBatchNoiseParams
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise")
+	int32 Seed = 0;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise")
+	float Size = 256.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise")
+	float Amplitude = 65535.f;
+};
+
+// See LandscapeGeneration::Kernels::PerlinNoiseBatch
+USTRUCT(BlueprintType, meta = (DisplayName = "Heightmap Batch"))
+struct FHeightmapBatchOutput
+{
+	GENERATED_BODY()
+
+	// Full resolution, one per parameter set
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Heightmaps")
+	TArray<FHeightmapWrapper> Maps;
+
+	// The thumbnails of Maps left to right, each ThumbnailSize wide
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Heightmaps")
+	FHeightmapWrapper Thumbnails;
+};
+
+#if WITH_EDITOR
 namespace LandscapeEditorUtils
 {
 	TMap<FIntPoint, uint16> GetHeightmapData(ALandscapeProxy* Landscape);
 }
+#endif
 
 UCLASS()
 class FOREST_API ALandscapeGen : public AActor
@@ -68,8 +150,10 @@ public:
 	UPROPERTY(EditAnywhere, Category="Landscape Actor")
 		TWeakObjectPtr<ALandscape> Landscape;
 
+	// MipLevel > 0 creates a smaller texture for previews, SetTransientHeightmap
+	// downsamples on the device to fill it
 	UFUNCTION(BlueprintCallable, Category = "Textures")
-		UTexture2D* CreateTransientHeightmap();
+		UTexture2D* CreateTransientHeightmap(int32 MipLevel = 0);
 
 	UFUNCTION(BlueprintCallable, Category = "Textures")
 		UTexture2D* CreateTransientTexture();
@@ -80,25 +164,133 @@ public:
 	UFUNCTION(BlueprintPure, Category = "Noise")
 		FHeightmapWrapper Perlin_Noise(float Size, int32 Seed, int32 Depth, float Amplitude);
 
+	// Perlin noise for every parameter set, evaluated as layers of an image array in a single
+	// dispatch rather than one node each, with a strip of thumbnails to pick from
 	UFUNCTION(BlueprintPure, Category = "Noise")
-		FHeightmapWrapper Warped_Perlin_Noise(float Size, int32 Seed, int32 Depth, float Amplitude);
+		FHeightmapBatchOutput Perlin_Noise_Batch(const TArray<FBatchNoiseParams>& ParamSets, int32 Depth,
+			int32 ThumbnailSize = 128);
+
+	// Perlin_Noise_Batch over Seeds with the same size and amplitude
+	UFUNCTION(BlueprintPure, Category = "Noise")
+		FHeightmapBatchOutput Perlin_Noise_Seeds(const TArray<int32>& Seeds, float Size, int32 Depth, float Amplitude,
+			int32 ThumbnailSize = 128);
+
+	// The warp offsets are evaluated at 1 / WarpDownsample of the resolution with WarpDepth
+	// octaves (0 uses Depth) and sampled bilinearly. WarpDownsample 1 evaluates them per pixel
+	UFUNCTION(BlueprintPure, Category = "Noise")
+		FHeightmapWrapper Warped_Perlin_Noise(float Size, int32 Seed, int32 Depth, float Amplitude,
+			int32 WarpDownsample = 4, int32 WarpDepth = 0);
+
+	// Simplex and gradient noise are cheaper per octave than Perlin_Noise
+	UFUNCTION(BlueprintPure, Category = "Noise")
+		FHeightmapWrapper Simplex_Noise(float Size, int32 Seed, int32 Depth, float Amplitude);
+
+	UFUNCTION(BlueprintPure, Category = "Noise")
+		FHeightmapWrapper Gradient_Noise(float Size, int32 Seed, int32 Depth, float Amplitude);
 
 	UFUNCTION(BlueprintPure, Category = "Noise")
 		FHeightmapWrapper Voronoi_Noise(int32 Size, int32 Seed, float Amplitude);
 
+	// Grid Voronoi with an integer hash, every output from a single kernel
+	UFUNCTION(BlueprintPure, Category = "Noise")
+		FVoronoiOutput Voronoi_Features(int32 Size, int32 Seed, float Amplitude);
+
 	UFUNCTION(BlueprintPure, Category = "Functions")
 		FErosionOutput Erode_Landscape(FHeightmapWrapper HeightmapInput, int32 iterations,
 			float DeltaTime = 0.016f, float waterMul = 0.012f, float softeningCoefficient = 5.0f, float maxErosionDepth = 10.f, float sedimentCapacity = 1.f);
 
+	// Erodes the landscape's current heightmap in tiles, so the terrain never has to fit on the device in
+	// one piece. Each tile is simulated IterationsPerPass iterations at a time before its halo is refreshed
+	UFUNCTION(BlueprintCallable, Category = "Functions")
+		void Erode_Landscape_Tiled(int32 iterations, int32 IterationsPerPass = 16, int32 TileSize = 2048,
+			float DeltaTime = 0.016f, float waterMul = 0.012f, float softeningCoefficient = 5.0f, float maxErosionDepth = 10.f, float sedimentCapacity = 1.f);
+
+	// Erodes HeightmapInput once for every combination of the values (an empty list keeps the
+	// default), sharing one upload and one program build per device. The runs are spread over
+	// every device when multi device is on, their timings are logged when they finish
+	UFUNCTION(BlueprintPure, Category = "Functions")
+		TArray<FErosionSweepRun> Erode_Landscape_Sweep(FHeightmapWrapper HeightmapInput, int32 iterations,
+			const TArray<float>& WaterMuls, const TArray<float>& SofteningCoefficients,
+			const TArray<float>& MaxErosionDepths, const TArray<float>& SedimentCapacities, float DeltaTime = 0.016f);
+
 	UFUNCTION(BlueprintPure, Category = "Functions")
 		FHeightmapWrapper Constant(float Height);
 
 	UFUNCTION(BlueprintPure, Category = "Functions")
 		FHeightmapWrapper Mix(FHeightmapWrapper LHeightMap, FHeightmapWrapper RHeightMap, EMixType MixType);
 
+	// Mip level MipLevel of the heightmap, each level is half the size of the one before.
+	// The whole chain up to MipLevel is reduced on the device
+	UFUNCTION(BlueprintPure, Category = "Functions")
+		FHeightmapWrapper Downsample(FHeightmapWrapper HeightMap, int32 MipLevel = 1, EMipReduction Reduction = EMipReduction::E_Average);
+
+	// Mean of the (2 * Radius + 1)^2 pixels around each pixel
+	UFUNCTION(BlueprintPure, Category = "Smoothing")
+		FHeightmapWrapper Box_Blur(FHeightmapWrapper HeightMap, int32 Radius = 4);
+
+	// Approximated by three box blurs, Sigma is in pixels
+	UFUNCTION(BlueprintPure, Category = "Smoothing")
+		FHeightmapWrapper Gaussian_Blur(FHeightmapWrapper HeightMap, float Sigma = 4.f);
+
+	// Lowest height within Radius pixels, erodes peaks and widens valleys
+	UFUNCTION(BlueprintPure, Category = "Smoothing")
+		FHeightmapWrapper Min_Filter(FHeightmapWrapper HeightMap, int32 Radius = 4);
+
+	// Highest height within Radius pixels, widens peaks and fills valleys
+	UFUNCTION(BlueprintPure, Category = "Smoothing")
+		FHeightmapWrapper Max_Filter(FHeightmapWrapper HeightMap, int32 Radius = 4);
+
+	// Stretches the heights so the lowest is Min and the highest is Max
+	UFUNCTION(BlueprintPure, Category = "Levels")
+		FHeightmapWrapper Normalize(FHeightmapWrapper HeightMap, float Min = 0.f, float Max = 65535.f);
+
+	// Maps InMin..InMax to OutMin..OutMax, heights outside the input range are clamped if bClamp is set
+	UFUNCTION(BlueprintPure, Category = "Levels")
+		FHeightmapWrapper Remap(FHeightmapWrapper HeightMap, float InMin = 0.f, float InMax = 65535.f,
+			float OutMin = 0.f, float OutMax = 65535.f, bool bClamp = true);
+
+	// Spreads the heights evenly over their range, flattens crowded heights and steepens rare ones
+	UFUNCTION(BlueprintPure, Category = "Levels")
+		FHeightmapWrapper Histogram_Equalize(FHeightmapWrapper HeightMap, int32 Bins = 1024);
+
 	UFUNCTION(BlueprintCallable, Category = "Functions")
 		void SetHeightmap(FHeightmapWrapper HeightMap);
 
+	UFUNCTION(BlueprintPure, Category = "Jobs")
+		EJobStatus Get_Job_Status(FHeightmapWrapper HeightMap);
+
+	// 0 to 1, only long running jobs (erosion) report progress before they finish
+	UFUNCTION(BlueprintPure, Category = "Jobs")
+		float Get_Job_Progress(FHeightmapWrapper HeightMap);
+
+	// Cancels the job that generates HeightMap. Jobs that depend on it are cancelled too
+	UFUNCTION(BlueprintCallable, Category = "Jobs")
+		void Cancel_Job(FHeightmapWrapper HeightMap);
+
+	// Starts recording where generation time goes, on the host and the device
+	UFUNCTION(BlueprintCallable, Category = "Profiling")
+		void Start_Profiling();
+
+	// Stops recording and writes a Chrome trace (chrome://tracing) to
+	// Saved/Profiling/FileName once everything queued so far has run
+	UFUNCTION(BlueprintCallable, Category = "Profiling")
+		void Stop_Profiling(FString FileName = TEXT("LandscapeGen.json"));
+
+	// Implement this with the graph to preview, Progressive_Preview calls it
+	// once per preview resolution
+	UFUNCTION(BlueprintImplementableEvent, Category = "Preview")
+		FHeightmapWrapper Evaluate_Graph();
+
+	// Evaluates Evaluate_Graph at each of PreviewLODs (coarsest first) and then
+	// at full resolution, showing each result in Texture as soon as it's ready.
+	// Calling it again drops whatever is still queued for the previous preview
+	UFUNCTION(BlueprintCallable, Category = "Preview")
+		void Progressive_Preview(UTexture2D* Texture);
+
+	// Resolutions shown before the full resolution result, 3 is 1/8 resolution
+	UPROPERTY(EditAnywhere, Category = "Preview")
+		TArray<int32> PreviewLODs;
+
 	// Tick in Editor
 	virtual bool ShouldTickIfViewportsOnly() const override { return true; };
 
@@ -108,6 +300,28 @@ protected:
 
 	TArray<uint16> GetLandscapeHeightmapSorted();
 
+	// Size and region nodes generate at, smaller than the landscape while a
+	// low resolution preview is being evaluated
+	void GetGraphSize(int32& SizeX, int32& SizeY) const;
+	LandscapeGeneration::Kernels::TileRegion GetGraphRegion() const;
+
+	// Pushes a node's kernel as a job that waits on the jobs of its Inputs and is
+	// attached to its Outputs. Jobs pushed while evaluating a preview are
+	// cancelled when the next preview starts. NodeName is what the node shows
+	// up as when profiling, it has to be a literal
+	// A node with one input and one output of the same size
+	FHeightmapWrapper PushFilterNode(const char* NodeName, const FHeightmapWrapper& HeightMap,
+		std::function<void(boost::compute::image2d&, boost::compute::image2d&)> Filter);
+
+	std::shared_ptr<LandscapeGeneration::Job> PushNodeKernel(const char* NodeName, std::function<void(LandscapeGeneration::Job&)> KernelFunc,
+		const std::vector<const FHeightmapWrapper*>& Inputs = std::vector<const FHeightmapWrapper*>(),
+		const std::vector<FHeightmapWrapper*>& Outputs = std::vector<FHeightmapWrapper*>());
+
+	int32 PreviewLOD;
+
+	bool bEvaluatingPreview;
+	std::vector<std::shared_ptr<LandscapeGeneration::Job>> PreviewJobs;
+
 	std::future<TSharedPtr<SNotificationItem>> CreateNotification(const FText& InText);
 	//void FinishNotification(FHeightMapInfoWrapper HeightInfo, const FText& InText, bool bFailure);
 
@@ -4,22 +4,11 @@
 
 #include "Core.h"
 
-// Disable warning for GNU_C not being defined
-#pragma warning(push)
-#pragma warning(disable: 4668)
-#define BOOST_COMPUTE_THREAD_SAFE
-#define BOOST_COMPUTE_DEBUG_KERNEL_COMPILATION
-#define BOOST_DISABLE_ABI_HEADERS
-#include <boost/compute/system.hpp>
-#include <boost/compute/image/image2d.hpp>
-#include <boost/compute/utility/dim.hpp>
-#include <boost/compute/utility/source.hpp>
-#pragma warning(pop)
+// The engine independent part of the generation lives in GenerationCore, this
+// adapts it to Unreal: Blueprint enums, TArray conversions and logging
+#include "LandscapeGenerationCore.h"
 
 #include <vector>
-#include <mutex>
-#include <string>
-#include <memory>
 
 #include "CoreMinimal.h"
 #include "LandscapeGeneration.generated.h"
@@ -34,78 +23,50 @@ enum class EMixType : uint8
 	E_Max			= 4 UMETA(DisplayName = "Maxmimum")
 };
 
-namespace LandscapeGeneration
+UENUM(BlueprintType)
+enum class EJobStatus : uint8
 {
-	extern boost::compute::image_format ImageFormat;
-
-	class Heightmap
-	{
-	public:
-		Heightmap(
-			int SizeX, 
-			int SizeY, 
-			boost::compute::image_format inImageFormat
-				= ImageFormat
-		);
-
-		// Copy the heightmap from the device to the client in a TArray<uint16>
-		operator TArray<uint16>() const;
-		operator TArray<float>() const;
-
-		void* CreateRawCopy() const;
+	E_Queued		= 0	UMETA(DisplayName = "Queued"),
+	E_Running		= 1	UMETA(DisplayName = "Running"),
+	E_Succeeded		= 2	UMETA(DisplayName = "Succeeded"),
+	E_Failed		= 3	UMETA(DisplayName = "Failed"),
+	E_Cancelled		= 4	UMETA(DisplayName = "Cancelled")
+};
 
-		boost::compute::image2d Image;
-	};
+UENUM(BlueprintType)
+enum class EMipReduction : uint8
+{
+	E_Min			= 0	UMETA(DisplayName = "Minimum"),
+	E_Max			= 1	UMETA(DisplayName = "Maximum"),
+	E_Average		= 2	UMETA(DisplayName = "Average")
+};
 
-	// Make sure you call SetDevices to initialize the module
-	void SetDevices(std::vector<boost::compute::device> Devices);
+namespace LandscapeGeneration
+{
+	// Points the core at the module's kernels and sends its log to UE_LOG.
+	// Called when the module starts up, also starts publishing Stats as STAT counters
+	void SetupForUnreal();
+	void ShutdownForUnreal();
 
-	// Creates a heightmap on the device and returns a wrapper pointer to it
-	std::shared_ptr<Heightmap> CreateHeightmap(
-		int SizeX, 
-		int SizeY, 
-		boost::compute::image_format inImageFormat 
-			= ImageFormat
-	);
+	// Starts the warm up (see StartWarmUp) for the size of the last graph that
+	// was evaluated, unless [LandscapeGeneration] bWarmUp is false
+	void StartWarmUpForUnreal();
 
-	void PushKernel(std::function<void()> KernelFunc);
+	// Saves the graph size in the game config for the next warm up
+	void RememberGraphSize(int32 SizeX, int32 SizeY);
 
-	// Manages the kernel thread. Should be ticked from UE4's game thread
-	void Tick();
+	inline MixOperation ToCore(EMixType MixType) { return (MixOperation)MixType; }
+	inline MipReduction ToCore(EMipReduction Reduction) { return (MipReduction)Reduction; }
+	inline EJobStatus ToUnreal(JobStatus Status) { return (EJobStatus)Status; }
 
-	namespace Kernels
+	// Copies the heightmap from the device to the host, see the conversions on Heightmap
+	template<typename T>
+	TArray<T> ReadHeightmap(const Heightmap& Map)
 	{
-		void PerlinNoise(boost::compute::image2d& Heightmap,
-			float noiseSize, int32 seed, int32 depth, float amplitude);
-
-		void WarpedPerlinNoise(boost::compute::image2d& Heightmap,
-			float noiseSize, int32 seed, int32 depth, float amplitude);
-
-		void Mix(boost::compute::image2d& LHeightMap,
-			boost::compute::image2d& RHeightMap,
-			boost::compute::image2d& OutputHeightmap,
-			EMixType MixType);
-
-		void VoronoiNoise(boost::compute::image2d& Heightmap,
-			int32 noiseSize,
-			int32 seed,
-			float amplitude);
-
-		void Constant(boost::compute::image2d& Heightmap,
-			float height);
-
-		struct ErosionParams
-		{
-			std::shared_ptr<Heightmap> height, water, hardness, sediment, sedimentCapacity, flux, velocity;
-		};
-
+		const std::vector<T> Data = Map;
 
-		ErosionParams Erosion(ErosionParams inputMaps,
-			int32 iterations,
-			float DeltaTime,
-			float waterMul,
-			float softeningCoefficient,
-			float maxErosionDepth,
-			float sedimentCapacity);
+		TArray<T> OutArray;
+		OutArray.Append(Data.data(), (int32)Data.size());
+		return OutArray;
 	}
 }
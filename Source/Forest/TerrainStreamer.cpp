@@ -0,0 +1,378 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "TerrainStreamer.h"
+#include "TileCache.h"
+#include "Async/Async.h"
+#include "Kismet/GameplayStatics.h"
+#include "Materials/MaterialInterface.h"
+#include "ProceduralMeshComponent.h"
+
+#include <vector>
+
+// Tiles need a pixel either side of the chunk for the normals, and one more
+// for the vertices on the far edge
+static const int32 ChunkBorder = 3;
+
+// A failed chunk waits this long before it's requested again, doubling with
+// every failure up to the maximum, so a persistent error doesn't resubmit it
+// and log a warning every frame
+static const double ChunkRetrySeconds		= 1.0;
+static const double MaxChunkRetrySeconds	= 60.0;
+
+// Mesh data is built from the heights read back from the device. Vertex (x, y)
+// is tile pixel (x + 1, y + 1)
+static std::shared_ptr<FTerrainChunkData> BuildChunkMesh(const FIntPoint& Chunk, const std::vector<float>& Heights,
+	int32 ChunkQuads, float VertexSpacing, float HeightScale)
+{
+	std::shared_ptr<FTerrainChunkData> ChunkData(new FTerrainChunkData());
+	ChunkData->Chunk = Chunk;
+
+	const int32 TileResolution	= ChunkQuads + ChunkBorder;
+	const int32 ChunkVerts		= ChunkQuads + 1;
+
+	auto Height = [&](int32 x, int32 y) -> float
+	{
+		return Heights[y * TileResolution + x] * HeightScale;
+	};
+
+	ChunkData->Vertices.Reserve(ChunkVerts * ChunkVerts);
+	ChunkData->Normals.Reserve(ChunkVerts * ChunkVerts);
+	ChunkData->UV0.Reserve(ChunkVerts * ChunkVerts);
+
+	for (int32 y = 0; y < ChunkVerts; y++)
+	{
+		for (int32 x = 0; x < ChunkVerts; x++)
+		{
+			const float WorldX = (float)(Chunk.X * ChunkQuads + x) * VertexSpacing;
+			const float WorldY = (float)(Chunk.Y * ChunkQuads + y) * VertexSpacing;
+
+			ChunkData->Vertices.Add(FVector(WorldX, WorldY, Height(x + 1, y + 1)));
+
+			// Central differences, using the border pixels on the edges
+			const float dx = (Height(x + 2, y + 1) - Height(x, y + 1)) / (2.f * VertexSpacing);
+			const float dy = (Height(x + 1, y + 2) - Height(x + 1, y)) / (2.f * VertexSpacing);
+			ChunkData->Normals.Add(FVector(-dx, -dy, 1.f).GetSafeNormal());
+
+			ChunkData->UV0.Add(FVector2D((float)x / ChunkQuads, (float)y / ChunkQuads));
+		}
+	}
+
+	ChunkData->Triangles.Reserve(ChunkQuads * ChunkQuads * 6);
+
+	for (int32 y = 0; y < ChunkQuads; y++)
+	{
+		for (int32 x = 0; x < ChunkQuads; x++)
+		{
+			const int32 i00 = y * ChunkVerts + x;
+			const int32 i10 = i00 + 1;
+			const int32 i01 = i00 + ChunkVerts;
+			const int32 i11 = i01 + 1;
+
+			ChunkData->Triangles.Append({ i00, i01, i10 });
+			ChunkData->Triangles.Append({ i10, i01, i11 });
+		}
+	}
+
+	return ChunkData;
+}
+
+ATerrainStreamer::ATerrainStreamer(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = true;
+
+	Mesh = CreateDefaultSubobject<UProceduralMeshComponent>(TEXT("TerrainMesh"));
+	Mesh->bUseAsyncCooking = true;
+	RootComponent = Mesh;
+
+	StreamingSource		= nullptr;
+	ChunkQuads			= 63;
+	VertexSpacing		= 100.f;
+	HeightScale			= 1.f;
+	LoadRadius			= 6;
+	UnloadHysteresis	= 2;
+	PrefetchSeconds		= 2.f;
+	PrefetchRadius		= 2;
+	MaxPendingChunks	= 8;
+	MaxUploadsPerFrame	= 2;
+	UploadBudgetMs		= 2.f;
+	bCreateCollision	= true;
+	Material			= nullptr;
+
+	NoiseType			= ETerrainNoiseType::E_Perlin;
+	NoiseSize			= 256.f;
+	Seed				= 0;
+	Depth				= 6;
+	Amplitude			= 2000.f;
+
+	SourceChunk			= FIntPoint(0, 0);
+	PrefetchChunk		= FIntPoint(0, 0);
+	NextSection			= 0;
+}
+
+void ATerrainStreamer::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (StreamingSource == nullptr)
+	{
+		StreamingSource = UGameplayStatics::GetPlayerCharacter(this, 0);
+	}
+
+	RegenerateTerrain();
+}
+
+void ATerrainStreamer::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	// Anything still on the kernel thread keeps its own reference
+	StreamingState.reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ATerrainStreamer::RegenerateTerrain()
+{
+	Mesh->ClearAllMeshSections();
+
+	LoadedChunks.Empty();
+	PendingChunks.Empty();
+	FailedChunks.Empty();
+	FreeSections.Empty();
+	NextSection = 0;
+
+	StreamingState = std::make_shared<FTerrainStreamingState>();
+	StreamingState->Cache.reset(new LandscapeGeneration::TileCache(ChunkQuads, ChunkBorder));
+}
+
+FIntPoint ATerrainStreamer::GetChunkAt(const FVector& Location) const
+{
+	const FVector Local = Location - GetActorLocation();
+	const float ChunkWorldSize = ChunkQuads * VertexSpacing;
+
+	return FIntPoint(
+		FMath::FloorToInt(Local.X / ChunkWorldSize),
+		FMath::FloorToInt(Local.Y / ChunkWorldSize));
+}
+
+static bool IsWithinRadius(const FIntPoint& A, const FIntPoint& B, int32 Radius)
+{
+	const FIntPoint Delta = A - B;
+	return Delta.X * Delta.X + Delta.Y * Delta.Y <= Radius * Radius;
+}
+
+bool ATerrainStreamer::IsChunkWanted(const FIntPoint& Chunk) const
+{
+	return IsWithinRadius(Chunk, SourceChunk, LoadRadius + UnloadHysteresis)
+		|| IsWithinRadius(Chunk, PrefetchChunk, PrefetchRadius + UnloadHysteresis);
+}
+
+void ATerrainStreamer::UpdateDesiredChunks()
+{
+	if (StreamingSource != nullptr)
+	{
+		const FVector Location = StreamingSource->GetActorLocation();
+
+		SourceChunk		= GetChunkAt(Location);
+		PrefetchChunk	= GetChunkAt(Location + StreamingSource->GetVelocity() * PrefetchSeconds);
+	}
+
+	// Drop everything that's fallen outside of the hysteresis band
+	TArray<FIntPoint> ToUnload;
+	for (auto& Loaded : LoadedChunks)
+	{
+		if (!IsChunkWanted(Loaded.Key))
+			ToUnload.Add(Loaded.Key);
+	}
+
+	for (auto& Chunk : ToUnload)
+	{
+		UnloadChunk(Chunk);
+	}
+
+	// Failures are forgotten the same way, coming back to a chunk tries it straight away
+	for (auto It = FailedChunks.CreateIterator(); It; ++It)
+	{
+		if (!IsChunkWanted(It.Key()))
+			It.RemoveCurrent();
+	}
+
+	// Closest chunks first, then the ones we're heading towards
+	auto AddRing = [](TArray<FIntPoint>& Out, const FIntPoint& Center, int32 Radius)
+	{
+		const int32 First = Out.Num();
+
+		for (int32 y = -Radius; y <= Radius; y++)
+		{
+			for (int32 x = -Radius; x <= Radius; x++)
+			{
+				if (x * x + y * y <= Radius * Radius)
+					Out.Add(Center + FIntPoint(x, y));
+			}
+		}
+
+		Sort(Out.GetData() + First, Out.Num() - First, [&](const FIntPoint& A, const FIntPoint& B)
+		{
+			const FIntPoint DA = A - Center;
+			const FIntPoint DB = B - Center;
+			return DA.X * DA.X + DA.Y * DA.Y < DB.X * DB.X + DB.Y * DB.Y;
+		});
+	};
+
+	TArray<FIntPoint> Desired;
+	AddRing(Desired, SourceChunk, LoadRadius);
+	if (PrefetchChunk != SourceChunk)
+	{
+		AddRing(Desired, PrefetchChunk, PrefetchRadius);
+	}
+
+	const double Now = FPlatformTime::Seconds();
+
+	for (auto& Chunk : Desired)
+	{
+		if (PendingChunks.Num() >= MaxPendingChunks)
+			break;
+
+		if (LoadedChunks.Contains(Chunk) || PendingChunks.Contains(Chunk))
+			continue;
+
+		const FFailedTerrainChunk* Failed = FailedChunks.Find(Chunk);
+		if (Failed != nullptr && Now < Failed->RetryTime)
+			continue;
+
+		RequestChunk(Chunk);
+	}
+}
+
+void ATerrainStreamer::RequestChunk(const FIntPoint& Chunk)
+{
+	LandscapeGeneration::TileGraph Graph;
+	switch (NoiseType)
+	{
+	case ETerrainNoiseType::E_WarpedPerlin:
+		Graph = LandscapeGeneration::WarpedPerlinTileGraph(NoiseSize, Seed, Depth, Amplitude);
+		break;
+	case ETerrainNoiseType::E_Voronoi:
+		Graph = LandscapeGeneration::VoronoiTileGraph((int32)NoiseSize, Seed, Amplitude);
+		break;
+	case ETerrainNoiseType::E_Simplex:
+		Graph = LandscapeGeneration::SimplexTileGraph(NoiseSize, Seed, Depth, Amplitude);
+		break;
+	case ETerrainNoiseType::E_Gradient:
+		Graph = LandscapeGeneration::GradientTileGraph(NoiseSize, Seed, Depth, Amplitude);
+		break;
+	default:
+		Graph = LandscapeGeneration::PerlinTileGraph(NoiseSize, Seed, Depth, Amplitude);
+		break;
+	}
+
+	PendingChunks.Add(Chunk);
+
+	auto State					= StreamingState;
+	const int32 Quads			= ChunkQuads;
+	const float Spacing			= VertexSpacing;
+	const float Scale			= HeightScale;
+
+	LandscapeGeneration::PushKernel([=]() -> void
+	{
+		std::vector<float> Heights;
+
+		try
+		{
+			auto Tile = State->Cache->GetTile(Graph, Chunk.X, Chunk.Y, 0);
+
+			const int32 TileResolution = State->Cache->GetTileResolution();
+			float* RawCopy = (float*)Tile->CreateRawCopy();
+			Heights.assign(RawCopy, RawCopy + TileResolution * TileResolution);
+			delete[] (uint8*)RawCopy;
+		}
+		catch (std::exception& e)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("Terrain chunk (%d, %d) failed: %s"), Chunk.X, Chunk.Y, ANSI_TO_TCHAR(e.what()));
+
+			// An empty chunk still has to come back so it stops being pending
+			std::shared_ptr<FTerrainChunkData> Failed(new FTerrainChunkData());
+			Failed->Chunk	= Chunk;
+			Failed->bFailed	= true;
+			State->CompletedChunks.Enqueue(Failed);
+			return;
+		}
+
+		// Building the mesh doesn't need the device, don't hold up the kernel thread with it
+		Async<void>(EAsyncExecution::ThreadPool, [=]()
+		{
+			State->CompletedChunks.Enqueue(BuildChunkMesh(Chunk, Heights, Quads, Spacing, Scale));
+		});
+	});
+}
+
+void ATerrainStreamer::UnloadChunk(const FIntPoint& Chunk)
+{
+	int32 Section;
+	if (LoadedChunks.RemoveAndCopyValue(Chunk, Section))
+	{
+		Mesh->ClearMeshSection(Section);
+		FreeSections.Add(Section);
+	}
+}
+
+void ATerrainStreamer::UploadCompletedChunks()
+{
+	const double StartTime = FPlatformTime::Seconds();
+	int32 Uploads = 0;
+
+	std::shared_ptr<FTerrainChunkData> ChunkData;
+	while (Uploads < MaxUploadsPerFrame
+		&& (FPlatformTime::Seconds() - StartTime) * 1000.0 < UploadBudgetMs
+		&& StreamingState->CompletedChunks.Dequeue(ChunkData))
+	{
+		PendingChunks.Remove(ChunkData->Chunk);
+
+		if (ChunkData->bFailed)
+		{
+			FFailedTerrainChunk& Failed = FailedChunks.FindOrAdd(ChunkData->Chunk);
+			Failed.Attempts++;
+			Failed.RetryTime = FPlatformTime::Seconds()
+				+ FMath::Min(ChunkRetrySeconds * (double)(1 << FMath::Min(Failed.Attempts - 1, 16)), MaxChunkRetrySeconds);
+			continue;
+		}
+
+		FailedChunks.Remove(ChunkData->Chunk);
+
+		// We've moved away from it while it was being generated
+		if (!IsChunkWanted(ChunkData->Chunk))
+			continue;
+
+		int32 Section;
+		if (const int32* Existing = LoadedChunks.Find(ChunkData->Chunk))
+		{
+			Section = *Existing;
+		}
+		else
+		{
+			Section = FreeSections.Num() > 0 ? FreeSections.Pop() : NextSection++;
+			LoadedChunks.Add(ChunkData->Chunk, Section);
+		}
+
+		Mesh->CreateMeshSection(Section, ChunkData->Vertices, ChunkData->Triangles, ChunkData->Normals,
+			ChunkData->UV0, TArray<FColor>(), TArray<FProcMeshTangent>(), bCreateCollision);
+
+		if (Material != nullptr)
+			Mesh->SetMaterial(Section, Material);
+
+		Uploads++;
+	}
+}
+
+void ATerrainStreamer::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	LandscapeGeneration::Tick();
+
+	if (!StreamingState)
+		return;
+
+	UploadCompletedChunks();
+	UpdateDesiredChunks();
+}
@@ -0,0 +1,175 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Queue.h"
+#include "GameFramework/Actor.h"
+
+#include "LandscapeGeneration.h"
+
+#include <memory>
+
+#include "TerrainStreamer.generated.h"
+
+class UProceduralMeshComponent;
+class UMaterialInterface;
+
+namespace LandscapeGeneration
+{
+	class TileCache;
+}
+
+UENUM(BlueprintType)
+enum class ETerrainNoiseType : uint8
+{
+	E_Perlin		= 0	UMETA(DisplayName = "Perlin"),
+	E_WarpedPerlin	= 1	UMETA(DisplayName = "Warped Perlin"),
+	E_Voronoi		= 2	UMETA(DisplayName = "Voronoi"),
+	E_Simplex		= 3	UMETA(DisplayName = "Simplex"),
+	E_Gradient		= 4	UMETA(DisplayName = "Gradient")
+};
+
+// Mesh data for one chunk, built off of the game thread
+struct FTerrainChunkData
+{
+	FIntPoint			Chunk;
+
+	// Generating the heights threw, there's no mesh
+	bool				bFailed = false;
+
+	TArray<FVector>		Vertices;
+	TArray<int32>		Triangles;
+	TArray<FVector>		Normals;
+	TArray<FVector2D>	UV0;
+};
+
+// Everything the kernel thread and the mesh building tasks touch. It's kept
+// alive by the work that's in flight, so the actor can go away at any time
+struct FTerrainStreamingState
+{
+	std::unique_ptr<LandscapeGeneration::TileCache>					Cache;
+	TQueue<std::shared_ptr<FTerrainChunkData>, EQueueMode::Mpsc>	CompletedChunks;
+};
+
+// A chunk that failed to generate, and when it can be tried again
+struct FFailedTerrainChunk
+{
+	int32	Attempts	= 0;
+	double	RetryTime	= 0.0;
+};
+
+// Generates terrain around a moving actor (the player character by default)
+// at runtime. Chunks are evaluated lazily through a TileCache on the kernel
+// thread, turned in to meshes on the thread pool and uploaded to a procedural
+// mesh a few at a time so a burst of finished chunks can't cause a hitch.
+// Chunks ahead of the streaming source are requested early based on its velocity.
+// Chunks that fail are retried with a growing delay, and forgotten once
+// the streaming source leaves them behind
+UCLASS()
+class FOREST_API ATerrainStreamer : public AActor
+{
+	GENERATED_UCLASS_BODY()
+
+public:
+	// The actor to stream terrain around, the player's character if not set
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Streaming")
+		AActor* StreamingSource;
+
+	// Quads along each side of a chunk
+	UPROPERTY(EditAnywhere, Category = "Streaming", meta = (ClampMin = "1", ClampMax = "255"))
+		int32 ChunkQuads;
+
+	// Distance between two neighbouring vertices, in world units
+	UPROPERTY(EditAnywhere, Category = "Streaming", meta = (ClampMin = "1"))
+		float VertexSpacing;
+
+	UPROPERTY(EditAnywhere, Category = "Streaming")
+		float HeightScale;
+
+	// Chunks closer than this to the streaming source are kept loaded, in chunks
+	UPROPERTY(EditAnywhere, Category = "Streaming", meta = (ClampMin = "0"))
+		int32 LoadRadius;
+
+	// Chunks are only unloaded once they're this many chunks outside of the load radius
+	UPROPERTY(EditAnywhere, Category = "Streaming", meta = (ClampMin = "0"))
+		int32 UnloadHysteresis;
+
+	// How far ahead, in seconds, to predict the streaming source's position
+	UPROPERTY(EditAnywhere, Category = "Streaming", meta = (ClampMin = "0"))
+		float PrefetchSeconds;
+
+	// Radius of the ring of chunks requested around the predicted position
+	UPROPERTY(EditAnywhere, Category = "Streaming", meta = (ClampMin = "0"))
+		int32 PrefetchRadius;
+
+	// Upper limit of chunks waiting on the kernel thread
+	UPROPERTY(EditAnywhere, Category = "Streaming", meta = (ClampMin = "1"))
+		int32 MaxPendingChunks;
+
+	UPROPERTY(EditAnywhere, Category = "Upload Budget", meta = (ClampMin = "1"))
+		int32 MaxUploadsPerFrame;
+
+	// Stop uploading chunks for this frame once this much time has been spent on it
+	UPROPERTY(EditAnywhere, Category = "Upload Budget", meta = (ClampMin = "0"))
+		float UploadBudgetMs;
+
+	UPROPERTY(EditAnywhere, Category = "Rendering")
+		bool bCreateCollision;
+
+	UPROPERTY(EditAnywhere, Category = "Rendering")
+		UMaterialInterface* Material;
+
+	UPROPERTY(EditAnywhere, Category = "Noise")
+		ETerrainNoiseType NoiseType;
+
+	UPROPERTY(EditAnywhere, Category = "Noise")
+		float NoiseSize;
+
+	UPROPERTY(EditAnywhere, Category = "Noise")
+		int32 Seed;
+
+	UPROPERTY(EditAnywhere, Category = "Noise")
+		int32 Depth;
+
+	UPROPERTY(EditAnywhere, Category = "Noise")
+		float Amplitude;
+
+	// Throws away all of the chunks and starts again with the current settings
+	UFUNCTION(BlueprintCallable, Category = "Streaming")
+		void RegenerateTerrain();
+
+	virtual void Tick(float DeltaTime) override;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Works out which chunks should be loaded and requests the missing ones
+	void UpdateDesiredChunks();
+
+	void RequestChunk(const FIntPoint& Chunk);
+	void UnloadChunk(const FIntPoint& Chunk);
+
+	// Moves finished chunks on to the mesh, within this frame's upload budget
+	void UploadCompletedChunks();
+
+	FIntPoint GetChunkAt(const FVector& Location) const;
+	bool IsChunkWanted(const FIntPoint& Chunk) const;
+
+	UPROPERTY(VisibleAnywhere, Category = "Rendering")
+		UProceduralMeshComponent* Mesh;
+
+	// Replaced when the terrain is regenerated, chunks still in flight for
+	// the old state finish in to a queue nobody reads
+	std::shared_ptr<FTerrainStreamingState>	StreamingState;
+
+	FIntPoint					SourceChunk;
+	FIntPoint					PrefetchChunk;
+
+	TMap<FIntPoint, int32>		LoadedChunks;
+	TSet<FIntPoint>				PendingChunks;
+	TMap<FIntPoint, FFailedTerrainChunk>	FailedChunks;
+	TArray<int32>				FreeSections;
+	int32						NextSection;
+};